@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+#include "adr.h"
+#include "airtime.h"
+#include "metrics.h"
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+/* Demodulation floor of SF7 - SF12 in 0.1 dB, Semtech SX1261/2 datasheet */
+static const int16_t required_snr[] = {-75, -100, -125, -150, -175, -200};
+
+static int pinned = LORA_DR_PIN;
+static int adaptive_dr = ADR_START_DR;
+static int16_t history[ADR_HISTORY];
+static int history_count = 0;
+static int no_ack_count = 0;
+static adr_stats stats;
+
+//////////////////////////////////////////////////
+//                ADR FUNCTIONS                 //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Returns the lowest SNR the given data rate can be received at.
+ *
+ * \param: 1 param: data rate index.
+ *
+ * \return: SNR in 0.1 dB
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static int16_t requiredSnr(int dr) {
+    return required_snr[dataRate(dr)->sf - 7];
+}
+
+/**********************************************************************************************************************
+ * \brief: Moves the adaptive data rate and forgets the measurements taken at the previous one.
+ *
+ * \param: 1 param: new data rate index, limited to ADR_MIN_DR - ADR_MAX_DR.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void moveTo(int dr) {
+    if (dr > ADR_MAX_DR) {
+        dr = ADR_MAX_DR;
+    } else if (dr < ADR_MIN_DR) {
+        dr = ADR_MIN_DR;
+    }
+    if (dr > adaptive_dr) {
+        stats.steps_up++;
+    } else if (dr < adaptive_dr) {
+        stats.steps_down++;
+    }
+    adaptive_dr = dr;
+    history_count = 0;
+    no_ack_count = 0;
+}
+
+/**********************************************************************************************************************
+ * \brief: Starts the adaptation over from ADR_START_DR. Keeps the pinned data rate.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void adrReset() {
+    adaptive_dr = ADR_START_DR;
+    history_count = 0;
+    no_ack_count = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**********************************************************************************************************************
+ * \brief: Finds the link quality reported with a downlink, e.g. "+CMSG: RXWIN1, RSSI -106, SNR 4.5", in a modem
+ *         response.
+ *
+ * \param: 3 params: response string, pointers to the RSSI in dBm and SNR in 0.1 dB to read to.
+ *
+ * \return: true: if both RSSI and SNR were found, false: otherwise
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+bool adrParseLink(const char *response, int *rssi, int *snr_db10) {
+    const char *rssi_str = strstr(response, "RSSI ");
+    const char *snr_str = strstr(response, "SNR ");
+    char *end;
+
+    if (NULL == rssi_str || NULL == snr_str) {
+        return false;
+    }
+    *rssi = strtol(rssi_str + 5, &end, 10);
+    if (end == rssi_str + 5) {
+        return false;
+    }
+
+    snr_str += 4;
+    bool negative = '-' == *snr_str;
+    long whole = strtol(snr_str, &end, 10);
+    if (end == snr_str) {
+        return false;
+    }
+    int tenths = 0;
+    if ('.' == end[0] && end[1] >= '0' && end[1] <= '9') {
+        tenths = end[1] - '0';
+    }
+    *snr_db10 = (int) whole * 10 + (negative ? -tenths : tenths);
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Feeds the outcome of a finished uplink to the adaptation. The best SNR of the recent downlinks decides how
+ *         many 2.5 dB steps above or below the margin the link is, and the data rate is moved by that many steps.
+ *         Repeated missing acknowledgements step the data rate down.
+ *
+ * \param: 3 params: modem response of the exchange, true if the uplink was confirmed and true if it was acknowledged.
+ *
+ * \return:
+ *
+ * \remarks: Only confirmed uplinks get a downlink to measure. A faster data rate needs ADR_STEP_UP_SAMPLES
+ *           measurements, a slower one is taken at once.
+ **********************************************************************************************************************/
+void adrReport(const char *response, bool confirmed, bool acked) {
+    int rssi, snr;
+
+    if (true == confirmed && false == acked) {
+        if (++no_ack_count >= ADR_NO_ACK_LIMIT) {
+            moveTo(adaptive_dr - 1);
+        }
+        return;
+    }
+    if (false == adrParseLink(response, &rssi, &snr)) {
+        return;
+    }
+    no_ack_count = 0;
+    stats.rssi_last = rssi;
+    stats.snr_last = snr;
+    stats.measurements++;
+    metricsRecord(MH_RSSI, rssi);
+    metricsRecord(MH_SNR, snr);
+
+    history[history_count % ADR_HISTORY] = snr;
+    history_count++;
+
+    int16_t best = history[0];
+    for (int i = 1; i < history_count && i < ADR_HISTORY; i++) {
+        if (history[i] > best) {
+            best = history[i];
+        }
+    }
+    int margin = best - requiredSnr(adaptive_dr) - ADR_MARGIN_DB10;
+    if (margin < 0) {
+        moveTo(adaptive_dr - (-margin + ADR_STEP_DB10 - 1) / ADR_STEP_DB10);
+    } else if (margin >= ADR_STEP_DB10 && history_count >= ADR_STEP_UP_SAMPLES) {
+        moveTo(adaptive_dr + margin / ADR_STEP_DB10);
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the data rate uplinks should use: the pinned one if set, the adapted one otherwise.
+ *
+ * \param:
+ *
+ * \return: data rate index
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int adrDataRate() {
+    return ADR_AUTO == pinned ? adaptive_dr : pinned;
+}
+
+/**********************************************************************************************************************
+ * \brief: Continues the adaptation from the given data rate, e.g. when the modem refused to change it.
+ *
+ * \param: 1 param: data rate index.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void adrSetDataRate(int dr) {
+    moveTo(dr);
+}
+
+/**********************************************************************************************************************
+ * \brief: Pins the data rate, overriding the adaptation.
+ *
+ * \param: 1 param: data rate index 0 - 6, or ADR_AUTO to resume the adaptation.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void adrPin(int dr) {
+    pinned = (dr >= 0 && dr < LORA_DR_COUNT) ? dr : ADR_AUTO;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the pinned data rate.
+ *
+ * \param:
+ *
+ * \return: data rate index, ADR_AUTO if the data rate adapts to the link.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int adrPinned() {
+    return pinned;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the last link measurement and the number of data rate changes.
+ *
+ * \param:
+ *
+ * \return: pointer to the statistics.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const adr_stats *adrStatistics() {
+    return &stats;
+}
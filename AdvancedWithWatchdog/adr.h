@@ -0,0 +1,40 @@
+#ifndef ADR
+#define ADR
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ADR_AUTO (-1)
+
+/* Set LORA_DR_PIN to 0 - 6 to pin the data rate at build time, ADR_AUTO adapts it to the link */
+#ifndef LORA_DR_PIN
+#define LORA_DR_PIN ADR_AUTO
+#endif
+
+#define ADR_START_DR 3                       // SF9, carries the longest status message (115 bytes)
+#define ADR_MIN_DR 0
+#define ADR_MAX_DR 5                         // DR6 (SF7 / 250 kHz) is not served by all gateways
+#define ADR_MARGIN_DB10 100                  // installation margin above the demodulation floor, 0.1 dB
+#define ADR_STEP_DB10 25                     // SNR difference between neighbouring spreading factors
+#define ADR_HISTORY 4                        // link measurements kept at the current data rate
+#define ADR_STEP_UP_SAMPLES 2                // measurements needed before a faster data rate is tried
+#define ADR_NO_ACK_LIMIT 2                   // consecutive missing ACKs that step the data rate down
+
+typedef struct adr_stats_ {
+    int16_t rssi_last;                       // dBm
+    int16_t snr_last;                        // 0.1 dB
+    uint32_t measurements;
+    uint32_t steps_up;
+    uint32_t steps_down;
+} adr_stats;
+
+void adrReset();
+bool adrParseLink(const char *response, int *rssi, int *snr_db10);
+void adrReport(const char *response, bool confirmed, bool acked);
+int adrDataRate();
+void adrSetDataRate(int dr);
+void adrPin(int dr);
+int adrPinned();
+const adr_stats *adrStatistics();
+
+#endif
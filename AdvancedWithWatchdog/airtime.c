@@ -0,0 +1,71 @@
+#include "airtime.h"
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+static const data_rate data_rates[LORA_DR_COUNT] = {{12, 125000, 51},   // DR0
+                                                    {11, 125000, 51},   // DR1
+                                                    {10, 125000, 51},   // DR2
+                                                    {9,  125000, 115},  // DR3
+                                                    {8,  125000, 222},  // DR4
+                                                    {7,  125000, 222},  // DR5
+                                                    {7,  250000, 222}}; // DR6
+
+//////////////////////////////////////////////////
+//              AIRTIME FUNCTIONS               //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Returns the EU868 parameters of the given data rate.
+ *
+ * \param: 1 param: data rate index, DR0 - DR6.
+ *
+ * \return: pointer to the data rate entry, the default data rate entry if index is out of range.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const data_rate *dataRate(int dr) {
+    if (dr < 0 || dr >= LORA_DR_COUNT) {
+        dr = LORA_DEFAULT_DR;
+    }
+    return &data_rates[dr];
+}
+
+/**********************************************************************************************************************
+ * \brief: Calculates the time on air of one LoRa frame as given in Semtech AN1200.13. Explicit header, CRC on and
+ *         coding rate 4/5 are assumed, low data rate optimisation is on for SF11 and SF12 at 125 kHz.
+ *
+ * \param: 3 params: spreading factor, bandwidth in Hz and the PHY payload length in bytes.
+ *
+ * \return: time on air in microseconds.
+ *
+ * \remarks: Integer only. Symbol counts are kept in quarter symbols because the preamble adds 4.25 symbols.
+ **********************************************************************************************************************/
+uint32_t airtimeUs(uint8_t sf, uint32_t bandwidth, size_t phy_payload_len) {
+    int low_dr_optimize = (sf >= 11 && bandwidth == 125000) ? 1 : 0;
+    int numerator = 8 * (int) phy_payload_len - 4 * sf + 28 + 16;
+    int denominator = 4 * (sf - 2 * low_dr_optimize);
+    uint32_t payload_symbols = 8;
+
+    if (numerator > 0) {
+        payload_symbols += ((numerator + denominator - 1) / denominator) * (LORA_CODING_RATE + 4);
+    }
+
+    uint64_t quarter_symbols = 4 * LORA_PREAMBLE_SYMBOLS + 17 + 4 * (uint64_t) payload_symbols;
+    return (uint32_t) (quarter_symbols * (1UL << sf) * 1000000ULL / (4ULL * bandwidth));
+}
+
+/**********************************************************************************************************************
+ * \brief: Calculates the time on air of a LoRaWAN uplink carrying the given application payload.
+ *
+ * \param: 2 params: data rate index and application payload length in bytes.
+ *
+ * \return: time on air in microseconds.
+ *
+ * \remarks: Adds the LoRaWAN MAC overhead, assumes no piggybacked MAC commands.
+ **********************************************************************************************************************/
+uint32_t uplinkAirtimeUs(int dr, size_t app_payload_len) {
+    const data_rate *rate = dataRate(dr);
+    return airtimeUs(rate->sf, rate->bandwidth, app_payload_len + LORAWAN_OVERHEAD);
+}
@@ -0,0 +1,27 @@
+#ifndef AIRTIME
+#define AIRTIME
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*   LORA PHY   */
+#define LORA_PREAMBLE_SYMBOLS 8
+#define LORA_CODING_RATE 1           // 4/5
+#define LORAWAN_OVERHEAD 13          // MHDR(1) + FHDR(7) + FPort(1) + MIC(4)
+
+/*   EU868 DATA RATES   */
+#define LORA_DR_COUNT 7
+#define LORA_DEFAULT_DR 0            // LoRa-E5 factory default: SF12 / 125 kHz
+#define LORA_MIN_PAYLOAD 51          // maximum application payload of DR0 - DR2, fits every data rate
+
+typedef struct data_rate_ {
+    uint8_t sf;
+    uint32_t bandwidth;              // Hz
+    uint8_t max_payload;             // maximum application payload (N) in bytes
+} data_rate;
+
+const data_rate *dataRate(int dr);
+uint32_t airtimeUs(uint8_t sf, uint32_t bandwidth, size_t phy_payload_len);
+uint32_t uplinkAirtimeUs(int dr, size_t app_payload_len);
+
+#endif
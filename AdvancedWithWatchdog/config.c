@@ -0,0 +1,82 @@
+#include "config.h"
+#include "eeprom.h"
+#include "adr.h"
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+static deviceConfig current;
+
+//////////////////////////////////////////////////
+//              CONFIG FUNCTIONS                //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Returns the EEPROM address of a config slot.
+ *
+ * \param: 1 param: sequence number of the config.
+ *
+ * \return: uint16_t address
+ *
+ * \remarks: Consecutive sequence numbers alternate between the two slots.
+ **********************************************************************************************************************/
+static uint16_t slotAddress(uint32_t sequence) {
+    return CONFIG_ADDRESS + (sequence % CONFIG_SLOTS) * I2C_MEM_PAGE_SIZE;
+}
+
+/**********************************************************************************************************************
+ * \brief: Reads the config from EEPROM. Takes the valid slot with the higher sequence number, or the defaults if
+ *         neither slot is valid.
+ *
+ * \param: 1 param: default dispense interval in ms.
+ *
+ * \return:
+ *
+ * \remarks: Call once at boot, after i2cInit().
+ **********************************************************************************************************************/
+void configLoad(uint32_t default_interval) {
+    deviceConfig slot;
+    bool found = false;
+
+    current.sequence = 0;
+    current.dispenseInterval = default_interval;
+    current.dataRate = LORA_DR_PIN;
+
+    for (uint32_t i = 0; i < CONFIG_SLOTS; i++) {
+        if (readRecord(slotAddress(i), &slot, sizeof(slot)) && slot.sequence % CONFIG_SLOTS == i &&
+            (false == found || (int32_t) (slot.sequence - current.sequence) > 0)) {
+            current = slot;
+            found = true;
+        }
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the config in effect.
+ *
+ * \param:
+ *
+ * \return: pointer to the config.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const deviceConfig *configGet() {
+    return &current;
+}
+
+/**********************************************************************************************************************
+ * \brief: Stores a new config and puts it in effect. It is written to the slot not holding the config in effect.
+ *
+ * \param: 1 param: pointer to the new config, usually a modified copy of configGet().
+ *
+ * \return:
+ *
+ * \remarks: The sequence number is assigned here.
+ **********************************************************************************************************************/
+void configUpdate(const deviceConfig *config) {
+    deviceConfig next = *config;
+    next.sequence = current.sequence + 1;
+    writeRecord(slotAddress(next.sequence), &next, sizeof(next));
+    current = next;
+}
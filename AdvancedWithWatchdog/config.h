@@ -0,0 +1,23 @@
+#ifndef DEVICE_CONFIG
+#define DEVICE_CONFIG
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MIN_DISPENSE_INTERVAL 10000          // ms
+#define MAX_DISPENSE_INTERVAL 604800000      // ms, one week
+
+/* Settings that can be changed over the downlink command channel. Stored to two EEPROM slots in turn, the valid slot
+ * with the higher sequence number is in effect, so a power loss during a write keeps the previous settings. */
+typedef struct __attribute__((__packed__)) deviceConfig {
+    uint32_t sequence;
+    uint32_t dispenseInterval;               // ms between dispensed compartments
+    int8_t dataRate;                         // pinned data rate, ADR_AUTO to adapt to the link
+    uint16_t crc16;
+} deviceConfig;
+
+void configLoad(uint32_t default_interval);
+const deviceConfig *configGet();
+void configUpdate(const deviceConfig *config);
+
+#endif
@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "debuglog.h"
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+typedef enum {
+    RECORD_ARGS,
+    RECORD_STRING,                           // the argument is the string copied to string
+    RECORD_NUMBERED                          // number, then the string copied to string
+} record_kind;
+
+typedef struct debug_record_ {
+    const char *format;
+    record_kind kind;
+    union {
+        uintptr_t args[DEBUG_LOG_ARGS];
+        struct {
+            int32_t number;
+            char string[DEBUG_LOG_TEXT];
+        };
+    };
+} debug_record;
+
+/* Single producer, single consumer: the core of the queue writes head and dropped, the drain tail and reported */
+typedef struct debug_queue_ {
+    debug_record record[DEBUG_LOG_RECORDS];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;                        // records lost to a full queue
+    uint32_t reported;                       // dropped records the drain has reported
+} debug_queue;
+
+static debug_queue queue[2];
+static char out[DEBUG_LOG_OUT];
+static int dma_channel = -1;
+
+//////////////////////////////////////////////////
+//              DEBUG LOG FUNCTIONS             //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Claims a DMA channel that writes the formatted output to the stdio uart.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Call after stdio_init_all(). Without a free channel the output goes through stdio instead. Records can
+ *           be put before this, they wait in their queue.
+ **********************************************************************************************************************/
+void debugLogInit() {
+    int channel = dma_claim_unused_channel(false);
+    if (channel < 0) {
+        return;
+    }
+
+    dma_channel_config config = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(uart_default, true));
+    dma_channel_configure(channel, &config, &uart_get_hw(uart_default)->dr, out, 0, false);
+    hw_set_bits(&uart_get_hw(uart_default)->dmacr, UART_UARTDMACR_TXDMAE_BITS);
+    dma_channel = channel;
+}
+
+/**********************************************************************************************************************
+ * \brief: Takes the next free record of the queue of the calling core.
+ *
+ * \param: 1 param: queue of the calling core.
+ *
+ * \return: the record to fill, NULL if the queue is full
+ *
+ * \remarks: Interrupts are disabled by the caller, so an interrupt handler logging on the same core cannot take the
+ *           same record.
+ **********************************************************************************************************************/
+static debug_record *nextRecord(debug_queue *q) {
+    if (q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == DEBUG_LOG_RECORDS) {
+        q->dropped++;
+        return NULL;
+    }
+    return &q->record[q->head & (DEBUG_LOG_RECORDS - 1)];
+}
+
+/**********************************************************************************************************************
+ * \brief: Stores a format and its arguments for debugLogDrain(). Use it through the debugLog() macro, which counts the
+ *         arguments and passes them as uintptr_t.
+ *
+ * \param: 2 params plus the arguments: the constant format, the number of arguments and the uintptr_t arguments.
+ *
+ * \return:
+ *
+ * \remarks: Tens of cycles and safe in interrupt handlers and on both cores: nothing is formatted or sent here. A full
+ *           queue drops the record and counts it.
+ **********************************************************************************************************************/
+void debugLogPut(const char *format, int count, ...) {
+    debug_queue *q = &queue[get_core_num()];
+    uint32_t interrupts = save_and_disable_interrupts();
+    debug_record *record = nextRecord(q);
+
+    if (NULL != record) {
+        va_list args;
+        va_start(args, count);
+        for (int i = 0; i < count; i++) {
+            record->args[i] = va_arg(args, uintptr_t);
+        }
+        va_end(args);
+        record->format = format;
+        record->kind = RECORD_ARGS;
+        __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+    }
+    restore_interrupts(interrupts);
+}
+
+/**********************************************************************************************************************
+ * \brief: Stores a format with a copy of its string, and a number for a record of kind RECORD_NUMBERED.
+ *
+ * \param: 4 params: the constant format, the kind of record, the number and the string.
+ *
+ * \return:
+ *
+ * \remarks: The string is cut to DEBUG_LOG_TEXT - 1 bytes.
+ **********************************************************************************************************************/
+static void putText(const char *format, record_kind kind, int number, const char *string) {
+    debug_queue *q = &queue[get_core_num()];
+    uint32_t interrupts = save_and_disable_interrupts();
+    debug_record *record = nextRecord(q);
+
+    if (NULL != record) {
+        int i = 0;
+        for (; i < DEBUG_LOG_TEXT - 1 && '\0' != string[i]; i++) {
+            record->string[i] = string[i];
+        }
+        record->string[i] = '\0';
+        record->number = number;
+        record->format = format;
+        record->kind = kind;
+        __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+    }
+    restore_interrupts(interrupts);
+}
+
+/**********************************************************************************************************************
+ * \brief: Stores a format with a single %s and a copy of its string, for strings in buffers that change.
+ *
+ * \param: 2 params: the constant format and the string.
+ *
+ * \return:
+ *
+ * \remarks: The string is cut to DEBUG_LOG_TEXT - 1 bytes.
+ **********************************************************************************************************************/
+void debugLogString(const char *format, const char *string) {
+    putText(format, RECORD_STRING, 0, string);
+}
+
+/**********************************************************************************************************************
+ * \brief: Stores a format with a %d and then a %s, the number and a copy of the string, in one record.
+ *
+ * \param: 3 params: the constant format, the number and the string.
+ *
+ * \return:
+ *
+ * \remarks: For numbered lines of changing text, e.g. log entries. The string is cut to DEBUG_LOG_TEXT - 1 bytes.
+ **********************************************************************************************************************/
+void debugLogNumbered(const char *format, int number, const char *string) {
+    putText(format, RECORD_NUMBERED, number, string);
+}
+
+/**********************************************************************************************************************
+ * \brief: Drains the output until the queue of core 0 has room for a number of records.
+ *
+ * \param: 1 param: records about to be put, at most DEBUG_LOG_RECORDS.
+ *
+ * \return:
+ *
+ * \remarks: Core 0 only, like debugLogDrain(). For loops that put more records than the queue holds, it waits for
+ *           the output of the previous records to be sent.
+ **********************************************************************************************************************/
+void debugLogReserve(int records) {
+    debug_queue *q = &queue[0];
+
+    while (q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) > DEBUG_LOG_RECORDS - records) {
+        debugLogDrain();
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Formats a record of kind RECORD_ARGS, one conversion at a time with the type it expects.
+ *
+ * \param: 3 params: the record, where to format it to and the room there.
+ *
+ * \return: length of the formatted text, room or more if it did not fit
+ *
+ * \remarks: The arguments are stored as uintptr_t, so they are converted back to int, unsigned or a pointer by the
+ *           conversion, which a single snprintf() of the whole format could not do. Text that does not fit is cut
+ *           like snprintf() cuts it. An unknown conversion ends the text.
+ **********************************************************************************************************************/
+static int formatArgs(const debug_record *record, char *buffer, int room) {
+    const char *f = record->format;
+    int length = 0;
+    int arg = 0;
+    char spec[12];
+
+    while ('\0' != *f) {
+        if ('%' != *f || '%' == f[1]) {
+            if (length < room - 1) {
+                buffer[length] = *f;
+            }
+            length++;
+            f += '%' == *f ? 2 : 1;
+            continue;
+        }
+        int n = (int) strspn(f + 1, "-+ #0123456789.") + 2;
+        if (n >= (int) sizeof(spec) || arg >= DEBUG_LOG_ARGS) {
+            break;
+        }
+        memcpy(spec, f, n);
+        spec[n] = '\0';
+        uintptr_t value = record->args[arg++];
+        char *at = length < room ? &buffer[length] : NULL;
+        int left = length < room ? room - length : 0;
+        int written;
+        switch (spec[n - 1]) {
+            case 'd':
+            case 'i':
+            case 'c':
+                written = snprintf(at, left, spec, (int) value);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                written = snprintf(at, left, spec, (unsigned) value);
+                break;
+            case 's':
+                written = snprintf(at, left, spec, (const char *) value);
+                break;
+            case 'p':
+                written = snprintf(at, left, spec, (void *) value);
+                break;
+            default:
+                written = -1;
+        }
+        if (written < 0) {
+            break;
+        }
+        length += written;
+        f += n;
+    }
+    if (room > 0) {
+        buffer[length < room ? length : room - 1] = '\0';
+    }
+    return length;
+}
+
+/**********************************************************************************************************************
+ * \brief: Formats a record to the output buffer.
+ *
+ * \param: 3 params: the record, where to format it to and the room there.
+ *
+ * \return: length of the formatted text, room or more if it did not fit
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static int formatRecord(const debug_record *record, char *buffer, int room) {
+    if (RECORD_STRING == record->kind) {
+        return snprintf(buffer, room, record->format, record->string);
+    }
+    if (RECORD_NUMBERED == record->kind) {
+        return snprintf(buffer, room, record->format, (int) record->number, record->string);
+    }
+    return formatArgs(record, buffer, room);
+}
+
+/**********************************************************************************************************************
+ * \brief: Formats the waiting records of both cores and sends them to the stdio uart by DMA.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Call from the main loop of core 0, where the time it takes does not matter. Returns at once while the
+ *           previous output is still being sent. The records of each core stay in order, a record longer than
+ *           DEBUG_LOG_OUT is cut. Other printf() output to the uart may interleave.
+ **********************************************************************************************************************/
+void debugLogDrain() {
+    int length = 0;
+    bool full = false;
+
+    if (dma_channel >= 0 && dma_channel_is_busy(dma_channel)) {
+        return;
+    }
+    for (int core = 0; core < 2 && false == full; core++) {
+        debug_queue *q = &queue[core];
+        uint32_t dropped = q->dropped;
+
+        if (dropped != q->reported) {
+            int n = snprintf(&out[length], DEBUG_LOG_OUT - length, "[%u debug records dropped]\n",
+                             dropped - q->reported);
+            if (n >= DEBUG_LOG_OUT - length) {
+                break;
+            }
+            length += n;
+            q->reported = dropped;
+        }
+        while (q->tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+            int room = DEBUG_LOG_OUT - length;
+            int n = formatRecord(&q->record[q->tail & (DEBUG_LOG_RECORDS - 1)], &out[length], room);
+            if (n >= room) {
+                if (0 != length) {
+                    full = true;
+                    break;
+                }
+                n = room - 1;
+            }
+            length += n;
+            __atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    if (0 == length) {
+        return;
+    }
+    if (dma_channel < 0) {
+        fwrite(out, 1, length, stdout);
+        return;
+    }
+    dma_channel_transfer_from_buffer_now(dma_channel, out, length);
+}
@@ -0,0 +1,44 @@
+#ifndef DEBUGLOG
+#define DEBUGLOG
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Deferred debug output. A call stores the format string pointer and its arguments in a per core queue, the
+ * formatting and the transmission to the stdio uart happen later in debugLogDrain(). */
+#define DEBUG_LOG_RECORDS 32                 // records per core, a power of two
+#define DEBUG_LOG_ARGS 6                     // per record, stored as uintptr_t: ints, chars, pointers to constants
+#define DEBUG_LOG_TEXT 64                    // bytes of a string copied by debugLogString() and debugLogNumbered()
+#define DEBUG_LOG_OUT 256                    // bytes formatted per DMA transfer
+
+/* Number of arguments, 0 - DEBUG_LOG_ARGS. 7 - 12 arguments select the sentinel, which fails to compile. */
+#define DEBUG_LOG_COUNT(...)  DEBUG_LOG_PICK_(0, ##__VA_ARGS__, DEBUG_LOG_TOO_MANY, DEBUG_LOG_TOO_MANY, \
+        DEBUG_LOG_TOO_MANY, DEBUG_LOG_TOO_MANY, DEBUG_LOG_TOO_MANY, DEBUG_LOG_TOO_MANY, 6, 5, 4, 3, 2, 1, 0)
+#define DEBUG_LOG_PICK_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, picked, ...)  picked
+#define DEBUG_LOG_TOO_MANY  sizeof(struct { _Static_assert(0, "debugLog() takes at most 6 arguments"); int unused; })
+
+/* The arguments as uintptr_t, each after a comma */
+#define DEBUG_LOG_CAST(...)  DEBUG_LOG_PICK_(0, ##__VA_ARGS__, DEBUG_LOG_CAST_N, DEBUG_LOG_CAST_N, DEBUG_LOG_CAST_N, \
+        DEBUG_LOG_CAST_N, DEBUG_LOG_CAST_N, DEBUG_LOG_CAST_N, DEBUG_LOG_CAST_6, DEBUG_LOG_CAST_5, DEBUG_LOG_CAST_4, \
+        DEBUG_LOG_CAST_3, DEBUG_LOG_CAST_2, DEBUG_LOG_CAST_1, DEBUG_LOG_CAST_0)(__VA_ARGS__)
+#define DEBUG_LOG_CAST_0()
+#define DEBUG_LOG_CAST_1(a)  , (uintptr_t) (a)
+#define DEBUG_LOG_CAST_2(a, ...)  , (uintptr_t) (a) DEBUG_LOG_CAST_1(__VA_ARGS__)
+#define DEBUG_LOG_CAST_3(a, ...)  , (uintptr_t) (a) DEBUG_LOG_CAST_2(__VA_ARGS__)
+#define DEBUG_LOG_CAST_4(a, ...)  , (uintptr_t) (a) DEBUG_LOG_CAST_3(__VA_ARGS__)
+#define DEBUG_LOG_CAST_5(a, ...)  , (uintptr_t) (a) DEBUG_LOG_CAST_4(__VA_ARGS__)
+#define DEBUG_LOG_CAST_6(a, ...)  , (uintptr_t) (a) DEBUG_LOG_CAST_5(__VA_ARGS__)
+#define DEBUG_LOG_CAST_N(...)
+
+/* printf() like with the conversions %d %i %c %u %x %X %o %s %p, each with flags, width and precision. The format must
+ * be a constant, and so must strings passed for %s: only the pointer is stored. */
+#define debugLog(format, ...)  debugLogPut((format), DEBUG_LOG_COUNT(__VA_ARGS__) DEBUG_LOG_CAST(__VA_ARGS__))
+
+void debugLogInit();
+void debugLogPut(const char *format, int count, ...);
+void debugLogString(const char *format, const char *string);
+void debugLogNumbered(const char *format, int number, const char *string);
+void debugLogReserve(int records);
+void debugLogDrain();
+
+#endif
@@ -0,0 +1,172 @@
+#include <string.h>
+#include "downlink.h"
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+/* Parser states for a modem line like: +CMSG: PORT: 10; RX: "0300" */
+enum ParserState {
+    MATCH_PORT,                              // looking for "PORT: "
+    PORT_DIGITS,
+    MATCH_RX,                                // looking for " RX: \"" right after the ';'
+    HEX_DIGITS
+};
+
+static const char port_tag[] = "PORT: ";
+static const char rx_tag[] = " RX: \"";
+
+static enum ParserState state = MATCH_PORT;
+static int matched = 0;
+static uint8_t nibbles = 0;
+static downlink receiving;
+static downlink pending;
+static bool pending_valid = false;
+static uint32_t overruns = 0;
+
+//////////////////////////////////////////////////
+//             DOWNLINK FUNCTIONS               //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Returns the value of a hexadecimal digit.
+ *
+ * \param: 1 param: character.
+ *
+ * \return: 0 - 15, -1 if the character is not a hexadecimal digit.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/**********************************************************************************************************************
+ * \brief: Advances the match of a tag by one character.
+ *
+ * \param: 2 params: tag and the character received.
+ *
+ * \return: true: if the whole tag has been matched, false: otherwise
+ *
+ * \remarks: Tags have no repeating prefix, so a mismatch can restart from the first character.
+ **********************************************************************************************************************/
+static bool matchTag(const char *tag, char c) {
+    if (c == tag[matched]) {
+        matched++;
+    } else {
+        matched = c == tag[0] ? 1 : 0;
+    }
+    return '\0' == tag[matched];
+}
+
+/**********************************************************************************************************************
+ * \brief: Restarts the parser from looking for the port.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void restart() {
+    state = MATCH_PORT;
+    matched = 0;
+}
+
+/**********************************************************************************************************************
+ * \brief: Feeds modem output to the downlink parser. The parser keeps its state between calls, so the output can be
+ *         fed in any pieces as it arrives, and decodes the hex payload in place without buffering the line.
+ *
+ * \param: 2 params: pointer to the received characters and their count.
+ *
+ * \return:
+ *
+ * \remarks: A complete downlink is kept until downlinkTake(). A newer one replaces it and is counted as an overrun.
+ **********************************************************************************************************************/
+void downlinkFeed(const char *data, int length) {
+    for (int i = 0; i < length; i++) {
+        char c = data[i];
+
+        switch (state) {
+            case MATCH_PORT:
+                if (matchTag(port_tag, c)) {
+                    state = PORT_DIGITS;
+                    receiving.port = 0;
+                    receiving.length = 0;
+                    matched = 0;
+                }
+                break;
+            case PORT_DIGITS:
+                if (c >= '0' && c <= '9') {
+                    receiving.port = receiving.port * 10 + (c - '0');
+                } else if (';' == c) {
+                    state = MATCH_RX;
+                } else {
+                    restart();
+                }
+                break;
+            case MATCH_RX:
+                if (c != rx_tag[matched]) {
+                    restart();
+                } else if (matchTag(rx_tag, c)) {
+                    state = HEX_DIGITS;
+                    nibbles = 0;
+                }
+                break;
+            case HEX_DIGITS:
+                if ('"' == c && 0 == nibbles % 2) {
+                    if (true == pending_valid) {
+                        overruns++;
+                    }
+                    pending = receiving;
+                    pending_valid = true;
+                    restart();
+                } else if (hexValue(c) < 0 || receiving.length >= DOWNLINK_PAYLOAD_MAX) {
+                    restart();
+                } else if (0 == nibbles++ % 2) {
+                    receiving.payload[receiving.length] = hexValue(c) << 4;
+                } else {
+                    receiving.payload[receiving.length++] |= hexValue(c);
+                }
+                break;
+        }
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Takes the last complete downlink.
+ *
+ * \param: 1 param: pointer to the downlink to copy to.
+ *
+ * \return: true: if a downlink was waiting, false: otherwise
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+bool downlinkTake(downlink *dl) {
+    if (false == pending_valid) {
+        return false;
+    }
+    *dl = pending;
+    pending_valid = false;
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the number of downlinks replaced before they were taken.
+ *
+ * \param:
+ *
+ * \return: uint32_t
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+uint32_t downlinkOverruns() {
+    return overruns;
+}
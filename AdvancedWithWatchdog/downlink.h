@@ -0,0 +1,28 @@
+#ifndef DOWNLINK
+#define DOWNLINK
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DOWNLINK_PORT 10                     // FPort of the command channel
+#define DOWNLINK_PAYLOAD_MAX 16
+
+/* Command set, first payload byte. Multi-byte arguments are big endian. */
+enum DownlinkCommand {
+    DL_SET_INTERVAL = 0x01,                  // uint32 seconds between dispensed compartments
+    DL_LOG_DUMP = 0x02,                      // send the EEPROM log in fragments, see fragment.h
+    DL_RECALIBRATE = 0x03,                   // calibrate the wheel again
+    DL_SET_DATA_RATE = 0x04                  // uint8 data rate 0 - 6, 0xFF to adapt to the link
+};
+
+typedef struct downlink_ {
+    uint8_t port;
+    uint8_t length;
+    uint8_t payload[DOWNLINK_PAYLOAD_MAX];
+} downlink;
+
+void downlinkFeed(const char *data, int length);
+bool downlinkTake(downlink *dl);
+uint32_t downlinkOverruns();
+
+#endif
@@ -0,0 +1,192 @@
+#include <stddef.h>
+#include "dutycycle.h"
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+/* EU868 sub-bands. Default LoRaWAN channels 868.1/868.3/868.5 MHz live in g1, the extra TTN channels 867.1 - 867.9 MHz
+ * live in g. The remaining sub-bands carry no uplink channels in the default plan. */
+static sub_band sub_bands[] = {{"g",  10,  true,  DUTY_CYCLE_CAPACITY_US(10),  0},   // 865.0 - 868.0 MHz, 1 %
+                               {"g1", 10,  true,  DUTY_CYCLE_CAPACITY_US(10),  0},   // 868.0 - 868.6 MHz, 1 %
+                               {"g2", 1,   false, DUTY_CYCLE_CAPACITY_US(1),   0},   // 868.7 - 869.2 MHz, 0.1 %
+                               {"g3", 100, false, DUTY_CYCLE_CAPACITY_US(100), 0},   // 869.4 - 869.65 MHz, 10 %
+                               {"g4", 10,  false, DUTY_CYCLE_CAPACITY_US(10),  0}};  // 869.7 - 870.0 MHz, 1 %
+
+static duty_cycle_stats stats;
+
+//////////////////////////////////////////////////
+//            DUTY CYCLE FUNCTIONS              //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Adds the airtime earned since the last refill to the bucket of the sub-band. The bucket never grows beyond
+ *         one observation period worth of airtime.
+ *
+ * \param: 2 params: pointer to the sub-band and current time in ms.
+ *
+ * \return:
+ *
+ * \remarks: Elapsed time is clamped before multiplying so that long idle periods cannot overflow.
+ **********************************************************************************************************************/
+static void refill(sub_band *band, uint32_t now_ms) {
+    uint32_t capacity = DUTY_CYCLE_CAPACITY_US(band->duty_permille);
+    uint32_t elapsed = now_ms - band->last_refill_ms;
+    band->last_refill_ms = now_ms;
+
+    if (elapsed >= DUTY_CYCLE_WINDOW_MS) {
+        band->tokens_us = capacity;
+        return;
+    }
+    /* 1 ms of wall time earns duty_permille us of airtime */
+    uint32_t earned = elapsed * band->duty_permille;
+    if (earned >= capacity - band->tokens_us) {
+        band->tokens_us = capacity;
+    } else {
+        band->tokens_us += earned;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Fills the buckets of all sub-bands and clears the statistics.
+ *
+ * \param: 1 param: current time in ms.
+ *
+ * \return:
+ *
+ * \remarks: The buckets start full at boot, so no call is needed before the first uplink. Used by host simulations
+ *           to restart the clock.
+ **********************************************************************************************************************/
+void dutyCycleReset(uint32_t now_ms) {
+    for (int i = 0; i < sizeof(sub_bands) / sizeof(sub_bands[0]); i++) {
+        sub_bands[i].tokens_us = DUTY_CYCLE_CAPACITY_US(sub_bands[i].duty_permille);
+        sub_bands[i].last_refill_ms = now_ms;
+    }
+    stats.granted = 0;
+    stats.deferred = 0;
+    stats.airtime_ms = 0;
+}
+
+/**********************************************************************************************************************
+ * \brief: Decides when an uplink of the given airtime may go out.
+ *
+ * \param: 2 params: airtime of the frame in us and current time in ms.
+ *
+ * \return: 0 if the frame may be sent now, otherwise the time in ms until the first enabled sub-band has enough budget.
+ *          DUTY_CYCLE_NEVER if the frame is longer than any enabled bucket.
+ *
+ * \remarks: Does not consume budget. Call dutyCycleConsume() once the frame has actually been handed to the modem.
+ **********************************************************************************************************************/
+uint32_t dutyCycleDelay(uint32_t airtime_us, uint32_t now_ms) {
+    uint32_t delay = DUTY_CYCLE_NEVER;
+
+    for (int i = 0; i < sizeof(sub_bands) / sizeof(sub_bands[0]); i++) {
+        sub_band *band = &sub_bands[i];
+        if (false == band->enabled || airtime_us > DUTY_CYCLE_CAPACITY_US(band->duty_permille)) {
+            continue;
+        }
+        refill(band, now_ms);
+        if (band->tokens_us >= airtime_us) {
+            return 0;
+        }
+        uint32_t missing = airtime_us - band->tokens_us;
+        uint32_t wait = (missing + band->duty_permille - 1) / band->duty_permille;
+        if (wait < delay) {
+            delay = wait;
+        }
+    }
+    if (DUTY_CYCLE_NEVER != delay) {
+        stats.deferred++;
+    }
+    return delay;
+}
+
+/**********************************************************************************************************************
+ * \brief: Charges the airtime of a sent frame to the enabled sub-band with the largest remaining budget, the same way
+ *         the modem spreads uplinks over its channels.
+ *
+ * \param: 2 params: airtime of the frame in us and current time in ms.
+ *
+ * \return: index of the charged sub-band, -1 if no enabled sub-band had enough budget.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int dutyCycleConsume(uint32_t airtime_us, uint32_t now_ms) {
+    int selected = -1;
+
+    for (int i = 0; i < sizeof(sub_bands) / sizeof(sub_bands[0]); i++) {
+        if (false == sub_bands[i].enabled) {
+            continue;
+        }
+        refill(&sub_bands[i], now_ms);
+        if (sub_bands[i].tokens_us >= airtime_us &&
+            (selected < 0 || sub_bands[i].tokens_us > sub_bands[selected].tokens_us)) {
+            selected = i;
+        }
+    }
+    if (selected >= 0) {
+        sub_bands[selected].tokens_us -= airtime_us;
+        stats.granted++;
+        stats.airtime_ms += airtime_us / 1000;
+    }
+    return selected;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the remaining airtime budget of one sub-band.
+ *
+ * \param: 2 params: sub-band index and current time in ms.
+ *
+ * \return: remaining budget in us, 0 if index is out of range.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+uint32_t dutyCycleBudget(int band, uint32_t now_ms) {
+    if (band < 0 || band >= dutyCycleBandCount()) {
+        return 0;
+    }
+    refill(&sub_bands[band], now_ms);
+    return sub_bands[band].tokens_us;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the number of sub-bands known to the scheduler.
+ *
+ * \param:
+ *
+ * \return: integer
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int dutyCycleBandCount() {
+    return sizeof(sub_bands) / sizeof(sub_bands[0]);
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns read only access to one sub-band.
+ *
+ * \param: 1 param: sub-band index.
+ *
+ * \return: pointer to the sub-band, NULL if index is out of range.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const sub_band *dutyCycleBand(int band) {
+    if (band < 0 || band >= dutyCycleBandCount()) {
+        return NULL;
+    }
+    return &sub_bands[band];
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the scheduler statistics.
+ *
+ * \param:
+ *
+ * \return: pointer to the statistics.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const duty_cycle_stats *dutyCycleStatistics() {
+    return &stats;
+}
@@ -0,0 +1,35 @@
+#ifndef DUTY_CYCLE
+#define DUTY_CYCLE
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DUTY_CYCLE_WINDOW_MS 3600000         // ETSI EN 300 220 observation period, one hour
+#define DUTY_CYCLE_NEVER UINT32_MAX          // frame does not fit in any enabled sub-band
+
+/* Full bucket of a sub-band in microseconds of airtime, duty cycle given in per mille */
+#define DUTY_CYCLE_CAPACITY_US(permille)  ( (uint32_t) (permille) * DUTY_CYCLE_WINDOW_MS )
+
+typedef struct sub_band_ {
+    const char *name;
+    uint16_t duty_permille;
+    bool enabled;                            // sub-band carries uplink channels
+    uint32_t tokens_us;                      // remaining airtime budget
+    uint32_t last_refill_ms;
+} sub_band;
+
+typedef struct duty_cycle_stats_ {
+    uint32_t granted;                        // uplinks charged to a sub-band
+    uint32_t deferred;                       // delay queries answered with a wait
+    uint32_t airtime_ms;                     // total airtime charged
+} duty_cycle_stats;
+
+void dutyCycleReset(uint32_t now_ms);
+uint32_t dutyCycleDelay(uint32_t airtime_us, uint32_t now_ms);
+int dutyCycleConsume(uint32_t airtime_us, uint32_t now_ms);
+uint32_t dutyCycleBudget(int band, uint32_t now_ms);
+int dutyCycleBandCount();
+const sub_band *dutyCycleBand(int band);
+const duty_cycle_stats *dutyCycleStatistics();
+
+#endif
@@ -1,12 +1,20 @@
 #include "eeprom.h"
 #include "pico/stdlib.h"
 #include "hardware/i2c.h"
+#include "pico/mutex.h"
 #include <string.h>
+#include "debuglog.h"
 
 #ifndef DEBUG_PRINT
-#define DBG_PRINT(f_, ...)  printf((f_), ##__VA_ARGS__)
+#define DBG_PRINT(f_, ...)  debugLog((f_), ##__VA_ARGS__)
+#define DBG_STRING(f_, s_)  debugLogString((f_), (s_))
+#define DBG_NUMBERED(f_, n_, s_)  debugLogNumbered((f_), (n_), (s_))
+#define DBG_RESERVE(n_)  debugLogReserve(n_)
 #else
 #define DBG_PRINT(f_, ...)
+#define DBG_STRING(f_, s_)
+#define DBG_NUMBERED(f_, n_, s_)
+#define DBG_RESERVE(n_)
 #endif
 
 //////////////////////////////////////////////////
@@ -14,6 +22,9 @@
 //////////////////////////////////////////////////
 extern int *log_counter;
 
+/* Serialises bus transactions and the write cycle when the LoRa join on core 1 accesses EEPROM */
+auto_init_mutex(i2c_mutex);
+
 //////////////////////////////////////////////////
 //              EEPROM FUNCTIONS                //
 //////////////////////////////////////////////////
@@ -72,8 +83,10 @@ void i2cWriteBytes(uint16_t address, const uint8_t *data, uint8_t length) {
     uint8_t buffer[length+2];
     buffer[0] = address >> 8; buffer[1] = address;
     memcpy( &buffer[2], data, length);
+    mutex_enter_blocking(&i2c_mutex);
     i2c_write_blocking(i2c0, DEVADDR, buffer, sizeof(buffer), false);
     sleep_ms(I2C_MEM_WRITE_TIME);
+    mutex_exit(&i2c_mutex);
 }
 
 /**********************************************************************************************************************
@@ -90,7 +103,9 @@ void i2cWriteByte_NoDelay(uint16_t address, uint8_t data) {
 
     uint8_t buffer[3];
     buffer[0] = address >> 8; buffer[1] = address; buffer[2] = data;
+    mutex_enter_blocking(&i2c_mutex);
     i2c_write_blocking(i2c0, DEVADDR, buffer, sizeof(buffer), false);
+    mutex_exit(&i2c_mutex);
 }
 
 /**********************************************************************************************************************
@@ -107,8 +122,10 @@ void i2cWriteByte(uint16_t address, uint8_t data) {
 
     uint8_t buffer[3];
     buffer[0] = address >> 8; buffer[1] = address; buffer[2] = data;
+    mutex_enter_blocking(&i2c_mutex);
     i2c_write_blocking(i2c0, DEVADDR, buffer, sizeof(buffer), false);
     sleep_ms(I2C_MEM_WRITE_TIME);
+    mutex_exit(&i2c_mutex);
 }
 
 /**********************************************************************************************************************
@@ -125,8 +142,10 @@ uint8_t i2cReadByte(uint16_t address) {
 
     uint8_t buffer[2];
     buffer[0] = address >> 8; buffer[1] = address;
+    mutex_enter_blocking(&i2c_mutex);
     i2c_write_blocking(i2c0, DEVADDR, buffer, 2, true);
     i2c_read_blocking(i2c0, DEVADDR, buffer, 1, false);
+    mutex_exit(&i2c_mutex);
     return buffer[0];
 }
 
@@ -147,8 +166,10 @@ void i2cReadBytes(uint16_t address, uint8_t *data, uint8_t length) {
 
     uint8_t buffer[2];
     buffer[0] = address >> 8; buffer[1] = address;
+    mutex_enter_blocking(&i2c_mutex);
     i2c_write_blocking(i2c0, DEVADDR, buffer, 2, true);
     i2c_read_blocking(i2c0, DEVADDR, data, length, false);
+    mutex_exit(&i2c_mutex);
 }
 
 /**********************************************************************************************************************
@@ -174,6 +195,67 @@ bool readStruct(machineState *state) {
     }
 }
 
+/**********************************************************************************************************************
+ * \brief: Writes a record to the designated address of the EEPROM. The last two bytes of the record are reserved for
+ *         the CRC, which is calculated over the rest of the record. Uses i2cWriteBytes().
+ *
+ * \param: 3 params: uint16_t address, pointer to the record and the record length as uint8_t, CRC included.
+ *
+ * \return:
+ *
+ * \remarks: The record must not cross an EEPROM page boundary.
+ **********************************************************************************************************************/
+void writeRecord(uint16_t address, const void *record, uint8_t length) {
+    assert(length > sizeof(uint16_t));
+
+    uint8_t buffer[length];
+    memcpy(buffer, record, length);
+    uint16_t crc = crc16(buffer, length - sizeof(crc));
+    memcpy(&buffer[length - sizeof(crc)], &crc, sizeof(crc));
+    i2cWriteBytes(address, buffer, length);
+}
+
+/**********************************************************************************************************************
+ * \brief: Reads a record written by writeRecord() from the designated address of the EEPROM. Applies CRC check. Uses
+ *         i2cReadBytes().
+ *
+ * \param: 3 params: uint16_t address, pointer to the record to read to and the record length as uint8_t.
+ *
+ * \return: boolean, true: if CRC check successful; false: if CRC check fails, record is left untouched.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+bool readRecord(uint16_t address, void *record, uint8_t length) {
+    assert(length > sizeof(uint16_t));
+
+    uint8_t buffer[length];
+    uint16_t stored_crc;
+    i2cReadBytes(address, buffer, length);
+    memcpy(&stored_crc, &buffer[length - sizeof(stored_crc)], sizeof(stored_crc));
+
+    if (stored_crc == crc16(buffer, length - sizeof(stored_crc))) {
+        memcpy(record, buffer, length);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Invalidates a record by overwriting it with zeros.
+ *
+ * \param: 2 params: uint16_t address and the record length as uint8_t.
+ *
+ * \return:
+ *
+ * \remarks: A zeroed record never passes the CRC check as the CRC of zeros is not zero.
+ **********************************************************************************************************************/
+void eraseRecord(uint16_t address, uint8_t length) {
+    uint8_t buffer[length];
+    memset(buffer, 0, length);
+    i2cWriteBytes(address, buffer, length);
+}
+
 /**********************************************************************************************************************
  * \brief: Calculates the crc for passed data.
  *
@@ -241,7 +323,8 @@ void writeLogEntry(const char *message) {
  *
  * \return:
  *
- * \remarks:
+ * \remarks: One debug record per entry. A full log has more lines than the debug queue holds, so each entry waits for
+ *           room in it.
  **********************************************************************************************************************/
 void printLog() {
     if (0 != *log_counter) {
@@ -250,6 +333,7 @@ void printLog() {
 
         DBG_PRINT("Printing log messages from memory:\n");
         for (int i = 0; i < *log_counter; i++) {
+            DBG_RESERVE(1);
             log_address = i * MAX_LOG_SIZE;
             i2cReadBytes(log_address, buffer, MAX_LOG_SIZE);
 
@@ -259,12 +343,7 @@ void printLog() {
             }
 
             if(0 == crc16(buffer, (term_zero_index + 3)) && buffer[0] != 0 && (term_zero_index < (MAX_LOG_SIZE - 2))) {
-                DBG_PRINT("Log #%d: ", i + 1);
-                int index = 0;
-                while (buffer[index]) {
-                    DBG_PRINT("%c", buffer[index++]);
-                }
-                DBG_PRINT("\n");
+                DBG_NUMBERED("Log #%d: %s\n", i + 1, (const char *) buffer);
             } else {
                 DBG_PRINT("Log message #%d invalid. Exit printing.\n", i + 1);
                 break;
@@ -275,6 +354,72 @@ void printLog() {
     }
 }
 
+/**********************************************************************************************************************
+ * \brief: Reads one log message from EEPROM and checks its CRC.
+ *
+ * \param: 2 params: index of the log message (0 - 31) and a buffer of MAX_LOG_SIZE characters for the message.
+ *
+ * \return: true: if the message is valid, false: if the index is past the last message or the message is invalid.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+bool readLogEntry(int index, char *message) {
+    if (index < 0 || index >= *log_counter) {
+        return false;
+    }
+
+    uint8_t buffer[MAX_LOG_SIZE];
+    i2cReadBytes(index * MAX_LOG_SIZE, buffer, MAX_LOG_SIZE);
+
+    int term_zero_index = 0;
+    while (term_zero_index < (MAX_LOG_SIZE - 2) && buffer[term_zero_index] != '\0') {
+        term_zero_index++;
+    }
+
+    if (term_zero_index < (MAX_LOG_SIZE - 2) && buffer[0] != 0 && 0 == crc16(buffer, (term_zero_index + 3))) {
+        memcpy(message, buffer, term_zero_index + 1);
+        return true;
+    }
+    return false;
+}
+
+/**********************************************************************************************************************
+ * \brief: Writes the metrics to EEPROM: the counters to METRICS_ADDRESS and each histogram to the following pages.
+ *
+ * \param: 1 param: pointer to the metrics.
+ *
+ * \return:
+ *
+ * \remarks: Every record has its own CRC, a power loss during the write loses at most the record being written.
+ **********************************************************************************************************************/
+void writeMetrics(const metrics *data) {
+    writeRecord(METRICS_ADDRESS, &data->counters, sizeof(data->counters));
+    for (int i = 0; i < MH_COUNT; i++) {
+        writeRecord(METRICS_ADDRESS + (i + 1) * I2C_MEM_PAGE_SIZE, &data->histogram[i], sizeof(data->histogram[i]));
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Reads the metrics written by writeMetrics(). Records failing the CRC check start from zero.
+ *
+ * \param: 1 param: pointer to the metrics to read to.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void readMetrics(metrics *data) {
+    if (false == readRecord(METRICS_ADDRESS, &data->counters, sizeof(data->counters))) {
+        memset(&data->counters, 0, sizeof(data->counters));
+    }
+    for (int i = 0; i < MH_COUNT; i++) {
+        if (false == readRecord(METRICS_ADDRESS + (i + 1) * I2C_MEM_PAGE_SIZE, &data->histogram[i],
+                                sizeof(data->histogram[i]))) {
+            memset(&data->histogram[i], 0, sizeof(data->histogram[i]));
+        }
+    }
+}
+
 /**********************************************************************************************************************
  * \brief: Erases all 32 log messages from EEPROM by writing a zero to the beginning of each log. Calls i2cWriteByte()
  *         to write 0.
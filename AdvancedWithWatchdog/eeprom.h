@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include "metrics.h"
 
 /*   I2C   */
 #define I2C0_SDA_PIN 16
@@ -18,6 +19,10 @@
 #define MAX_LOG_ENTRY 32
 
 #define STEPPER_POSITION_ADDRESS  ( I2C_MEM_SIZE / 2 )
+#define LORA_SETTINGS_ADDRESS  ( STEPPER_POSITION_ADDRESS + I2C_MEM_PAGE_SIZE )
+#define CONFIG_ADDRESS  ( LORA_SETTINGS_ADDRESS + I2C_MEM_PAGE_SIZE )
+#define CONFIG_SLOTS 2                       // one page each
+#define METRICS_ADDRESS  ( CONFIG_ADDRESS + CONFIG_SLOTS * I2C_MEM_PAGE_SIZE )   // counters, then a page per histogram
 
 enum SystemState {
     CALIB_WAITING,       // EEPROM, CALIBRATED: 0 == CALIB_WAITING
@@ -51,7 +56,13 @@ void i2cReadBytes(uint16_t address, uint8_t *data, uint8_t length);
 uint16_t crc16(const uint8_t *data, size_t length);
 void writeStruct(const machineState *state);
 bool readStruct(machineState *state);
+void writeRecord(uint16_t address, const void *record, uint8_t length);
+bool readRecord(uint16_t address, void *record, uint8_t length);
+void eraseRecord(uint16_t address, uint8_t length);
 void writeLogEntry(const char *message);
+bool readLogEntry(int index, char *message);
+void writeMetrics(const metrics *data);
+void readMetrics(metrics *data);
 void printLog();
 void eraseLog();
 void printAllMemory();
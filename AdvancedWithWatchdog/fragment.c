@@ -0,0 +1,147 @@
+#include <string.h>
+#include "fragment.h"
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+static uint8_t message[FRAGMENT_MAX];
+static size_t message_len = 0;
+static size_t sent = 0;                      // bytes of the message already put in frames
+static bool sending = false;
+static uint8_t message_id = 0;
+static uint8_t next_index = 0;               // of the next frame
+
+//////////////////////////////////////////////////
+//             FRAGMENT FUNCTIONS               //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Seeds the message ids from the boot count. The receiver drops fragments of the ids it completed last, so the
+ *         first message after a reboot must not reuse the id of one sent before it.
+ *
+ * \param: 1 param: number of boots, counted with MC_BOOTS and stored before the call.
+ *
+ * \return:
+ *
+ * \remarks: Call once at boot. Each boot starts FRAGMENT_IDS_PER_BOOT ids after the previous one.
+ **********************************************************************************************************************/
+void fragmentSeed(uint32_t boots) {
+    message_id = (uint8_t) (boots * FRAGMENT_IDS_PER_BOOT);
+}
+
+/**********************************************************************************************************************
+ * \brief: Starts building a new long message. Discards a message being built but not yet sent.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Does nothing while the previous message is still being sent, fragmentAppend() then fails.
+ **********************************************************************************************************************/
+void fragmentBegin() {
+    if (false == sending) {
+        message_len = 0;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Appends data to the long message being built.
+ *
+ * \param: 2 params: pointer to the data and its length.
+ *
+ * \return: true: if appended, false: if a message is being sent or the data does not fit in FRAGMENT_MAX
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+bool fragmentAppend(const uint8_t *data, size_t length) {
+    if (true == sending || message_len + length > FRAGMENT_MAX) {
+        return false;
+    }
+    memcpy(&message[message_len], data, length);
+    message_len += length;
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Completes the message being built. Its frames are taken with fragmentNext() from now on.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Every message gets the next message id, so the receiver can tell the fragments of two messages apart.
+ **********************************************************************************************************************/
+void fragmentSend() {
+    if (true == sending || 0 == message_len) {
+        return;
+    }
+    message_id++;
+    next_index = 0;
+    sent = 0;
+    sending = true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Checks if a message still has frames to be taken.
+ *
+ * \param:
+ *
+ * \return: true: if frames are left, false: otherwise
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+bool fragmentBusy() {
+    return sending;
+}
+
+/**********************************************************************************************************************
+ * \brief: Builds the next frame of the message being sent, filled up to the given size.
+ *
+ * \param: 2 params: buffer for the frame and the largest frame the data rate in use carries.
+ *
+ * \return: frame length, 0 if no message is being sent or the frame size leaves no room for data
+ *
+ * \remarks: Pass the payload limit at the time the frame is queued, the frames of one message may differ in size.
+ *           Gives up on the message when it would need more than 128 frames.
+ **********************************************************************************************************************/
+size_t fragmentNext(uint8_t *frame, size_t frame_max) {
+    if (false == sending || frame_max <= FRAGMENT_HEADER_LEN) {
+        return 0;
+    }
+    size_t length = message_len - sent;
+    if (length > frame_max - FRAGMENT_HEADER_LEN) {
+        length = frame_max - FRAGMENT_HEADER_LEN;
+    }
+    bool last = sent + length == message_len;
+    if (false == last && FRAGMENT_INDEX_MASK == next_index) {
+        sending = false;
+        return 0;
+    }
+
+    frame[0] = FRAGMENT_TAG;
+    frame[1] = message_id;
+    frame[2] = next_index | (last ? FRAGMENT_LAST : 0);
+    memcpy(&frame[FRAGMENT_HEADER_LEN], &message[sent], length);
+    sent += length;
+    next_index++;
+    if (true == last) {
+        sending = false;
+        message_len = 0;
+    }
+    return FRAGMENT_HEADER_LEN + length;
+}
+
+/**********************************************************************************************************************
+ * \brief: Calculates the frames a message needs at a fixed frame size, the least any split can use.
+ *
+ * \param: 2 params: message length and frame size.
+ *
+ * \return: number of frames
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+size_t fragmentCount(size_t length, size_t frame_max) {
+    size_t room = frame_max - FRAGMENT_HEADER_LEN;
+    return length ? (length + room - 1) / room : 0;
+}
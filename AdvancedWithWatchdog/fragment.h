@@ -0,0 +1,24 @@
+#ifndef FRAGMENT
+#define FRAGMENT
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Frame: FRAGMENT_TAG, message id, fragment index with FRAGMENT_LAST set on the last one, then the data */
+#define FRAGMENT_TAG 0x02                    // first byte, METRICS_HEALTH_TAG is 0x01 and text starts printable
+#define FRAGMENT_HEADER_LEN 3
+#define FRAGMENT_LAST 0x80
+#define FRAGMENT_INDEX_MASK 0x7F             // up to 128 fragments per message
+#define FRAGMENT_MAX 2048                    // the whole EEPROM log
+#define FRAGMENT_IDS_PER_BOOT 16             // message ids a boot uses before reaching those of the next boot
+
+void fragmentSeed(uint32_t boots);
+void fragmentBegin();
+bool fragmentAppend(const uint8_t *data, size_t length);
+void fragmentSend();
+bool fragmentBusy();
+size_t fragmentNext(uint8_t *frame, size_t frame_max);
+size_t fragmentCount(size_t length, size_t frame_max);
+
+#endif
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adr.h"
+#include "airtime.h"
+#include "uplink.h"
+
+#define SUPPLY_MV 3300
+#define TX_CURRENT_MA 45                     // LoRa-E5 at +14 dBm
+#define RX_CURRENT_MA 6
+#define RX_WINDOW_SYMBOLS 8                  // preamble the modem listens for when no downlink comes
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+static const int16_t required_snr[] = {-75, -100, -125, -150, -175, -200};
+static uint32_t random_state = 2463534242u;
+
+typedef struct result_ {
+    uint64_t airtime_us;
+    uint64_t energy_uj;
+    uint32_t delivered;
+    uint32_t attempts;
+    int final_dr;
+} result;
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static uint32_t nextRandom() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**********************************************************************************************************************
+ * \brief: Draws an SNR sample around the mean of the link: the sum of four uniform samples, about 3 dB standard
+ *         deviation.
+ *
+ * \param: 1 param: mean SNR in 0.1 dB.
+ *
+ * \return: SNR in 0.1 dB
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static int snrSample(int mean) {
+    int sum = 0;
+    for (int i = 0; i < 4; i++) {
+        sum += (int) (nextRandom() % 101) - 50;
+    }
+    return mean + sum * 3 / 2;
+}
+
+/**********************************************************************************************************************
+ * \brief: Sends confirmed uplinks over a simulated link for the given number of days. An attempt is received if the
+ *         SNR sample reaches the demodulation floor of the data rate, the modem response carries the measured SNR
+ *         back to the adaptation.
+ *
+ * \param: 4 params: mean SNR in 0.1 dB, uplinks per day, days and payload length.
+ *
+ * \return: totals of the run
+ *
+ * \remarks: The data rate is pinned by the caller for the fixed data rate run.
+ **********************************************************************************************************************/
+static result run(int snr_mean, int per_day, int days, size_t payload) {
+    result total = {0};
+    char response[128];
+
+    adrReset();
+    for (int i = 0; i < per_day * days; i++) {
+        for (int attempt = 0; attempt <= UPLINK_MAX_RETRIES; attempt++) {
+            int dr = adrDataRate();
+            const data_rate *rate = dataRate(dr);
+            uint32_t tx_us = uplinkAirtimeUs(dr, payload);
+            int snr = snrSample(snr_mean);
+            bool acked = snr >= required_snr[rate->sf - 7];
+            uint32_t rx_us = acked ? airtimeUs(rate->sf, rate->bandwidth, LORAWAN_OVERHEAD) :
+                             2 * RX_WINDOW_SYMBOLS * (uint32_t) ((1ULL << rate->sf) * 1000000ULL / rate->bandwidth);
+
+            total.attempts++;
+            total.airtime_us += tx_us;
+            total.energy_uj += (uint64_t) SUPPLY_MV * (TX_CURRENT_MA * (uint64_t) tx_us +
+                                                       RX_CURRENT_MA * (uint64_t) rx_us) / 1000000;
+            if (acked) {
+                snprintf(response, sizeof(response),
+                         "+CMSG: Start\r\n+CMSG: Wait ACK\r\n+CMSG: ACK Received\r\n"
+                         "+CMSG: RXWIN1, RSSI %d, SNR %d.%d\r\n+CMSG: Done\r\n",
+                         -120 + snr / 10, snr / 10, abs(snr % 10));
+            } else {
+                snprintf(response, sizeof(response), "+CMSG: Start\r\n+CMSG: Wait ACK\r\n+CMSG: Done\r\n");
+            }
+            adrReport(response, true, acked);
+            if (acked) {
+                total.delivered++;
+                break;
+            }
+        }
+    }
+    total.final_dr = adrDataRate();
+    return total;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Compares the airtime and energy per day of a fixed data rate with the adaptive data rate over links of
+ *         different quality.
+ *
+ * \param: optional arguments: fixed data rate to compare with (default LORA_DEFAULT_DR), uplinks per day (default
+ *         12), simulated days (default 30).
+ *
+ * \return: 0
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    static const int snr_means[] = {80, 0, -80, -130, -170};
+    int fixed_dr = argc > 1 ? atoi(argv[1]) : LORA_DEFAULT_DR;
+    int per_day = argc > 2 ? atoi(argv[2]) : 12;
+    int days = argc > 3 ? atoi(argv[3]) : 30;
+    const char *message = "Day 1: Pill dispensed. Number of pills left: 6.";
+    size_t payload = strlen(message);
+
+    printf("%d confirmed uplinks per day, %zu byte payload, %d days\n", per_day, payload, days);
+    printf("%11s | %-28s | %-28s | %s\n", "link SNR", "fixed DR", "adaptive", "saved per day");
+    for (int i = 0; i < sizeof(snr_means) / sizeof(snr_means[0]); i++) {
+        adrPin(fixed_dr);
+        result fixed = run(snr_means[i], per_day, days, payload);
+        adrPin(ADR_AUTO);
+        result adaptive = run(snr_means[i], per_day, days, payload);
+
+        uint64_t fixed_air = fixed.airtime_us / days, adaptive_air = adaptive.airtime_us / days;
+        uint64_t fixed_mj = fixed.energy_uj / days / 1000, adaptive_mj = adaptive.energy_uj / days / 1000;
+        printf("%6d.%d dB | DR%d %6llu ms %5llu mJ %3u %% | DR%d %6llu ms %5llu mJ %3u %% | %6lld ms %5lld mJ\n",
+               snr_means[i] / 10, abs(snr_means[i] % 10),
+               fixed.final_dr, (unsigned long long) fixed_air / 1000, (unsigned long long) fixed_mj,
+               100 * fixed.delivered / (per_day * days),
+               adaptive.final_dr, (unsigned long long) adaptive_air / 1000, (unsigned long long) adaptive_mj,
+               100 * adaptive.delivered / (per_day * days),
+               (long long) (fixed_air - adaptive_air) / 1000, (long long) (fixed_mj - adaptive_mj));
+    }
+    printf("Columns: data rate at the end of the run, airtime per day, radio energy per day, delivery ratio.\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "metrics.h"
+#include "uplink.h"
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+static const char *fixed_msg[] = {"Clean boot.",
+                                  "Calibrated. Waiting for button to dispense pills.",
+                                  "Powered off during dispense. Motor was not turning.",
+                                  "Reboot by Watchdog.",
+                                  "Waiting for button to calibrate."};
+
+#define FIXED_COUNT  ( sizeof(fixed_msg) / sizeof(fixed_msg[0]) )
+
+static uint32_t random_state = 1;
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static uint32_t nextRandom() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**********************************************************************************************************************
+ * \brief: Makes one uplink payload of the mix a fleet sends: mostly dispense sentences, some fixed messages, routine
+ *         messages coalesced into one, compact binary events and health uplinks.
+ *
+ * \param: 1 param: buffer of UPLINK_PAYLOAD_MAX bytes.
+ *
+ * \return: payload length
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static size_t makePayload(uint8_t *payload) {
+    uint32_t kind = nextRandom() % 100;
+    int day = nextRandom() % 7 + 1;
+
+    if (kind < 60) {
+        return sprintf((char *) payload, "Day %d: Pill %sdispensed. Number of pills left: %d.", day,
+                       kind < 5 ? "not " : "", 7 - day);
+    }
+    if (kind < 75) {
+        return sprintf((char *) payload, "%s", fixed_msg[nextRandom() % FIXED_COUNT]);
+    }
+    if (kind < 85) {
+        return sprintf((char *) payload, "%s" UPLINK_COALESCE_SEPARATOR "%s", fixed_msg[0], fixed_msg[4]);
+    }
+    if (kind < 95) {
+        payload[0] = DECODER_EVENT_TAG;
+        payload[1] = EV_PILL_DISPENSED;
+        payload[2] = day;
+        payload[3] = 7 - day;
+        return 1 + DECODER_EVENT_RECORD;
+    }
+    memset(payload, 0, METRICS_HEALTH_LEN);
+    payload[0] = METRICS_HEALTH_TAG;
+    payload[2 + 2 * MC_BOOTS] = nextRandom() % 8;
+    payload[2 + 2 * MC_UPLINKS] = nextRandom() % 200;
+    return METRICS_HEALTH_LEN;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Writes a synthetic capture file of fleet uplinks for uplink_decode: device,time_ms,payload_hex per line.
+ *
+ * \param: output file, number of uplinks (default 1000000) and number of devices (default 10000).
+ *
+ * \return: 0, 1 on error.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    static const char hex[] = "0123456789ABCDEF";
+    uint8_t payload[UPLINK_PAYLOAD_MAX];
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s capture [uplinks] [devices]\n", argv[0]);
+        return 1;
+    }
+    unsigned long uplinks = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    uint32_t devices = argc > 3 ? strtoul(argv[3], NULL, 10) : 10000;
+    FILE *file = fopen(argv[1], "w");
+    if (NULL == file) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    uint64_t time = 1700000000000ULL;
+    for (unsigned long i = 0; i < uplinks; i++) {
+        size_t length = makePayload(payload);
+        time += nextRandom() % 50;
+        fprintf(file, "%u,%llu,", nextRandom() % devices, (unsigned long long) time);
+        for (size_t j = 0; j < length; j++) {
+            fputc(hex[payload[j] >> 4], file);
+            fputc(hex[payload[j] & 0x0F], file);
+        }
+        fputc('\n', file);
+    }
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include <string.h>
+#include "decoder.h"
+#include "metrics.h"
+#include "fragment.h"
+#include "uplink.h"
+#include "messages.h"
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+static const char *event_names[EV_COUNT] = {"unknown", "clean_boot", "calibrated", "power_off_stopped",
+                                            "power_off_turning", "all_dispensed", "boot_calibrated",
+                                            "waiting_calibration", "watchdog_reboot", "pill_dispensed",
+                                            "pill_missed", "health", "fragment"};
+
+/* One event per message of messages.h, from EV_CLEAN_BOOT */
+_Static_assert(EV_CLEAN_BOOT + FIXED_MSG_COUNT == EV_PILL_DISPENSED, "fixed_msg[] and EventType differ");
+
+/* Parts of the dispense sentences of dispensePills() */
+static const char day_tag[] = "Day ";
+static const char dispensed_tag[] = ": Pill dispensed. Number of pills left: ";
+static const char missed_tag[] = ": Pill not dispensed. Number of pills left: ";
+
+#define TAG_LEN(tag)  ( sizeof(tag) - 1 )
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/**********************************************************************************************************************
+ * \brief: Reads a decimal number.
+ *
+ * \param: 3 params: text, its end and pointer to the position, moved past the digits.
+ *
+ * \return: the number, -1 if there are no digits
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static int64_t number(const char *text, const char *end, const char **position) {
+    int64_t value = 0;
+    const char *start = text;
+
+    while (text < end && *text >= '0' && *text <= '9') {
+        value = value * 10 + (*text++ - '0');
+    }
+    *position = text;
+    return text == start ? -1 : value;
+}
+
+/**********************************************************************************************************************
+ * \brief: Decodes one text message: a sentence of dispensePills() or one of fixed_msg[].
+ *
+ * \param: 3 params: the text, its length and the event to fill.
+ *
+ * \return:
+ *
+ * \remarks: Unknown text gives EV_UNKNOWN. Compares prefixes, no regular expressions.
+ **********************************************************************************************************************/
+static void decodeText(const char *text, size_t length, decoded_event *event) {
+    const char *end = text + length;
+    const char *position;
+
+    event->type = EV_UNKNOWN;
+    event->arg[0] = event->arg[1] = -1;
+    if (length > TAG_LEN(day_tag) && 0 == memcmp(text, day_tag, TAG_LEN(day_tag))) {
+        int64_t day = number(text + TAG_LEN(day_tag), end, &position);
+        enum EventType type = EV_PILL_DISPENSED;
+        if ((size_t) (end - position) > TAG_LEN(dispensed_tag) &&
+            0 == memcmp(position, dispensed_tag, TAG_LEN(dispensed_tag))) {
+            position += TAG_LEN(dispensed_tag);
+        } else if ((size_t) (end - position) > TAG_LEN(missed_tag) &&
+                   0 == memcmp(position, missed_tag, TAG_LEN(missed_tag))) {
+            position += TAG_LEN(missed_tag);
+            type = EV_PILL_MISSED;
+        } else {
+            return;
+        }
+        int64_t left = number(position, end, &position);
+        if (day >= 0 && left >= 0 && position + 1 == end && '.' == *position) {
+            event->type = type;
+            event->arg[0] = (int32_t) day;
+            event->arg[1] = (int32_t) left;
+        }
+        return;
+    }
+    /* fixed_msg[] is in EventType order from EV_CLEAN_BOOT */
+    for (int i = 0; i < FIXED_MSG_COUNT; i++) {
+        if (length == strlen(fixed_msg[i]) && 0 == memcmp(text, fixed_msg[i], length)) {
+            event->type = EV_CLEAN_BOOT + i;
+            return;
+        }
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the name of an event type.
+ *
+ * \param: 1 param: event type.
+ *
+ * \return: name
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const char *decoderEventName(enum EventType type) {
+    return type < EV_COUNT ? event_names[type] : event_names[EV_UNKNOWN];
+}
+
+/**********************************************************************************************************************
+ * \brief: Decodes one uplink payload into events. Text payloads may hold several messages joined by
+ *         UPLINK_COALESCE_SEPARATOR, binary payloads are told apart by their first byte.
+ *
+ * \param: 4 params: payload, its length, array for the events and its size.
+ *
+ * \return: number of events, the device and time of the events are left to the caller
+ *
+ * \remarks: Thread safe, no allocation. Fragments are reported but not reassembled, see reassembler.h.
+ **********************************************************************************************************************/
+int decodePayload(const uint8_t *payload, size_t length, decoded_event *events, int max_events) {
+    static const char separator[] = UPLINK_COALESCE_SEPARATOR;
+    int count = 0;
+
+    if (0 == length || 0 == max_events) {
+        return 0;
+    }
+    switch (payload[0]) {
+        case DECODER_EVENT_TAG:
+            for (size_t i = 1; i + DECODER_EVENT_RECORD <= length && count < max_events; i += DECODER_EVENT_RECORD) {
+                events[count].type = payload[i] < EV_COUNT ? payload[i] : EV_UNKNOWN;
+                events[count].arg[0] = payload[i + 1];
+                events[count].arg[1] = payload[i + 2];
+                count++;
+            }
+            return count;
+        case METRICS_HEALTH_TAG:
+            events[0].type = EV_UNKNOWN;
+            events[0].arg[0] = events[0].arg[1] = -1;
+            if (METRICS_HEALTH_LEN == length) {
+                events[0].type = EV_HEALTH;
+                events[0].arg[0] = payload[1 + 2 * MC_BOOTS] << 8 | payload[2 + 2 * MC_BOOTS];
+                events[0].arg[1] = payload[1 + 2 * MC_UPLINKS] << 8 | payload[2 + 2 * MC_UPLINKS];
+            }
+            return 1;
+        case FRAGMENT_TAG:
+            events[0].type = length > FRAGMENT_HEADER_LEN ? EV_FRAGMENT : EV_UNKNOWN;
+            events[0].arg[0] = length > 1 ? payload[1] : -1;
+            events[0].arg[1] = length > 2 ? payload[2] & FRAGMENT_INDEX_MASK : -1;
+            return 1;
+    }
+
+    const char *text = (const char *) payload;
+    const char *end = text + length;
+    while (count < max_events) {
+        const char *next = text;
+        while (next + TAG_LEN(separator) <= end && 0 != memcmp(next, separator, TAG_LEN(separator))) {
+            next++;
+        }
+        if (next + TAG_LEN(separator) > end) {
+            next = end;
+        }
+        decodeText(text, next - text, &events[count++]);
+        if (next == end) {
+            break;
+        }
+        text = next + TAG_LEN(separator);
+    }
+    return count;
+}
+
+/**********************************************************************************************************************
+ * \brief: Decodes one line of a capture file: device id, time in ms and the hex encoded payload, separated by commas.
+ *
+ * \param: 4 params: line without line ending, its length, array for the events and its size.
+ *
+ * \return: number of events, 0 for a malformed line
+ *
+ * \remarks: Thread safe, no allocation.
+ **********************************************************************************************************************/
+int decodeLine(const char *line, size_t length, decoded_event *events, int max_events) {
+    const char *end = line + length;
+    const char *position;
+    uint8_t payload[UPLINK_PAYLOAD_MAX];
+    size_t payload_len = 0;
+
+    int64_t device = number(line, end, &position);
+    if (device < 0 || position == end || ',' != *position) {
+        return 0;
+    }
+    int64_t time = number(position + 1, end, &position);
+    if (time < 0 || position == end || ',' != *position) {
+        return 0;
+    }
+    for (position++; position + 1 < end && payload_len < sizeof(payload); position += 2) {
+        int high = hexValue(position[0]), low = hexValue(position[1]);
+        if (high < 0 || low < 0) {
+            return 0;
+        }
+        payload[payload_len++] = high << 4 | low;
+    }
+
+    int count = decodePayload(payload, payload_len, events, max_events);
+    for (int i = 0; i < count; i++) {
+        events[i].device = (uint32_t) device;
+        events[i].time_ms = (uint64_t) time;
+    }
+    return count;
+}
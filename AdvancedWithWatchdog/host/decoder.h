@@ -0,0 +1,43 @@
+#ifndef DECODER
+#define DECODER
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Compact binary events: DECODER_EVENT_TAG followed by one 3-byte record per event: EventType, day, pills left.
+ * METRICS_HEALTH_TAG (0x01) and FRAGMENT_TAG (0x02) frames are recognised as well. */
+#define DECODER_EVENT_TAG 0x03
+#define DECODER_EVENT_RECORD 3
+#define DECODER_MAX_EVENTS 8                 // events of one uplink, coalesced routine messages carry several
+
+/* Event types, the values are the codes of the compact binary form */
+enum EventType {
+    EV_UNKNOWN = 0,
+    EV_CLEAN_BOOT,
+    EV_CALIBRATED,
+    EV_POWER_OFF_STOPPED,                    // powered off during dispense, motor was not turning
+    EV_POWER_OFF_TURNING,
+    EV_ALL_DISPENSED,
+    EV_BOOT_CALIBRATED,
+    EV_WAITING_CALIBRATION,
+    EV_WATCHDOG_REBOOT,
+    EV_PILL_DISPENSED,
+    EV_PILL_MISSED,
+    EV_HEALTH,
+    EV_FRAGMENT,
+    EV_COUNT
+};
+
+typedef struct decoded_event_ {
+    uint32_t device;
+    uint64_t time_ms;
+    enum EventType type;
+    int32_t arg[2];                          // day and pills left, boots and uplink attempts of a health uplink,
+                                             // message id and index of a fragment
+} decoded_event;
+
+const char *decoderEventName(enum EventType type);
+int decodePayload(const uint8_t *payload, size_t length, decoded_event *events, int max_events);
+int decodeLine(const char *line, size_t length, decoded_event *events, int max_events);
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "airtime.h"
+#include "dutycycle.h"
+
+#define IN_BUDGET_INTERVAL 150000            // ms, a dispense message at DR0 is 1.75 % of the airtime
+#define IN_BUDGET_HOURS 24
+#define OVERLOAD_INTERVAL 5000               // ms, the DEBUG dispense interval
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+static const char message[] = "Day 1: Pill dispensed. Number of pills left: 6.";
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Offers one uplink every interval to the duty cycle scheduler on a simulated clock and prints when each one
+ *         is allowed out, together with the remaining budget of the enabled sub-bands.
+ *
+ * \param: 5 params: label of the run, interval in ms, data rate, payload length in bytes and simulated hours.
+ *
+ * \return: 0, 1 if a load within the duty cycle budget waited longer than the bound
+ *
+ * \remarks: Uplinks are queued: an uplink offered while the previous one is still waiting goes out after it. Within
+ *           the budget no uplink may wait longer than the slowest enabled sub-band takes to earn one frame of airtime.
+ *           An overload only shows the saturation, its waits grow without limit.
+ **********************************************************************************************************************/
+static int run(const char *label, uint32_t interval, int dr, size_t payload, uint32_t hours) {
+    uint32_t airtime = uplinkAirtimeUs(dr, payload);
+    uint32_t end = hours * 3600000;
+    uint32_t now = 0;
+    uint32_t sent = 0, max_wait = 0;
+    uint64_t total_wait = 0;
+    uint32_t budget_permille = 0, slowest_permille = UINT16_MAX;
+
+    for (int i = 0; i < dutyCycleBandCount(); i++) {
+        if (dutyCycleBand(i)->enabled) {
+            budget_permille += dutyCycleBand(i)->duty_permille;
+            if (dutyCycleBand(i)->duty_permille < slowest_permille) {
+                slowest_permille = dutyCycleBand(i)->duty_permille;
+            }
+        }
+    }
+    /* airtime in us per ms of interval is the load in per mille */
+    bool within = (uint64_t) airtime <= (uint64_t) budget_permille * interval;
+    uint32_t bound = airtime / slowest_permille;
+
+    printf("%s: DR%d SF%u/%ukHz, %zu byte payload: %u.%03u ms airtime, one uplink every %u ms, load %u.%u of %u per "
+           "mille\n", label, dr, dataRate(dr)->sf, dataRate(dr)->bandwidth / 1000, payload, airtime / 1000,
+           airtime % 1000, interval, airtime / interval, airtime % interval * 10 / interval, budget_permille);
+    dutyCycleReset(0);
+
+    for (uint32_t offered = 0; offered < end; offered += interval) {
+        if (now < offered) {
+            now = offered;
+        }
+        uint32_t delay = dutyCycleDelay(airtime, now);
+        if (DUTY_CYCLE_NEVER == delay) {
+            printf("Frame longer than any sub-band budget.\n");
+            return 0;
+        }
+        now += delay;
+        int band = dutyCycleConsume(airtime, now);
+
+        uint32_t wait = now - offered;
+        total_wait += wait;
+        if (wait > max_wait) {
+            max_wait = wait;
+        }
+        if (sent < 20 || 0 != delay) {
+            printf("t=%9u ms  offered=%9u ms  wait=%8u ms  band=%s  budget:", now, offered, wait,
+                   dutyCycleBand(band)->name);
+            for (int i = 0; i < dutyCycleBandCount(); i++) {
+                if (dutyCycleBand(i)->enabled) {
+                    printf(" %s=%u us", dutyCycleBand(i)->name, dutyCycleBudget(i, now));
+                }
+            }
+            printf("\n");
+        }
+        sent++;
+        /* the modem is busy for the airtime and the receive windows */
+        now += airtime / 1000 + 2000;
+    }
+
+    const duty_cycle_stats *stats = dutyCycleStatistics();
+    printf("%u uplinks in %u h, %u ms airtime, %u deferred, average wait %llu ms, worst wait %u ms\n", sent, hours,
+           stats->airtime_ms, stats->deferred, (unsigned long long) (sent ? total_wait / sent : 0), max_wait);
+    if (false == within) {
+        printf("%s: overloaded, the waits are not bounded\n\n", label);
+        return 0;
+    }
+    printf("%s: worst wait %u ms, bounded by %u ms: %s\n\n", label, max_wait, bound,
+           max_wait <= bound ? "ok" : "failed");
+    return max_wait <= bound ? 0 : 1;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Runs the duty cycle scheduler with a load within the budget and checks that the waits stay bounded, then
+ *         with an overload that saturates it. With arguments, runs the given load only.
+ *
+ * \param: optional arguments: interval in ms, data rate (default LORA_DEFAULT_DR), payload length in bytes (default
+ *         length of a dispense message) and simulated hours (default 2).
+ *
+ * \return: 0, 1 if a load within the budget waited longer than the bound
+ *
+ * \remarks: The default load is IN_BUDGET_INTERVAL for IN_BUDGET_HOURS, the overload OVERLOAD_INTERVAL (DEBUG timing).
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    int dr = argc > 2 ? atoi(argv[2]) : LORA_DEFAULT_DR;
+    size_t payload = argc > 3 ? strtoul(argv[3], NULL, 10) : strlen(message);
+
+    if (argc > 1) {
+        return run("given load", strtoul(argv[1], NULL, 10), dr, payload, argc > 4 ? strtoul(argv[4], NULL, 10) : 2);
+    }
+    int failed = run("within budget", IN_BUDGET_INTERVAL, dr, payload, IN_BUDGET_HOURS);
+    failed += run("overload", OVERLOAD_INTERVAL, dr, payload, 2);
+    return 0 == failed ? 0 : 1;
+}
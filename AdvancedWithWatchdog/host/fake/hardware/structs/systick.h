@@ -0,0 +1,16 @@
+#ifndef FAKE_HARDWARE_STRUCTS_SYSTICK
+#define FAKE_HARDWARE_STRUCTS_SYSTICK
+
+#include "pico/stdlib.h"
+
+typedef struct systick_hw_ {
+    uint32_t csr;
+    uint32_t rvr;
+    uint32_t cvr;                            // stands still, handler times read as 0
+    uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t fake_systick;
+#define systick_hw  ( &fake_systick )
+
+#endif
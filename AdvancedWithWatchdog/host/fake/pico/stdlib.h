@@ -0,0 +1,186 @@
+#ifndef FAKE_PICO_STDLIB
+#define FAKE_PICO_STDLIB
+
+/* Just enough of the Pico SDK to build the uart driver on the host. The peripherals are plain structs in memory:
+ * bytes for a uart to receive are queued with fakeUartReceive(), and a DMA channel copies them when fakeDmaRun() is
+ * called or the core sleeps. Bytes written to dr are collected in tx, the transmit FIFO is emptied by
+ * fakeUartTransmit(), or at the baud rate while the core sleeps with the TX interrupt on, which then runs the
+ * handler. A DMA transfer to a uart completes at once. The I2C bus has a 32 kB EEPROM on it, see
+ * i2c_write_blocking(). */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef unsigned int uint;
+typedef void (*irq_handler_t)(void);
+
+#define UART0_IRQ 20
+#define UART1_IRQ 21
+#define GPIO_FUNC_UART 2
+#define GPIO_FUNC_I2C 3
+
+#define UART_UARTIMSC_RXIM_LSB 4
+#define UART_UARTIMSC_TXIM_LSB 5
+#define UART_UARTIMSC_RXIM_BITS 0x10
+#define UART_UARTIMSC_TXIM_BITS 0x20
+#define UART_UARTIMSC_RTIM_BITS 0x40
+#define UART_UARTDMACR_RXDMAE_BITS 0x1
+#define UART_UARTDMACR_TXDMAE_BITS 0x2
+
+typedef struct uart_hw_ {
+    uint32_t dr;
+    uint32_t imsc;
+    uint32_t dmacr;
+} uart_hw_t;
+
+#define FAKE_TX_FIFO 32                      // bytes the transmit FIFO holds
+#define FAKE_DR_EMPTY 0x100u                 // dr holds no byte written by the driver
+
+typedef struct uart_inst_ {
+    uart_hw_t hw;
+    uint baudrate;
+    uint8_t rx[1024];                        // waiting to be received
+    int rx_head, rx_tail;
+    uint8_t tx[1024];                        // sent, the first tx_length % 1024 bytes
+    int tx_length;
+    int tx_fifo;                             // bytes in the transmit FIFO
+    uint64_t tx_empty_us;                    // time the FIFO has been sent while the core sleeps, 0 if not timed
+} uart_inst_t;
+
+extern uart_inst_t fake_uart[2];
+#define uart0  ( &fake_uart[0] )
+#define uart1  ( &fake_uart[1] )
+#define uart_default  uart0
+
+#define FAKE_EEPROM_SIZE 32768
+#define FAKE_EEPROM_PAGE 64                  // a write wraps around within its page, as on the 24LC256
+
+typedef struct i2c_inst_ {
+    uint baudrate;
+    uint16_t address;                        // of the next byte read
+    uint8_t memory[FAKE_EEPROM_SIZE];
+} i2c_inst_t;
+
+extern i2c_inst_t fake_i2c[2];
+#define i2c0  ( &fake_i2c[0] )
+#define i2c1  ( &fake_i2c[1] )
+
+/* time: it only passes in fakeAdvanceUs() and while the core sleeps */
+typedef uint64_t absolute_time_t;
+
+uint32_t time_us_32(void);
+void fakeAdvanceUs(uint32_t us);
+absolute_time_t get_absolute_time(void);
+absolute_time_t make_timeout_time_us(uint64_t us);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+bool time_reached(absolute_time_t t);
+bool best_effort_wfe_or_timeout(absolute_time_t timeout);
+uint32_t fakeWakeups(void);                  // calls of best_effort_wfe_or_timeout() so far
+uint32_t to_ms_since_boot(absolute_time_t t);
+
+static inline absolute_time_t absolute_time_min(absolute_time_t a, absolute_time_t b) {
+    return a < b ? a : b;
+}
+
+static inline void __sev(void) {
+}
+
+static inline void tight_loop_contents(void) {
+}
+
+void sleep_ms(uint32_t ms);
+
+/* cores, interrupts, mutexes: a single thread on core 0 */
+static inline uint get_core_num(void) {
+    return 0;
+}
+
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+}
+
+/* core 1 runs its entry at once, to the end, and hands back one value through the FIFO */
+void multicore_launch_core1(void (*entry)(void));
+void multicore_reset_core1(void);
+void multicore_fifo_push_blocking(uint32_t data);
+bool multicore_fifo_rvalid(void);
+uint32_t multicore_fifo_pop_blocking(void);
+
+typedef struct mutex_ {
+    bool owned;
+} mutex_t;
+
+#define auto_init_mutex(name)  static mutex_t name
+
+static inline void mutex_enter_blocking(mutex_t *mutex) {
+    mutex->owned = true;
+}
+
+static inline void mutex_exit(mutex_t *mutex) {
+    mutex->owned = false;
+}
+
+/* gpio, irq */
+void gpio_set_function(uint gpio, int function);
+void irq_set_enabled(uint irq, bool enabled);
+void irq_set_exclusive_handler(uint irq, irq_handler_t handler);
+
+/* uart */
+uint uart_init(uart_inst_t *uart, uint baudrate);
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate);
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data);
+uart_hw_t *uart_get_hw(uart_inst_t *uart);
+bool uart_is_readable(uart_inst_t *uart);
+bool uart_is_writable(uart_inst_t *uart);
+char uart_getc(uart_inst_t *uart);
+uint uart_get_dreq(uart_inst_t *uart, bool is_tx);
+void fakeUartReceive(uart_inst_t *uart, const uint8_t *data, int length);
+void fakeUartTransmit(uart_inst_t *uart);
+void fakeUartReceiveLater(uart_inst_t *uart, const uint8_t *data, int length, uint32_t delay_us);
+
+/* i2c */
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+
+static inline void hw_set_bits(volatile uint32_t *address, uint32_t mask) {
+    *address |= mask;
+}
+
+static inline void hw_clear_bits(volatile uint32_t *address, uint32_t mask) {
+    *address &= ~mask;
+}
+
+/* dma */
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct dma_channel_config_ {
+    uint ring_bits;
+    uint dreq;
+} dma_channel_config;
+
+typedef struct dma_channel_hw_ {
+    uint32_t transfer_count;
+} dma_channel_hw_t;
+
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config *config, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config *config, bool increment);
+void channel_config_set_write_increment(dma_channel_config *config, bool increment);
+void channel_config_set_ring(dma_channel_config *config, bool write, uint size_bits);
+void channel_config_set_dreq(dma_channel_config *config, uint dreq);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_set_trans_count(uint channel, uint32_t count, bool trigger);
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count);
+void fakeDmaRun(void);
+
+#endif
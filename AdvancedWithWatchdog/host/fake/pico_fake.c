@@ -0,0 +1,333 @@
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+
+#define FAKE_DMA_CHANNELS 12
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+typedef struct fake_dma_ {
+    bool claimed;
+    bool busy;
+    uint8_t *write;                          // start of the ring
+    uint32_t ring_mask;
+    uint32_t position;
+    uart_inst_t *uart;                       // paced by the DREQ of this uart
+    dma_channel_hw_t hw;
+} fake_dma;
+
+uart_inst_t fake_uart[2];
+i2c_inst_t fake_i2c[2];
+systick_hw_t fake_systick;
+static fake_dma dma[FAKE_DMA_CHANNELS];
+static uint64_t now_us;
+static uint32_t wakeups;
+static irq_handler_t handlers[2];            // of UART0_IRQ and UART1_IRQ
+static struct {
+    bool valid;
+    uint32_t data;
+} core1_fifo;
+
+/* bytes that arrive later, see fakeUartReceiveLater() */
+static struct {
+    uart_inst_t *uart;
+    uint8_t data[256];
+    int length;
+    uint64_t at_us;
+} later;
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+uint32_t time_us_32(void) {
+    return (uint32_t) now_us;
+}
+
+void fakeAdvanceUs(uint32_t us) {
+    now_us += us;
+}
+
+absolute_time_t get_absolute_time(void) {
+    return now_us;
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us) {
+    return now_us + us;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return now_us + ms * 1000ull;
+}
+
+bool time_reached(absolute_time_t t) {
+    return now_us >= t;
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t) (t / 1000);
+}
+
+/* A uart sending with its TX interrupt on: the FIFO goes out at the baud rate, 10 bits a byte, then the interrupt
+ * wakes the core. Returns true if that happens before the timeout. */
+static bool transmitUntil(absolute_time_t timeout) {
+    for (int i = 0; i < 2; i++) {
+        uart_inst_t *uart = &fake_uart[i];
+        if (0 == (uart->hw.imsc & UART_UARTIMSC_TXIM_BITS) || NULL == handlers[i] || 0 == uart->baudrate) {
+            continue;
+        }
+        (void) uart_is_writable(uart);
+        if (0 == uart->tx_empty_us) {
+            uart->tx_empty_us = now_us + (uint64_t) uart->tx_fifo * 10 * 1000000 / uart->baudrate;
+        }
+        if (uart->tx_empty_us <= timeout) {
+            now_us = uart->tx_empty_us > now_us ? uart->tx_empty_us : now_us;
+            fakeUartTransmit(uart);
+            handlers[i]();
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Sleeps until a uart interrupt, the bytes queued by fakeUartReceiveLater() arrive or the timeout, the DMA then
+ * takes what was received */
+bool best_effort_wfe_or_timeout(absolute_time_t timeout) {
+    wakeups++;
+    if (true == transmitUntil(timeout)) {
+        fakeDmaRun();
+        return false;
+    }
+    if (NULL != later.uart && later.at_us <= timeout) {
+        now_us = later.at_us > now_us ? later.at_us : now_us;
+        fakeUartReceive(later.uart, later.data, later.length);
+        later.uart = NULL;
+        fakeDmaRun();
+        return false;
+    }
+    now_us = timeout > now_us ? timeout : now_us;
+    fakeDmaRun();
+    return true;
+}
+
+uint32_t fakeWakeups(void) {
+    return wakeups;
+}
+
+void sleep_ms(uint32_t ms) {
+    now_us += ms * 1000ull;
+}
+
+void gpio_set_function(uint gpio, int function) {
+}
+
+void irq_set_enabled(uint irq, bool enabled) {
+}
+
+void irq_set_exclusive_handler(uint irq, irq_handler_t handler) {
+    if (UART0_IRQ == irq || UART1_IRQ == irq) {
+        handlers[irq - UART0_IRQ] = handler;
+    }
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    entry();
+}
+
+void multicore_reset_core1(void) {
+    core1_fifo.valid = false;
+}
+
+void multicore_fifo_push_blocking(uint32_t data) {
+    core1_fifo.data = data;
+    core1_fifo.valid = true;
+}
+
+bool multicore_fifo_rvalid(void) {
+    return core1_fifo.valid;
+}
+
+uint32_t multicore_fifo_pop_blocking(void) {
+    core1_fifo.valid = false;
+    return core1_fifo.data;
+}
+
+uint uart_init(uart_inst_t *uart, uint baudrate) {
+    uart->hw.dr = FAKE_DR_EMPTY;
+    uart->hw.imsc = 0;
+    uart->hw.dmacr = 0;
+    uart->baudrate = baudrate;
+    return baudrate;
+}
+
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate) {
+    uart->baudrate = baudrate;
+    return baudrate;
+}
+
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data) {
+    uart->hw.imsc = (rx_has_data ? UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS : 0) |
+                    (tx_needs_data ? UART_UARTIMSC_TXIM_BITS : 0);
+}
+
+uart_hw_t *uart_get_hw(uart_inst_t *uart) {
+    return &uart->hw;
+}
+
+bool uart_is_readable(uart_inst_t *uart) {
+    return uart->rx_head != uart->rx_tail;
+}
+
+/* The driver checks before each byte it writes, so a byte waiting in dr is moved to the FIFO here */
+bool uart_is_writable(uart_inst_t *uart) {
+    if (uart->hw.dr < FAKE_DR_EMPTY) {
+        uart->tx[uart->tx_length++ % sizeof(uart->tx)] = (uint8_t) uart->hw.dr;
+        uart->tx_fifo++;
+        uart->hw.dr = FAKE_DR_EMPTY;
+    }
+    return uart->tx_fifo < FAKE_TX_FIFO;
+}
+
+/* Sends what is in the transmit FIFO, the driver refills it in its TX interrupt */
+void fakeUartTransmit(uart_inst_t *uart) {
+    (void) uart_is_writable(uart);
+    uart->tx_fifo = 0;
+    uart->tx_empty_us = 0;
+}
+
+char uart_getc(uart_inst_t *uart) {
+    char c = uart->rx[uart->rx_tail];
+    uart->rx_tail = (uart->rx_tail + 1) % sizeof(uart->rx);
+    return c;
+}
+
+uint uart_get_dreq(uart_inst_t *uart, bool is_tx) {
+    return (uint) (uart - fake_uart);
+}
+
+/* Queues bytes for a uart to receive */
+void fakeUartReceive(uart_inst_t *uart, const uint8_t *data, int length) {
+    for (int i = 0; i < length; i++) {
+        uart->rx[uart->rx_head] = data[i];
+        uart->rx_head = (uart->rx_head + 1) % sizeof(uart->rx);
+    }
+}
+
+/* Queues bytes that arrive after the given time, one batch at a time */
+void fakeUartReceiveLater(uart_inst_t *uart, const uint8_t *data, int length, uint32_t delay_us) {
+    length = length < (int) sizeof(later.data) ? length : (int) sizeof(later.data);
+    memcpy(later.data, data, length);
+    later.length = length;
+    later.uart = uart;
+    later.at_us = now_us + delay_us;
+}
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+    i2c->baudrate = baudrate;
+    return baudrate;
+}
+
+/* The first two bytes set the EEPROM address, the rest is written from there within its page */
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    if (len < 2) {
+        return -1;
+    }
+    uint16_t address = (uint16_t) ((src[0] << 8 | src[1]) % FAKE_EEPROM_SIZE);
+    uint16_t page = address - address % FAKE_EEPROM_PAGE;
+
+    for (size_t i = 2; i < len; i++) {
+        i2c->memory[page + (address + i - 2) % FAKE_EEPROM_PAGE] = src[i];
+    }
+    i2c->address = address;
+    return (int) len;
+}
+
+/* Sequential read from the address set by the last write */
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = i2c->memory[i2c->address];
+        i2c->address = (i2c->address + 1) % FAKE_EEPROM_SIZE;
+    }
+    return (int) len;
+}
+
+int dma_claim_unused_channel(bool required) {
+    for (int i = 0; i < FAKE_DMA_CHANNELS; i++) {
+        if (false == dma[i].claimed) {
+            dma[i].claimed = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config config = {0, 0};
+    return config;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *config, enum dma_channel_transfer_size size) {
+}
+
+void channel_config_set_read_increment(dma_channel_config *config, bool increment) {
+}
+
+void channel_config_set_write_increment(dma_channel_config *config, bool increment) {
+}
+
+void channel_config_set_ring(dma_channel_config *config, bool write, uint size_bits) {
+    config->ring_bits = size_bits;
+}
+
+void channel_config_set_dreq(dma_channel_config *config, uint dreq) {
+    config->dreq = dreq;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    fake_dma *d = &dma[channel];
+
+    d->write = (uint8_t *) write_addr;
+    d->ring_mask = (1u << config->ring_bits) - 1;
+    d->position = 0;
+    d->uart = &fake_uart[config->dreq];
+    d->hw.transfer_count = transfer_count;
+    d->busy = trigger && transfer_count > 0;
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    return &dma[channel].hw;
+}
+
+bool dma_channel_is_busy(uint channel) {
+    return dma[channel].busy;
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t count, bool trigger) {
+    dma[channel].hw.transfer_count = count;
+    dma[channel].busy = trigger && count > 0;
+}
+
+/* A transfer to the uart of the channel, sent at once */
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count) {
+    uart_inst_t *uart = dma[channel].uart;
+
+    for (uint32_t i = 0; i < transfer_count; i++) {
+        uart->tx[uart->tx_length++ % sizeof(uart->tx)] = ((const volatile uint8_t *) read_addr)[i];
+    }
+    dma[channel].hw.transfer_count = 0;
+    dma[channel].busy = false;
+}
+
+/* Runs the busy channels: each takes what its uart has received, as the DREQ would let it */
+void fakeDmaRun(void) {
+    for (int i = 0; i < FAKE_DMA_CHANNELS; i++) {
+        fake_dma *d = &dma[i];
+        while (true == d->busy && (d->uart->hw.dmacr & UART_UARTDMACR_RXDMAE_BITS) && uart_is_readable(d->uart)) {
+            d->write[d->position++ & d->ring_mask] = (uint8_t) uart_getc(d->uart);
+            d->busy = 0 != --d->hw.transfer_count;
+        }
+    }
+}
@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "ring_buffer.h"
+#include "uart.h"
+#include "lorawan.h"
+#include "eeprom.h"
+#include "debuglog.h"
+
+#define REPETITIONS 7                        // measurements per benchmark, the median is reported
+#define BURST 16                             // bytes put per interrupt, about one uart FIFO
+#define DEBUG_BATCH 4                        // records put per debugLogDrain(), their output fits in one transfer
+
+void uart1_handler(void);
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+/* The counts are fixed, not calibrated to a time, so every run and every commit measures the same work */
+typedef struct benchmark_ {
+    const char *name;
+    const char *op;                          // what one operation is
+    long ops;                                // operations per measurement
+    int bytes;                               // bytes per operation, 0 if it does not apply
+    void (*setup)(void);                     // before the measurements, may be NULL
+    void (*run)(long ops);
+} benchmark;
+
+typedef struct result_ {
+    double median_ns;
+    double min_ns;
+    double max_ns;
+} result;
+
+static int log_entries;
+int *log_counter = &log_entries;
+
+static const char command[] = "AT+CMSGHEX=\"0F01A2000000000000000000000000000000000000\"\r\n";
+static const char response[] = "+CMSGHEX: Done\r\n";
+static const char log_message[] = "Day 3: Pill dispensed. Compartment 3 of 7.";
+
+static volatile uint32_t sink;               // keeps the results of the measured calls alive
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Lets the uart send everything that is waiting, one TX interrupt per FIFO */
+static void transmitAll(void) {
+    while (uart1->hw.imsc & UART_UARTIMSC_TXIM_BITS) {
+        fakeUartTransmit(uart1);
+        uart1_handler();
+    }
+    fakeUartTransmit(uart1);
+}
+
+/* rb_put() of a burst, then rb_get() of it, as the interrupt and the reader do */
+static void benchRingBytes(long ops) {
+    static uint8_t storage[256];
+    ring_buffer rb;
+    uint32_t sum = 0;
+
+    rb_init(&rb, storage, sizeof(storage));
+    for (long i = 0; i < ops; i += BURST) {
+        for (int j = 0; j < BURST; j++) {
+            rb_put(&rb, (uint8_t) (i + j));
+        }
+        for (int j = 0; j < BURST; j++) {
+            sum += rb_get(&rb);
+        }
+    }
+    sink = sum;
+}
+
+/* rb_write() and rb_read() of a whole message */
+static void benchRingMessages(long ops) {
+    static uint8_t storage[256];
+    uint8_t message[64], copy[64];
+    ring_buffer rb;
+
+    memset(message, 'm', sizeof(message));
+    rb_init(&rb, storage, sizeof(storage));
+    for (long i = 0; i < ops; i++) {
+        message[0] = (uint8_t) i;
+        rb_write(&rb, message, sizeof(message));
+        rb_read(&rb, copy, sizeof(copy));
+    }
+    sink = copy[0];
+}
+
+static void setupUart(void) {
+    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE);
+    uart_rx_dma(UART_NR);
+}
+
+/* uart_write() of a command and the TX interrupts that send it */
+static void benchUartWrite(long ops) {
+    for (long i = 0; i < ops; i++) {
+        uart_write(UART_NR, (const uint8_t *) command, sizeof(command) - 1);
+        transmitAll();
+    }
+    sink = uart1->tx_length;
+    uart1->tx_length = 0;
+}
+
+/* uart_write_ref() of a constant command and the TX interrupts that send it */
+static void benchUartWriteRef(long ops) {
+    uint32_t ticket = 0;
+
+    for (long i = 0; i < ops; i++) {
+        uart_write_ref(UART_NR, (const uint8_t *) command, sizeof(command) - 1, &ticket);
+        transmitAll();
+    }
+    sink = uart_tx_done(UART_NR, ticket);
+    uart1->tx_length = 0;
+}
+
+/* A response line taken by the DMA and read with uart_read_line() */
+static void benchUartReadLine(long ops) {
+    absolute_time_t deadline = make_timeout_time_ms(1000);
+    char line[32];
+    int length = 0;
+
+    for (long i = 0; i < ops; i++) {
+        fakeUartReceive(uart1, (const uint8_t *) response, sizeof(response) - 1);
+        fakeDmaRun();
+        length += uart_read_line(UART_NR, line, sizeof(line), deadline);
+    }
+    sink = length;
+}
+
+/* crc16() of a log message sized block */
+static void benchCrc16(long ops) {
+    uint8_t block[MAX_LOG_SIZE];
+    uint32_t sum = 0;
+
+    memset(block, 0x5A, sizeof(block));
+    for (long i = 0; i < ops; i++) {
+        block[0] = (uint8_t) i;
+        sum += crc16(block, sizeof(block));
+    }
+    sink = sum;
+}
+
+static void setupEeprom(void) {
+    i2cInit();
+}
+
+/* writeLogEntry() to the fake EEPROM, starting over before the log is full so eraseLog() is not measured */
+static void benchLogWrite(long ops) {
+    for (long i = 0; i < ops; i++) {
+        if (*log_counter >= MAX_LOG_ENTRY) {
+            *log_counter = 0;
+        }
+        writeLogEntry(log_message);
+    }
+}
+
+static void setupLogRead(void) {
+    i2cInit();
+    *log_counter = 0;
+    for (int i = 0; i < MAX_LOG_ENTRY; i++) {
+        writeLogEntry(log_message);
+    }
+}
+
+/* readLogEntry() with its CRC check from a full log */
+static void benchLogRead(long ops) {
+    char message[MAX_LOG_SIZE];
+    int valid = 0;
+
+    for (long i = 0; i < ops; i++) {
+        valid += readLogEntry(i % MAX_LOG_ENTRY, message);
+    }
+    sink = valid;
+    assert(ops == valid);
+}
+
+static void setupDebugLog(void) {
+    debugLogInit();
+}
+
+/* debugLog() of a record with four arguments, formatted and sent by debugLogDrain() */
+static void benchDebugLog(long ops) {
+    for (long i = 0; i < ops; i += DEBUG_BATCH) {
+        for (int j = 0; j < DEBUG_BATCH; j++) {
+            debugLog("Day %d: compartment %d of %d, %d steps\n", (int) i, j, 7, 4096);
+        }
+        debugLogDrain();
+    }
+    sink = uart0->tx_length;
+    uart0->tx_length = 0;
+}
+
+/* debugLogString() of a log message, formatted and sent by debugLogDrain() */
+static void benchDebugLogString(long ops) {
+    for (long i = 0; i < ops; i += DEBUG_BATCH) {
+        for (int j = 0; j < DEBUG_BATCH; j++) {
+            debugLogString("%s\n", log_message);
+        }
+        debugLogDrain();
+    }
+    sink = uart0->tx_length;
+    uart0->tx_length = 0;
+}
+
+static const benchmark benchmarks[] = {
+    {"rb_put_get",          "byte",    64000000, 1,                       NULL,          benchRingBytes},
+    {"rb_write_read",       "message", 4000000,  64,                      NULL,          benchRingMessages},
+    {"uart_write",          "command", 400000,   sizeof(command) - 1,     setupUart,     benchUartWrite},
+    {"uart_write_ref",      "command", 400000,   sizeof(command) - 1,     setupUart,     benchUartWriteRef},
+    {"uart_read_line",      "line",    1000000,  sizeof(response) - 1,    setupUart,     benchUartReadLine},
+    {"crc16",               "block",   400000,   MAX_LOG_SIZE,            NULL,          benchCrc16},
+    {"log_write",           "entry",   200000,   sizeof(log_message) + 2, setupEeprom,   benchLogWrite},
+    {"log_read",            "entry",   200000,   MAX_LOG_SIZE,            setupLogRead,  benchLogRead},
+    {"debug_log",           "record",  1000000,  0,                       setupDebugLog, benchDebugLog},
+    {"debug_log_string",    "record",  1000000,  0,                       setupDebugLog, benchDebugLogString},
+};
+
+#define BENCHMARKS  ( sizeof(benchmarks) / sizeof(benchmarks[0]) )
+
+/**********************************************************************************************************************
+ * \brief: Runs a benchmark once to warm up, then REPETITIONS times.
+ *
+ * \param: 1 param: the benchmark.
+ *
+ * \return: median, fastest and slowest time per operation in ns
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static result measure(const benchmark *b) {
+    double ns[REPETITIONS];
+
+    if (NULL != b->setup) {
+        b->setup();
+    }
+    b->run(b->ops);
+    for (int i = 0; i < REPETITIONS; i++) {
+        double start = seconds();
+        b->run(b->ops);
+        ns[i] = (seconds() - start) * 1e9 / b->ops;
+    }
+    qsort(ns, REPETITIONS, sizeof(ns[0]), compareDouble);
+
+    result r = {ns[REPETITIONS / 2], ns[0], ns[REPETITIONS - 1]};
+    return r;
+}
+
+/* true if the benchmark is selected on the command line, every benchmark is without names */
+static bool selected(const char *name, char **names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (0 == strncmp(name, names[i], strlen(names[i]))) {
+            return true;
+        }
+    }
+    return 0 == count;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Benchmarks the ring buffer, the uart driver against the fake Pico SDK, crc16(), the EEPROM log and the
+ *         deferred debug output. Prints a table, and with -j the results as JSON to a file, or to stdout with -j -.
+ *
+ * \param: firmware_bench [-j results.json] [name prefix...]
+ *
+ * \return: 0, 2 on a usage error
+ *
+ * \remarks: The operation counts and repetitions are fixed, so the JSON of two commits can be compared benchmark by
+ *           benchmark. The uart and EEPROM times include the fake peripherals, which do less than the real ones.
+ **********************************************************************************************************************/
+int main(int argc, char **argv) {
+    const char *json_path = NULL;
+    int first = 1;
+
+    if (argc > 2 && 0 == strcmp(argv[1], "-j")) {
+        json_path = argv[2];
+        first = 3;
+    } else if (argc > 1 && '-' == argv[1][0]) {
+        fprintf(stderr, "usage: %s [-j results.json] [name prefix...]\n", argv[0]);
+        return 2;
+    }
+
+    FILE *json = NULL;
+    FILE *table = stdout;
+    if (NULL != json_path && 0 == strcmp(json_path, "-")) {
+        json = stdout;
+        table = stderr;
+    } else if (NULL != json_path && NULL == (json = fopen(json_path, "w"))) {
+        perror(json_path);
+        return 2;
+    }
+
+    fprintf(table, "%-18s %10s %12s %12s %12s %14s\n", "benchmark", "ops", "ns/op", "min ns/op", "max ns/op", "ops/s");
+    if (NULL != json) {
+        fprintf(json, "{\n  \"suite\": \"firmware_bench\",\n  \"repetitions\": %d,\n  \"benchmarks\": [", REPETITIONS);
+    }
+
+    const char *separator = "";
+    for (int i = 0; i < BENCHMARKS; i++) {
+        const benchmark *b = &benchmarks[i];
+        if (false == selected(b->name, &argv[first], argc - first)) {
+            continue;
+        }
+        result r = measure(b);
+        double ops_per_s = 1e9 / r.median_ns;
+
+        fprintf(table, "%-18s %10ld %12.2f %12.2f %12.2f %14.0f\n", b->name, b->ops, r.median_ns, r.min_ns,
+                r.max_ns, ops_per_s);
+        if (NULL != json) {
+            fprintf(json, "%s\n    {\"name\": \"%s\", \"op\": \"%s\", \"ops\": %ld, \"bytes_per_op\": %d, "
+                    "\"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"max_ns_per_op\": %.3f, \"ops_per_s\": %.0f}",
+                    separator, b->name, b->op, b->ops, b->bytes, r.median_ns, r.min_ns, r.max_ns, ops_per_s);
+            separator = ",";
+        }
+    }
+
+    if (NULL != json) {
+        fprintf(json, "\n  ]\n}\n");
+        if (stdout != json) {
+            fclose(json);
+        }
+    }
+    return 0;
+}
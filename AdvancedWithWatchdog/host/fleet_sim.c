@@ -0,0 +1,387 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eeprom.h"
+#include "steppermotor.h"
+#include "lorawan.h"
+#include "messages.h"
+#include "work_pool.h"
+
+#define FLEET_CHUNK 64                       // devices per pool task
+#define EPOCH_MS 3600000ULL                  // virtual time run per pool batch
+#define DAY_MS 86400000ULL
+#define ROTATION_MS 1500                     // stepper run of one compartment
+#define BOOT_MS 2000                         // reset to the boot messages of main()
+#define CALIBRATION_STEPS 4096
+
+/* Rates of the failure paths and of the patient, per device */
+#define POWER_LOSS_DAYS 30.0                 // mean days between power losses
+#define WATCHDOG_DAYS 60.0                   // mean days between watchdog reboots
+#define PILL_MISS_PERCENT 2                  // compartments the optofork misses
+#define OUTAGE_MAX_MS 21600000               // longest power outage
+#define CALIBRATE_DELAY_MS 3600000           // longest wait for SW_0 after boot or refill
+#define DISPENSE_DELAY_MS 43200000           // longest wait for SW_2 after calibration
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+/* What a device does next, the steps of main() and dispensePills() */
+enum DeviceStep {
+    STEP_BOOT,
+    STEP_CALIBRATE,                          // SW_0 pressed in CALIB_WAITING
+    STEP_DISPENSE,                           // SW_2 pressed in DISPENSE_WAITING
+    STEP_RESUME,                             // COMPARTMENT_TIME over after a boot IN_THE_MIDDLE, FINISHED is stored
+    STEP_ROTATE,                             // motor starts turning the current compartment, if any is left
+    STEP_ROTATED,                            // compartment done, pill detected or not
+    STEP_NEXT,                               // COMPARTMENT_TIME over, on to the next compartment
+    STEP_RESET                               // resetValues() after the last compartment
+};
+
+typedef struct device_ {
+    uint32_t random;
+    enum DeviceStep step;
+    uint64_t step_ms;
+    uint64_t failure_ms;                     // next power loss or watchdog reset
+    bool failure_watchdog;
+    bool reboot_watchdog;                    // watchdog_caused_reboot() of the coming boot
+    bool stored;                             // readStruct() succeeds
+    machineState machine;                    // RAM copy
+    machineState eeprom;                     // copy written by writeStruct()
+} device;
+
+/* Uplinks of one chunk of devices in one epoch */
+typedef struct chunk_output_ {
+    char *text;
+    size_t length;
+    size_t capacity;
+    unsigned long uplinks;
+} chunk_output;
+
+typedef struct fleet_ {
+    device *devices;
+    size_t count;
+    chunk_output *outputs;
+    uint64_t epoch_end;
+    uint64_t interval_ms;                    // COMPARTMENT_TIME, configGet()->dispenseInterval
+} fleet;
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t nextRandom(device *d) {
+    d->random ^= d->random << 13;
+    d->random ^= d->random >> 17;
+    d->random ^= d->random << 5;
+    return d->random;
+}
+
+/* Uniform delay of 1 ms..max_ms */
+static uint64_t randomDelay(device *d, uint64_t max_ms) {
+    return 1 + (((uint64_t) nextRandom(d) << 32 | nextRandom(d)) % max_ms);
+}
+
+/* Schedules the next power loss or watchdog reset, exponentially distributed */
+static void scheduleFailure(device *d, uint64_t now) {
+    double power = -log((nextRandom(d) + 1.0) / 4294967297.0) * POWER_LOSS_DAYS * DAY_MS;
+    double watchdog = -log((nextRandom(d) + 1.0) / 4294967297.0) * WATCHDOG_DAYS * DAY_MS;
+
+    d->failure_watchdog = watchdog < power;
+    d->failure_ms = now + 1 + (uint64_t) (true == d->failure_watchdog ? watchdog : power);
+}
+
+static void schedule(device *d, enum DeviceStep step, uint64_t at) {
+    d->step = step;
+    d->step_ms = at;
+}
+
+static void storeState(device *d) {
+    d->eeprom = d->machine;
+    d->stored = true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Sends an uplink the way eepromLorawanComm() does: the message is the payload, and the state is written to
+ *         EEPROM. The uplink is appended to the output as device,time_ms,payload_hex, the capture format of
+ *         uplink_decode.
+ *
+ * \param: 5 params: pointer to the output, the device, its number, the time and the message.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void send(chunk_output *output, device *d, size_t number, uint64_t now, const char *message) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t length = strlen(message);
+
+    storeState(d);
+    if (output->capacity - output->length < 2 * length + 48) {
+        output->capacity = output->capacity ? 2 * output->capacity : 65536;
+        output->text = realloc(output->text, output->capacity);
+    }
+    char *text = &output->text[output->length];
+    text += sprintf(text, "%zu,%llu,", number, (unsigned long long) now);
+    for (size_t i = 0; i < length; i++) {
+        *text++ = hex[(uint8_t) message[i] >> 4];
+        *text++ = hex[message[i] & 0x0F];
+    }
+    *text++ = '\n';
+    output->length = text - output->text;
+    output->uplinks++;
+}
+
+/**********************************************************************************************************************
+ * \brief: Runs the boot path of main(): boot messages, then the state read from EEPROM decides whether the device
+ *         waits for calibration, for SW_2 or resumes an interrupted dispense.
+ *
+ * \param: 5 params: pointer to the output, the device, its number, the time and the compartment interval.
+ *
+ * \return:
+ *
+ * \remarks: Keeps the quirks of main(), e.g. a power loss right after a resumed dispense skips a compartment.
+ **********************************************************************************************************************/
+static void boot(chunk_output *output, device *d, size_t number, uint64_t now, uint64_t interval) {
+    const char *reset_msg = true == d->reboot_watchdog ? fixed_msg[7] : fixed_msg[0];
+
+    d->machine = d->eeprom;
+    if (false == d->stored || CALIB_WAITING == d->machine.currentState) {
+        send(output, d, number, now, reset_msg);
+        send(output, d, number, now, fixed_msg[6]);
+        schedule(d, STEP_CALIBRATE, now + randomDelay(d, CALIBRATE_DELAY_MS));
+        return;
+    }
+
+    send(output, d, number, now, reset_msg);
+    if (IN_THE_MIDDLE == d->machine.compartmentFinished) {
+        if (0 != d->machine.compartmentsMoved) {
+            send(output, d, number, now, fixed_msg[3]);
+        }
+        schedule(d, STEP_RESUME, now + interval);
+    } else if (0 == d->machine.compartmentsMoved) {
+        send(output, d, number, now, fixed_msg[5]);
+        d->machine.compartmentsMoved = 1;
+        schedule(d, STEP_DISPENSE, now + randomDelay(d, DISPENSE_DELAY_MS));
+    } else {
+        d->machine.compartmentsMoved++;
+        send(output, d, number, now, fixed_msg[2]);
+        schedule(d, STEP_ROTATE, now + interval);
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Runs one step of a device, see enum DeviceStep.
+ *
+ * \param: 4 params: pointer to the output, the device, its number and the compartment interval.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void step(chunk_output *output, device *d, size_t number, uint64_t interval) {
+    uint64_t now = d->step_ms;
+    char dispensed_msg[STRLEN];
+
+    switch (d->step) {
+        case STEP_BOOT:
+            boot(output, d, number, now, interval);
+            break;
+        case STEP_CALIBRATE:
+            d->machine.currentState = DISPENSE_WAITING;
+            d->machine.calibrationCount = CALIBRATION_STEPS;
+            d->machine.compartmentFinished = FINISHED;
+            send(output, d, number, now, fixed_msg[1]);
+            schedule(d, STEP_DISPENSE, now + randomDelay(d, DISPENSE_DELAY_MS));
+            break;
+        case STEP_DISPENSE:
+            d->machine.compartmentsMoved = 1;
+            schedule(d, STEP_ROTATE, now);
+            break;
+        case STEP_RESUME:
+            /* main() stores FINISHED before dispensePills(), which stores IN_THE_MIDDLE again after the write */
+            d->machine.compartmentFinished = FINISHED;
+            storeState(d);
+            schedule(d, STEP_ROTATE, now + I2C_MEM_WRITE_TIME);
+            break;
+        case STEP_NEXT:
+            d->machine.compartmentsMoved++;
+            /* fall through */
+        case STEP_ROTATE:
+            if (COMPARTMENTS <= d->machine.compartmentsMoved) {
+                schedule(d, STEP_RESET, now);
+                break;
+            }
+            d->machine.compartmentFinished = IN_THE_MIDDLE;
+            storeState(d);
+            schedule(d, STEP_ROTATED, now + ROTATION_MS);
+            break;
+        case STEP_ROTATED:
+            d->machine.compartmentFinished = FINISHED;
+            storeState(d);
+            snprintf(dispensed_msg, sizeof(dispensed_msg), "Day %d: Pill %sdispensed. Number of pills left: %d.",
+                     d->machine.compartmentsMoved, nextRandom(d) % 100 < PILL_MISS_PERCENT ? "not " : "",
+                     COMPARTMENTS - d->machine.compartmentsMoved - 1);
+            send(output, d, number, now, dispensed_msg);
+            if ((COMPARTMENTS - 1) > d->machine.compartmentsMoved) {
+                schedule(d, STEP_NEXT, now + interval - I2C_MEM_WRITE_TIME);
+            } else {
+                send(output, d, number, now, fixed_msg[4]);
+                schedule(d, STEP_RESET, now + MSG_WAITING_TIME);
+            }
+            break;
+        case STEP_RESET:
+            memset(&d->machine, 0, sizeof(d->machine));
+            d->machine.currentState = CALIB_WAITING;
+            d->machine.compartmentFinished = IN_THE_MIDDLE;
+            storeState(d);
+            schedule(d, STEP_CALIBRATE, now + randomDelay(d, CALIBRATE_DELAY_MS));
+            break;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Pool task: runs the devices of one chunk until the end of the epoch. A failure that comes before the next
+ *         step cuts the power or resets the device, RAM is lost and the device boots from its EEPROM copy.
+ *
+ * \param: 3 params: pointer to the fleet, chunk number and worker number.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void runChunk(void *context, size_t chunk, int worker) {
+    fleet *f = context;
+    chunk_output *output = &f->outputs[chunk];
+    size_t last = (chunk + 1) * FLEET_CHUNK < f->count ? (chunk + 1) * FLEET_CHUNK : f->count;
+
+    (void) worker;
+    for (size_t number = chunk * FLEET_CHUNK; number < last; number++) {
+        device *d = &f->devices[number];
+        while (true) {
+            if (d->failure_ms <= d->step_ms && d->failure_ms < f->epoch_end) {
+                uint64_t at = d->failure_ms;
+                d->reboot_watchdog = d->failure_watchdog;
+                schedule(d, STEP_BOOT, at + (true == d->failure_watchdog ? BOOT_MS : randomDelay(d, OUTAGE_MAX_MS)));
+                scheduleFailure(d, d->step_ms);
+            } else if (d->step_ms < f->epoch_end) {
+                step(output, d, number, f->interval_ms);
+            } else {
+                break;
+            }
+        }
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-n devices] [-d days] [-i interval_s] [-x compression] [-t threads] [-o capture]\n"
+                    "  -x 0 runs as fast as possible, -x 3600 runs an hour of fleet time per second\n"
+                    "  -o - writes the uplinks to stdout, device,time_ms,payload_hex per line\n", name);
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Runs a fleet of independent dispensers in virtual time for load testing the backend. Every device runs the
+ *         state machine of main(): boot, calibration, dispensing, power losses and watchdog reboots, and sends the
+ *         payloads eepromLorawanComm() would send.
+ *
+ * \param: options, see usage().
+ *
+ * \return: 0, 1 on error.
+ *
+ * \remarks: The fleet is cut into chunks of FLEET_CHUNK devices that a work stealing pool runs one epoch of virtual
+ *           time at a time. Devices seed their own random numbers, so the capture does not depend on the threads.
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    static work_pool pool;
+    static fleet f;
+    size_t devices = 10000;
+    double days = 30, compression = 0;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    FILE *capture = NULL;
+    unsigned long long uplinks = 0, bytes = 0;
+    int option;
+
+    f.interval_ms = DAY_MS;
+    while ((option = getopt(argc, argv, "n:d:i:x:t:o:h")) != -1) {
+        switch (option) {
+            case 'n': devices = strtoul(optarg, NULL, 10); break;
+            case 'd': days = atof(optarg); break;
+            case 'i': f.interval_ms = strtoull(optarg, NULL, 10) * 1000; break;
+            case 'x': compression = atof(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 'o':
+                capture = 0 == strcmp(optarg, "-") ? stdout : fopen(optarg, "w");
+                if (NULL == capture) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (0 == devices || days <= 0 || 0 == f.interval_ms) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t chunks = (devices + FLEET_CHUNK - 1) / FLEET_CHUNK;
+    f.count = devices;
+    f.devices = calloc(devices, sizeof(device));
+    f.outputs = calloc(chunks, sizeof(chunk_output));
+    for (size_t i = 0; i < devices; i++) {
+        device *d = &f.devices[i];
+        d->random = 2463534242u ^ (uint32_t) (i * 2654435761u);
+        d->random = 0 != d->random ? d->random : 1;
+        schedule(d, STEP_BOOT, randomDelay(d, DAY_MS));
+        scheduleFailure(d, d->step_ms);
+    }
+    threads = workPoolInit(&pool, threads);
+
+    uint64_t end = (uint64_t) (days * DAY_MS);
+    double start = seconds();
+    for (f.epoch_end = EPOCH_MS; f.epoch_end - EPOCH_MS < end; f.epoch_end += EPOCH_MS) {
+        workPoolRun(&pool, chunks, runChunk, &f);
+        for (size_t i = 0; i < chunks; i++) {
+            if (NULL != capture) {
+                fwrite(f.outputs[i].text, 1, f.outputs[i].length, capture);
+            }
+            uplinks += f.outputs[i].uplinks;
+            bytes += f.outputs[i].length;
+            f.outputs[i].length = 0;
+            f.outputs[i].uplinks = 0;
+        }
+        if (compression > 0) {
+            double behind = f.epoch_end / 1000.0 / compression - (seconds() - start);
+            if (behind > 0) {
+                usleep((useconds_t) (behind * 1e6));
+            }
+        }
+    }
+    double elapsed = seconds() - start;
+    workPoolDestroy(&pool);
+    if (NULL != capture && stdout != capture) {
+        fclose(capture);
+    }
+
+    double device_days = (double) devices * (f.epoch_end - EPOCH_MS) / DAY_MS;
+    fprintf(stderr, "%zu devices, %.0f days, %d threads, %lu steals: %llu uplinks (%.1f MB capture) in %.3f s\n",
+            devices, (double) (f.epoch_end - EPOCH_MS) / DAY_MS, threads, pool.steals, uplinks, bytes / 1e6, elapsed);
+    fprintf(stderr, "%.0f device-days/s, %.0f uplinks/s, %.0fx real time\n", device_days / elapsed, uplinks / elapsed,
+            (f.epoch_end - EPOCH_MS) / 1000.0 / elapsed);
+    return 0;
+}
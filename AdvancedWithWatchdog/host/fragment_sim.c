@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "airtime.h"
+#include "dutycycle.h"
+#include "adr.h"
+#include "uplink.h"
+#include "fragment.h"
+#include "sim_modem.h"
+#include "reassembler.h"
+
+#define TICK_MS 10
+#define LOG_ENTRIES 32                       // MAX_LOG_ENTRY, a full EEPROM log
+#define SIM_LIMIT_MS 86400000
+#define REBOOTS 2                            // dumps, each one after a reboot
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+static reassembler receiver;
+static uint32_t frames_sent;
+static uint32_t messages_done;
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**********************************************************************************************************************
+ * \brief: Passes commands to the simulated modem. The payload of every AT+CMSGHEX is handed to the reassembler as the
+ *         network server would, acknowledgements dropped by the modem make the server see a frame twice.
+ *
+ * \param: 1 param: modem command.
+ *
+ * \return: bytes sent
+ *
+ * \remarks: Frames lost on the air are not simulated, the modem is configured without loss.
+ **********************************************************************************************************************/
+static int traceSend(const char *command) {
+    const char *hex = strstr(command, "HEX=\"");
+    if (NULL != hex) {
+        uint8_t frame[UPLINK_PAYLOAD_MAX];
+        size_t length = 0;
+        for (hex += 5; hexValue(hex[0]) >= 0 && hexValue(hex[1]) >= 0 && length < sizeof(frame); hex += 2) {
+            frame[length++] = hexValue(hex[0]) << 4 | hexValue(hex[1]);
+        }
+        frames_sent++;
+        if (REASSEMBLY_COMPLETE == reassemblerFeed(&receiver, frame, length)) {
+            messages_done++;
+        }
+    }
+    return simModemIo()->send(command);
+}
+
+static int traceRead(uint8_t *buffer, int size) {
+    return simModemIo()->read(buffer, size);
+}
+
+static const modem_io trace_io = {.send = traceSend, .read = traceRead};
+
+/**********************************************************************************************************************
+ * \brief: Queues the fragments of a dump the way continueLogDump() does, leaving one place of the queue free, and runs
+ *         the modem until they are delivered.
+ *
+ * \param: 1 param: simulated time in ms, advanced.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void sendDump(uint32_t *now) {
+    uint8_t frame[UPLINK_PAYLOAD_MAX];
+
+    while ((true == fragmentBusy() || false == uplinkIdle()) && *now < SIM_LIMIT_MS) {
+        while (true == fragmentBusy() && uplinkQueueSpace() > 1) {
+            size_t length = fragmentNext(frame, uplinkMaxPayload());
+            if (length > 0) {
+                uplinkEnqueue(frame, length, UPLINK_CONFIRMED | UPLINK_BINARY, *now);
+            }
+        }
+        simModemTick(*now);
+        uplinkPoll(*now);
+        *now += TICK_MS;
+    }
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Sends a full EEPROM log dump in fragments through the uplink queue and the simulated modem, reassembles it
+ *         as the server would and checks it against the original. Prints the frames used against the fewest
+ *         possible and against one uplink per log message. Then reboots, seeding the message ids from the next boot
+ *         count, and sends the dump again to the same reassembler.
+ *
+ * \param: optional arguments: data rate (default DR0) and ACK drop percentage (default 20).
+ *
+ * \return: 0 if every dump arrived intact, 1 otherwise.
+ *
+ * \remarks: The reassembler drops fragments of the ids it completed last, a dump reusing an id after the reboot would
+ *           be lost.
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    int dr = argc > 1 ? atoi(argv[1]) : LORA_DEFAULT_DR;
+    sim_modem_config config = {.response_latency_ms = 20, .dr = dr, .joined = true,
+                               .ack_drop_percent = argc > 2 ? atoi(argv[2]) : 20};
+    char dump[FRAGMENT_MAX];
+    size_t dump_len = 0;
+    bool intact = true;
+    uint32_t fragments = 0;                  // of the first dump
+
+    simModemInit(&config, 12345);
+    uplinkInit(&trace_io, 67890);
+    uplinkSetDataRate(dr);
+    adrPin(dr);
+    dutyCycleReset(0);
+    reassemblerInit(&receiver);
+
+    for (int i = 0; i < LOG_ENTRIES; i++) {
+        int length = snprintf(&dump[dump_len], sizeof(dump) - dump_len,
+                              "Day %d: Pill %sdispensed. Number of pills left: %d.\n",
+                              i % 7 + 1, i % 5 ? "" : "not ", 6 - i % 7);
+        dump_len += length;
+    }
+
+    uint32_t now = 0;
+    for (uint32_t boots = 1; boots <= REBOOTS; boots++) {
+        fragmentSeed(boots);
+        fragmentBegin();
+        fragmentAppend((const uint8_t *) dump, dump_len);
+        fragmentSend();
+        sendDump(&now);
+
+        size_t received_len;
+        const uint8_t *received = reassemblerMessage(&receiver, &received_len);
+        intact = intact && boots == messages_done && received_len == dump_len &&
+                 0 == memcmp(received, dump, dump_len);
+        if (1 == boots) {
+            fragments = uplinkStatistics()->delivered;
+        }
+    }
+    size_t fewest = fragmentCount(dump_len, uplinkMaxPayload());
+
+    printf("log dump of %d messages, %zu bytes, at DR%d (%d byte payload), ACK drop %u %%\n", LOG_ENTRIES, dump_len,
+           dr, uplinkMaxPayload(), config.ack_drop_percent);
+    printf("fragments %u (fewest possible %zu), one uplink per message %d\n", fragments, fewest, LOG_ENTRIES);
+    printf("%d dumps with a reboot before each: frames on air %u, duplicates dropped %u\n", REBOOTS, frames_sent,
+           receiver.duplicates);
+    printf("reassembled %u of %d in %u s: %s\n", messages_done, REBOOTS, now / 1000, intact ? "intact" : "CORRUPT");
+    return intact ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim_modem.h"
+
+#define POLL_MS 2
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+static volatile sig_atomic_t running = 1;
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static void stop(int signal) {
+    running = 0;
+}
+
+static uint32_t monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-l latency_ms] [-j join_delay_ms] [-p loss_%%] [-a ack_drop_%%] [-g garble_%%]\n"
+                    "       [-w wake_ms] [-r dr] [-d] [-J] [-D downlink_hex] [-o airtime.csv] [-s seed]\n"
+                    "  -d  refuse uplinks with No band while the sub-bands are off (1 %% duty cycle)\n"
+                    "  -J  start with a network session\n", name);
+}
+
+/**********************************************************************************************************************
+ * \brief: Opens a pseudo-terminal in raw mode.
+ *
+ * \param: 1 param: pointer to the file descriptor of the slave side, kept open so that the master never sees a hang
+ *         up between clients.
+ *
+ * \return: file descriptor of the master side, -1 on error.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static int openPty(int *slave) {
+    struct termios tio;
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        return -1;
+    }
+    *slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (*slave < 0 || tcgetattr(*slave, &tio) < 0) {
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+    return master;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Runs the simulated LoRa-E5 on a pseudo-terminal in real time. Programs and serial terminals open the printed
+ *         device like the uart of the module, an airtime log records every frame put on the air.
+ *
+ * \param: options, see usage().
+ *
+ * \return: 0, 1 on error.
+ *
+ * \remarks: Stops on SIGINT or SIGTERM and prints the counters of the modem.
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    sim_modem_config config = {.response_latency_ms = 20, .dr = 0, .join_delay_ms = 5000};
+    uint32_t seed = 1;
+    const char *log_name = NULL;
+    char buffer[256];
+    int option, slave;
+
+    while ((option = getopt(argc, argv, "l:j:p:a:g:w:r:dJD:o:s:h")) != -1) {
+        switch (option) {
+            case 'l': config.response_latency_ms = strtoul(optarg, NULL, 10); break;
+            case 'j': config.join_delay_ms = strtoul(optarg, NULL, 10); break;
+            case 'p': config.loss_percent = atoi(optarg); break;
+            case 'a': config.ack_drop_percent = atoi(optarg); break;
+            case 'g': config.garble_percent = atoi(optarg); break;
+            case 'w': config.wake_latency_ms = strtoul(optarg, NULL, 10); break;
+            case 'r': config.dr = atoi(optarg); break;
+            case 'd': config.duty_cycle = true; break;
+            case 'J': config.joined = true; break;
+            case 'D': config.downlink = optarg; break;
+            case 'o': log_name = optarg; break;
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (NULL != log_name && NULL == (config.airtime_log = fopen(log_name, "w"))) {
+        perror(log_name);
+        return 1;
+    }
+
+    int master = openPty(&slave);
+    if (master < 0) {
+        perror("pty");
+        return 1;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    printf("LoRa-E5 simulator on %s\n", ptsname(master));
+    fflush(stdout);
+
+    uint32_t start = monotonicMs();
+    simModemInit(&config, seed);
+    while (running) {
+        struct pollfd pfd = {.fd = master, .events = POLLIN};
+        if (poll(&pfd, 1, POLL_MS) > 0 && (pfd.revents & POLLIN)) {
+            ssize_t count = read(master, buffer, sizeof(buffer));
+            if (count > 0) {
+                simModemReceive(buffer, count);
+            }
+        }
+        simModemTick(monotonicMs() - start);
+        int count = simModemTransmit((uint8_t *) buffer, sizeof(buffer));
+        if (count > 0 && write(master, buffer, count) < 0) {
+            perror("write");
+            break;
+        }
+    }
+
+    const sim_modem_stats *stats = simModemStatistics();
+    printf("\ncommands %u, joins %u, frames %u, lost %u, no band %u, garbled lines %u, airtime %llu ms\n",
+           stats->commands, stats->joins, stats->transmissions, stats->lost, stats->no_band, stats->garbled,
+           (unsigned long long) stats->airtime_us / 1000);
+    printf("sleeps %u, wakes %u, bytes dropped asleep %u, asleep %u s\n", stats->sleeps, stats->wakes, stats->dropped,
+           stats->asleep_ms / 1000);
+    if (NULL != config.airtime_log) {
+        fclose(config.airtime_log);
+    }
+    close(slave);
+    close(master);
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "airtime.h"
+#include "dutycycle.h"
+#include "adr.h"
+#include "uplink.h"
+#include "sim_modem.h"
+
+#define TICK_MS 10
+#define TRIALS 21                            // alert raised 0, 250, ... 5000 ms after the burst started
+#define TRIAL_STEP_MS 250
+#define SIM_LIMIT_MS 3600000
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+/* Routine chatter of a boot and a calibration, and the alert raised meanwhile */
+static const char *routine[] = {"Clean boot.",
+                                "Waiting for button to calibrate.",
+                                "Calibrated. Waiting for button to dispense pills.",
+                                "Booted after calibration. Waiting for button to dispense.",
+                                "Day 1: Pill dispensed. Number of pills left: 6.",
+                                "Day 2: Pill dispensed. Number of pills left: 5."};
+
+#define ROUTINE_COUNT  ( sizeof(routine) / sizeof(routine[0]) )
+
+static const char alert[] = "Day 3: Pill not dispensed. Number of pills left: 4.";
+
+static uint32_t now;
+static uint32_t alert_sent_ms;               // when the alert was first handed to the modem, 0 if not yet
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+/* Passes commands to the simulated modem and notes when the alert goes out */
+static int traceSend(const char *command) {
+    if (0 == alert_sent_ms && NULL != strstr(command, alert)) {
+        alert_sent_ms = now;
+    }
+    return simModemIo()->send(command);
+}
+
+static int traceRead(uint8_t *buffer, int size) {
+    return simModemIo()->read(buffer, size);
+}
+
+static const modem_io trace_io = {.send = traceSend, .read = traceRead};
+
+/**********************************************************************************************************************
+ * \brief: Queues a burst of routine messages, raises an alert after the given time and serves the queue until it is
+ *         empty.
+ *
+ * \param: 5 params: burst length, time of the alert in ms, flags of the alert, data rate and pointer to store the time
+ *         when the last uplink was delivered to.
+ *
+ * \return: event-to-air latency of the alert in ms: from the alert to its command reaching the modem.
+ *
+ * \remarks: The modem runs with a fixed response latency and acknowledges every uplink, so only the queueing differs.
+ **********************************************************************************************************************/
+static uint32_t runTrial(int burst, uint32_t alert_ms, uint8_t alert_flags, int dr, uint32_t *done_ms) {
+    sim_modem_config config = {.response_latency_ms = 20, .dr = dr, .joined = true};
+    bool raised = false;
+
+    simModemInit(&config, 12345);
+    uplinkInit(&trace_io, 67890);
+    uplinkSetDataRate(dr);
+    adrPin(dr);
+    dutyCycleReset(0);
+    now = 0;
+    alert_sent_ms = 0;
+
+    for (int i = 0; i < burst; i++) {
+        const char *message = routine[i % ROUTINE_COUNT];
+        uplinkEnqueue((const uint8_t *) message, strlen(message), 0, now);
+    }
+    while ((false == raised || false == uplinkIdle()) && now < SIM_LIMIT_MS) {
+        if (false == raised && now >= alert_ms) {
+            uplinkEnqueue((const uint8_t *) alert, strlen(alert), alert_flags, now);
+            raised = true;
+        }
+        simModemTick(now);
+        uplinkPoll(now);
+        now += TICK_MS;
+    }
+    *done_ms = now;
+    return alert_sent_ms - alert_ms;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Measures how long an alert waits behind a burst of routine messages, once queued first-come first-served
+ *         and once as UPLINK_ALERT. The alert is raised at TRIALS points in time during the burst.
+ *
+ * \param: optional arguments: number of routine messages in the burst (default 6) and data rate (default DR0, the
+ *         slowest, where the queueing hurts most).
+ *
+ * \return: 0
+ *
+ * \remarks: Routine messages are coalesced in both runs, the difference is the priority of the alert alone.
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    int burst = argc > 1 ? atoi(argv[1]) : 6;
+    int dr = argc > 2 ? atoi(argv[2]) : LORA_DEFAULT_DR;
+    const struct {
+        const char *name;
+        uint8_t flags;
+    } modes[] = {{"first come", UPLINK_CONFIRMED}, {"alert priority", UPLINK_CONFIRMED | UPLINK_ALERT}};
+
+    printf("%d routine messages at DR%d, alert raised 0 - %d ms after the burst\n", burst, dr,
+           (TRIALS - 1) * TRIAL_STEP_MS);
+    for (int m = 0; m < 2; m++) {
+        uint32_t total = 0, worst = 0, total_done = 0;
+        for (int t = 0; t < TRIALS; t++) {
+            uint32_t done;
+            uint32_t latency = runTrial(burst, t * TRIAL_STEP_MS, modes[m].flags, dr, &done);
+            total += latency;
+            total_done += done;
+            if (latency > worst) {
+                worst = latency;
+            }
+        }
+        const uplink_stats *stats = uplinkStatistics();
+        printf("%-15s alert event-to-air: average %5u ms, worst %5u ms | queue empty after %5u ms, "
+               "%u routine messages coalesced\n", modes[m].name, total / TRIALS, worst, total_done / TRIALS,
+               stats->coalesced);
+    }
+    return 0;
+}
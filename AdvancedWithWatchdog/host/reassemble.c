@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "reassembler.h"
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Reassembles the fragmented uplinks of the device, e.g. a log dump, from the payloads exported by the network
+ *         server. Every complete message is written to stdout.
+ *
+ * \param: reads one hex encoded uplink payload per line from stdin, lines that are not fragments are skipped.
+ *
+ * \return: 0 if every message was completed, 1 if fragments are missing.
+ *
+ * \remarks: The frames may come in any order and more than once.
+ **********************************************************************************************************************/
+int main(void) {
+    static reassembler r;
+    char line[2 * UPLINK_PAYLOAD_MAX + 16];
+    int incomplete = 0;
+
+    reassemblerInit(&r);
+    while (NULL != fgets(line, sizeof(line), stdin)) {
+        uint8_t frame[UPLINK_PAYLOAD_MAX];
+        size_t length = 0;
+        unsigned int byte;
+        for (const char *hex = line; isxdigit((unsigned char) hex[0]) && length < sizeof(frame); hex += 2) {
+            if (1 != sscanf(hex, "%2x", &byte)) {
+                break;
+            }
+            frame[length++] = byte;
+        }
+        if (REASSEMBLY_COMPLETE == reassemblerFeed(&r, frame, length)) {
+            size_t message_len;
+            const uint8_t *message = reassemblerMessage(&r, &message_len);
+            fwrite(message, 1, message_len, stdout);
+        }
+    }
+    for (int i = 0; i < REASSEMBLY_SLOTS; i++) {
+        if (true == r.slot[i].used) {
+            fprintf(stderr, "message %u incomplete: %d fragments received\n", r.slot[i].id, r.slot[i].received);
+            incomplete++;
+        }
+    }
+    return incomplete || r.abandoned ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include <string.h>
+#include "reassembler.h"
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Finds the slot collecting the given message id, or takes a free one, or the one that got no fragment for
+ *         the longest time.
+ *
+ * \param: 2 params: pointer to the reassembler and message id.
+ *
+ * \return: pointer to the slot
+ *
+ * \remarks: An incomplete message pushed out is counted as abandoned.
+ **********************************************************************************************************************/
+static reassembly_slot *slotFor(reassembler *r, uint8_t id) {
+    reassembly_slot *oldest = &r->slot[0];
+
+    for (int i = 0; i < REASSEMBLY_SLOTS; i++) {
+        if (true == r->slot[i].used && id == r->slot[i].id) {
+            return &r->slot[i];
+        }
+    }
+    for (int i = 0; i < REASSEMBLY_SLOTS; i++) {
+        if (false == r->slot[i].used) {
+            oldest = &r->slot[i];
+            break;
+        }
+        if ((int32_t) (r->slot[i].age - oldest->age) < 0) {
+            oldest = &r->slot[i];
+        }
+    }
+    if (true == oldest->used) {
+        r->abandoned++;
+    }
+    memset(oldest, 0, sizeof(*oldest));
+    oldest->used = true;
+    oldest->id = id;
+    oldest->last = -1;
+    return oldest;
+}
+
+/**********************************************************************************************************************
+ * \brief: Empties the reassembler.
+ *
+ * \param: 1 param: pointer to the reassembler.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void reassemblerInit(reassembler *r) {
+    memset(r, 0, sizeof(*r));
+}
+
+/**********************************************************************************************************************
+ * \brief: Takes one uplink frame built by fragmentNext(). The fragments of a message may arrive in any order and more
+ *         than once, the message is complete when the last fragment and all before it have arrived.
+ *
+ * \param: 3 params: pointer to the reassembler, the uplink payload and its length.
+ *
+ * \return: REASSEMBLY_COMPLETE when the frame completed a message, REASSEMBLY_PENDING or REASSEMBLY_INVALID
+ *
+ * \remarks: The completed message stays available with reassemblerMessage() until the next complete one. Fragments of
+ *           the last REASSEMBLY_SLOTS completed messages are counted as duplicates.
+ **********************************************************************************************************************/
+enum ReassemblyResult reassemblerFeed(reassembler *r, const uint8_t *frame, size_t length) {
+    if (length < FRAGMENT_HEADER_LEN || FRAGMENT_TAG != frame[0] ||
+        length - FRAGMENT_HEADER_LEN > REASSEMBLY_FRAME_DATA) {
+        return REASSEMBLY_INVALID;
+    }
+    int index = frame[2] & FRAGMENT_INDEX_MASK;
+    for (int i = 0; i < r->completed_count && i < REASSEMBLY_SLOTS; i++) {
+        if (frame[1] == r->completed[i]) {
+            r->duplicates++;
+            return REASSEMBLY_PENDING;
+        }
+    }
+    reassembly_slot *slot = slotFor(r, frame[1]);
+
+    slot->age = ++r->arrivals;
+    if (true == slot->have[index]) {
+        r->duplicates++;
+        return REASSEMBLY_PENDING;
+    }
+    slot->have[index] = true;
+    slot->length[index] = length - FRAGMENT_HEADER_LEN;
+    memcpy(slot->data[index], &frame[FRAGMENT_HEADER_LEN], slot->length[index]);
+    slot->received++;
+    if (frame[2] & FRAGMENT_LAST) {
+        slot->last = index;
+    }
+    if (slot->last < 0 || slot->received != slot->last + 1) {
+        return REASSEMBLY_PENDING;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i <= slot->last; i++) {
+        total += slot->length[i];
+    }
+    slot->used = false;
+    r->completed[r->completed_count++ % REASSEMBLY_SLOTS] = slot->id;
+    if (total > FRAGMENT_MAX) {
+        return REASSEMBLY_INVALID;
+    }
+    r->message_len = 0;
+    for (int i = 0; i <= slot->last; i++) {
+        memcpy(&r->message[r->message_len], slot->data[i], slot->length[i]);
+        r->message_len += slot->length[i];
+    }
+    return REASSEMBLY_COMPLETE;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the message completed last.
+ *
+ * \param: 2 params: pointer to the reassembler and pointer to store the message length to.
+ *
+ * \return: pointer to the message
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const uint8_t *reassemblerMessage(const reassembler *r, size_t *length) {
+    *length = r->message_len;
+    return r->message;
+}
@@ -0,0 +1,46 @@
+#ifndef REASSEMBLER
+#define REASSEMBLER
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "fragment.h"
+#include "uplink.h"
+
+#define REASSEMBLY_SLOTS 4                   // messages collected at the same time
+#define REASSEMBLY_FRAMES ( FRAGMENT_INDEX_MASK + 1 )
+#define REASSEMBLY_FRAME_DATA ( UPLINK_PAYLOAD_MAX - FRAGMENT_HEADER_LEN )
+
+enum ReassemblyResult {
+    REASSEMBLY_INVALID = -1,                 // not a fragment frame
+    REASSEMBLY_PENDING = 0,                  // stored, fragments are missing
+    REASSEMBLY_COMPLETE = 1                  // message ready, see reassemblerMessage()
+};
+
+typedef struct reassembly_slot_ {
+    bool used;
+    uint8_t id;
+    int last;                                // index of the last fragment, -1 until it arrived
+    int received;                            // distinct fragments
+    uint32_t age;                            // arrival order of the latest fragment, the oldest slot is reused
+    bool have[REASSEMBLY_FRAMES];
+    uint8_t length[REASSEMBLY_FRAMES];
+    uint8_t data[REASSEMBLY_FRAMES][REASSEMBLY_FRAME_DATA];
+} reassembly_slot;
+
+typedef struct reassembler_ {
+    reassembly_slot slot[REASSEMBLY_SLOTS];
+    uint32_t arrivals;
+    uint32_t duplicates;                     // fragments received again, e.g. after a lost acknowledgement
+    uint32_t abandoned;                      // incomplete messages pushed out by newer ones
+    uint8_t completed[REASSEMBLY_SLOTS];     // ids of the messages completed last, their late fragments are dropped
+    int completed_count;
+    uint8_t message[FRAGMENT_MAX];
+    size_t message_len;
+} reassembler;
+
+void reassemblerInit(reassembler *r);
+enum ReassemblyResult reassemblerFeed(reassembler *r, const uint8_t *frame, size_t length);
+const uint8_t *reassemblerMessage(const reassembler *r, size_t *length);
+
+#endif
@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "ring_buffer.h"
+
+#define BENCH_BYTES 100000000UL              // bytes through the buffer per measurement
+#define STRESS_BYTES 4000000UL               // bytes through the buffer per stress run
+#define BURST 16                             // bytes put per interrupt, about one uart FIFO
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+/* The ring buffer before the SPSC rewrite: int indices, a modulo per operation, one slot unused, no barriers */
+typedef struct legacy_ring_ {
+    int head;
+    int tail;
+    int size;
+    uint8_t *buffer;
+} legacy_ring;
+
+/* How the stress threads move the bytes */
+enum StressMode {
+    STRESS_BYTES_GET,                        // rb_put() and rb_get()
+    STRESS_PEEK_DROP,                        // rb_put(), rb_peek() and rb_drop()
+    STRESS_BULK                              // rb_write() and rb_read() in chunks of varying length
+};
+
+typedef struct stress_ {
+    ring_buffer rb;
+    unsigned long bytes;
+    unsigned long errors;
+    unsigned long producer_full;
+    unsigned long consumer_empty;
+    enum StressMode mode;
+} stress;
+
+static const char *mode_names[] = {"get      ", "peek/drop", "bulk     "};
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* legacy rb_put() */
+static __attribute__((noinline)) bool legacyPut(legacy_ring *rb, uint8_t data) {
+    int nh = (rb->head + 1) % rb->size;
+    if (nh == rb->tail) return false;
+    rb->buffer[rb->head] = data;
+    rb->head = nh;
+    return true;
+}
+
+/* legacy rb_get() */
+static __attribute__((noinline)) uint8_t legacyGet(legacy_ring *rb) {
+    uint8_t value = rb->buffer[rb->tail];
+    if (rb->head != rb->tail) {
+        rb->tail = (rb->tail + 1) % rb->size;
+    }
+    return value;
+}
+
+/* legacy rb_empty() */
+static __attribute__((noinline)) bool legacyEmpty(legacy_ring *rb) {
+    return rb->head == rb->tail;
+}
+
+/* Byte number i of the stress pattern, not periodic in any power of two up to 2^16 */
+static inline uint8_t pattern(unsigned long i) {
+    return (uint8_t) (i * 31 + (i >> 8) * 7 + (i >> 16));
+}
+
+/**********************************************************************************************************************
+ * \brief: Measures the interrupt pattern of the firmware on one thread: a burst of BURST bytes is put, then the main
+ *         loop takes everything that is waiting.
+ *
+ * \param: 1 param: buffer size.
+ *
+ * \return:
+ *
+ * \remarks: Prints ns per byte for the legacy and the SPSC ring.
+ **********************************************************************************************************************/
+static void benchSingle(int size) {
+    static uint8_t storage[4096];
+    unsigned int sum = 0;
+    legacy_ring legacy = {0, 0, size, storage};
+    ring_buffer rb;
+    double start;
+
+    start = seconds();
+    for (unsigned long i = 0; i < BENCH_BYTES; i += BURST) {
+        for (int j = 0; j < BURST; j++) {
+            legacyPut(&legacy, (uint8_t) (i + j));
+        }
+        while (false == legacyEmpty(&legacy)) {
+            sum += legacyGet(&legacy);
+        }
+    }
+    double legacy_ns = (seconds() - start) * 1e9 / BENCH_BYTES;
+
+    rb_init(&rb, storage, size);
+    start = seconds();
+    for (unsigned long i = 0; i < BENCH_BYTES; i += BURST) {
+        for (int j = 0; j < BURST; j++) {
+            rb_put(&rb, (uint8_t) (i + j));
+        }
+        while (false == rb_empty(&rb)) {
+            sum -= rb_get(&rb);
+        }
+    }
+    double spsc_ns = (seconds() - start) * 1e9 / BENCH_BYTES;
+
+    printf("  size %4d, bursts of %d: legacy %.2f ns/byte, spsc %.2f ns/byte, %.2fx%s\n", size, BURST, legacy_ns,
+           spsc_ns, legacy_ns / spsc_ns, 0 != sum ? " (checksum mismatch)" : "");
+}
+
+/**********************************************************************************************************************
+ * \brief: Measures moving whole messages through the ring, the way uart_write() and uart_read() do: byte by byte with
+ *         a full or empty check per byte, against rb_write() and rb_read() with one copy per span.
+ *
+ * \param: 1 param: message length.
+ *
+ * \return:
+ *
+ * \remarks: Prints ns per byte of both.
+ **********************************************************************************************************************/
+static void benchBulk(int length) {
+    static uint8_t storage[256];
+    uint8_t message[256], received[256];
+    unsigned long rounds = BENCH_BYTES / length;
+    ring_buffer rb;
+    double start;
+    int errors = 0;
+
+    for (int i = 0; i < length; i++) {
+        message[i] = pattern(i);
+    }
+
+    rb_init(&rb, storage, sizeof(storage));
+    rb.head = rb.tail = 0xFFFFFF00u;
+    start = seconds();
+    for (unsigned long r = 0; r < rounds; r++) {
+        int count = 0;
+        while (count < length && !rb_full(&rb)) {
+            rb_put(&rb, message[count++]);
+        }
+        count = 0;
+        while (count < length && !rb_empty(&rb)) {
+            received[count++] = rb_get(&rb);
+        }
+        errors += count != length;
+    }
+    double bytes_ns = (seconds() - start) * 1e9 / (rounds * length);
+
+    start = seconds();
+    for (unsigned long r = 0; r < rounds; r++) {
+        rb_write(&rb, message, length);
+        errors += length != rb_read(&rb, received, length);
+    }
+    double bulk_ns = (seconds() - start) * 1e9 / (rounds * length);
+    errors += 0 != memcmp(message, received, length);
+
+    printf("  %3d byte messages: per byte %.2f ns/byte, spans %.2f ns/byte, %.1fx%s\n", length, bytes_ns, bulk_ns,
+           bytes_ns / bulk_ns, 0 != errors ? " (data mismatch)" : "");
+}
+
+/* Stress producer: puts the pattern as fast as the buffer takes it */
+static void *produce(void *argument) {
+    stress *s = argument;
+    uint8_t chunk[97];
+
+    if (STRESS_BULK == s->mode) {
+        for (unsigned long i = 0; i < s->bytes;) {
+            int length = 1 + i % sizeof(chunk);
+            length = length < s->bytes - i ? length : s->bytes - i;
+            for (int j = 0; j < length; j++) {
+                chunk[j] = pattern(i + j);
+            }
+            for (int put = 0; put < length;) {
+                int count = rb_write(&s->rb, &chunk[put], length - put);
+                if (0 == count) {
+                    s->producer_full++;
+                    sched_yield();
+                }
+                put += count;
+            }
+            i += length;
+        }
+        return NULL;
+    }
+    for (unsigned long i = 0; i < s->bytes; i++) {
+        while (false == rb_put(&s->rb, pattern(i))) {
+            s->producer_full++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* Stress consumer: takes the bytes one at a time or in bulk and checks them against the pattern */
+static void *consume(void *argument) {
+    stress *s = argument;
+    unsigned long i = 0;
+    uint8_t chunk[61];
+
+    while (i < s->bytes) {
+        if (STRESS_BULK == s->mode) {
+            int count = rb_read(&s->rb, chunk, 1 + i % sizeof(chunk));
+            if (0 == count) {
+                s->consumer_empty++;
+                sched_yield();
+            }
+            for (int j = 0; j < count; j++, i++) {
+                s->errors += pattern(i) != chunk[j];
+            }
+            continue;
+        }
+        int waiting = rb_count(&s->rb);
+        if (0 == waiting) {
+            s->consumer_empty++;
+            sched_yield();
+            continue;
+        }
+        if (waiting > s->rb.size) {
+            s->errors++;
+        }
+        if (STRESS_PEEK_DROP == s->mode) {
+            for (int j = 0; j < waiting; j++) {
+                s->errors += pattern(i + j) != rb_peek(&s->rb, j);
+            }
+            rb_drop(&s->rb, waiting);
+            i += waiting;
+        } else {
+            for (int j = 0; j < waiting; j++, i++) {
+                s->errors += pattern(i) != rb_get(&s->rb);
+            }
+        }
+    }
+    s->errors += 0 != rb_count(&s->rb);
+    return NULL;
+}
+
+/**********************************************************************************************************************
+ * \brief: Runs a producer and a consumer thread on one ring buffer and checks every byte. Small buffers make the two
+ *         sides meet at the full and empty edges all the time.
+ *
+ * \param: 3 params: buffer size, how the bytes are moved, and the start of the indices.
+ *
+ * \return: number of errors
+ *
+ * \remarks: Starting the indices just below 2^32 runs the test across the wrap of the free running indices.
+ **********************************************************************************************************************/
+static unsigned long stressRun(int size, enum StressMode mode, uint32_t start_index) {
+    static uint8_t storage[4096];
+    stress s = {.bytes = STRESS_BYTES, .mode = mode};
+    pthread_t producer, consumer;
+
+    rb_init(&s.rb, storage, size);
+    s.rb.head = s.rb.tail = start_index;
+    double start = seconds();
+    pthread_create(&consumer, NULL, consume, &s);
+    pthread_create(&producer, NULL, produce, &s);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    double elapsed = seconds() - start;
+
+    printf("  size %4d, %s, start %10u: %lu errors, %.1f MB/s, producer found it full %lu, consumer empty %lu\n",
+           size, mode_names[mode], start_index, s.errors, s.bytes / elapsed / 1e6,
+           s.producer_full, s.consumer_empty);
+    return s.errors;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Stress test and benchmark of the SPSC ring buffer of the uart driver.
+ *
+ * \param:
+ *
+ * \return: 0 if every byte arrived intact and in order, 1 otherwise.
+ *
+ * \remarks: The stress test needs at least two cores to hit real races, on one core the threads only interleave at
+ *           preemption points.
+ **********************************************************************************************************************/
+int main(void) {
+    static const int sizes[] = {2, 16, 256, 4096};
+    static const int messages[] = {4, 16, 64, 200};
+    unsigned long errors = 0;
+    ring_buffer rb;
+    uint8_t small[4];
+
+    rb_init(&rb, small, 4);
+    errors += 4 != rb.size;
+    errors += 0 != rb_get(&rb);
+    for (int i = 0; i < 4; i++) {
+        errors += true != rb_put(&rb, 0xA0 + i);
+    }
+    errors += false != rb_put(&rb, 0xFF) || true != rb_full(&rb) || 4 != rb_count(&rb);
+    errors += 0xA0 != rb_get(&rb) || 0xA2 != rb_peek(&rb, 1);
+    rb_drop(&rb, 10);
+    errors += true != rb_empty(&rb) || 0 != rb_get(&rb);
+    printf("edge cases: %lu errors\n", errors);
+
+    printf("stress, producer and consumer threads:\n");
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        errors += stressRun(sizes[i], STRESS_BYTES_GET, 0);
+        errors += stressRun(sizes[i], STRESS_PEEK_DROP, 0xFFFFFFFFu - STRESS_BYTES / 2);
+        errors += stressRun(sizes[i], STRESS_BULK, 0xFFFFFFFFu - STRESS_BYTES / 3);
+    }
+
+    printf("benchmark, one thread:\n");
+    for (int i = 2; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        benchSingle(sizes[i]);
+    }
+    printf("benchmark, uart_write() and uart_read() of whole messages through 256 bytes:\n");
+    for (int i = 0; i < sizeof(messages) / sizeof(messages[0]); i++) {
+        benchBulk(messages[i]);
+    }
+    printf("%s\n", 0 == errors ? "PASS" : "FAIL");
+    return 0 == errors ? 0 : 1;
+}
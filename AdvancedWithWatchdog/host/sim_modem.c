@@ -0,0 +1,528 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_modem.h"
+#include "airtime.h"
+#include "downlink.h"
+
+#define JOIN_REQUEST_LEN 23                  // PHY payload of a join request
+#define RX_DELAY_MS 1000                     // RECEIVE_DELAY1
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+typedef struct sim_line_ {
+    uint32_t due_ms;
+    char text[SIM_LINE_LEN];
+} sim_line;
+
+static sim_modem_config config;
+static sim_modem_stats stats;
+static uint32_t now;
+static uint32_t random_state = 1;
+
+static char command[2 * SIM_LINE_LEN];
+static int command_len;
+
+static sim_line output[SIM_OUTPUT_LINES];
+static int output_head, output_count, output_pos;
+
+/* Modem settings, answered by the queries of the lorawan[] table */
+static bool joined;
+static char mode[16];
+static char appkey[40];
+static char device_class;
+static int port;
+static bool adr;
+static uint32_t band_free_ms[SIM_BANDS];
+
+/* AT+LOWPOWER: asleep until bytes arrive, awake again when +LOWPOWER: WAKEUP is sent */
+static bool asleep;
+static bool waking;
+static uint32_t sleep_ms;
+static uint32_t wake_ms;
+
+static int simSend(const char *data);
+static int simRead(uint8_t *buffer, int size);
+static const modem_io sim_io = {.send = simSend, .read = simRead};
+
+/////////////////////////////////////////////////////
+//                  SIMULATED MODEM                //
+/////////////////////////////////////////////////////
+
+static uint32_t nextRandom() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static bool chance(uint8_t percent) {
+    return nextRandom() % 100 < percent;
+}
+
+/**********************************************************************************************************************
+ * \brief: Queues one response line to be sent to the host at the given time. A share of the lines is garbled: a
+ *         character is corrupted or the line is cut short, as seen on a noisy uart.
+ *
+ * \param: 2 params: time in ms when the line is due and the line without line ending.
+ *
+ * \return:
+ *
+ * \remarks: Lines are sent in the order they were queued, a late line holds back the ones after it like a uart does.
+ **********************************************************************************************************************/
+static void respond(uint32_t due_ms, const char *text) {
+    char garbled[SIM_LINE_LEN];
+
+    if (output_count == SIM_OUTPUT_LINES) {
+        return;
+    }
+    snprintf(garbled, sizeof(garbled), "%.*s", SIM_LINE_LEN - 3, text);
+    if (garbled[0] != '\0' && chance(config.garble_percent)) {
+        size_t position = nextRandom() % strlen(garbled);
+        if (nextRandom() % 2) {
+            garbled[position] = '\0';
+        } else {
+            garbled[position] ^= 0x01;
+        }
+        stats.garbled++;
+    }
+
+    sim_line *line = &output[(output_head + output_count) % SIM_OUTPUT_LINES];
+    line->due_ms = due_ms;
+    snprintf(line->text, SIM_LINE_LEN, "%.*s\r\n", SIM_LINE_LEN - 3, garbled);
+    output_count++;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the time until a sub-band may transmit again.
+ *
+ * \param: 1 param: time in ms when the transmission would start.
+ *
+ * \return: 0 if a sub-band is free, otherwise the wait in ms.
+ *
+ * \remarks: Always 0 when the duty cycle is not simulated.
+ **********************************************************************************************************************/
+static uint32_t bandDelay(uint32_t start_ms) {
+    uint32_t delay = UINT32_MAX;
+
+    if (false == config.duty_cycle) {
+        return 0;
+    }
+    for (int i = 0; i < SIM_BANDS; i++) {
+        uint32_t wait = (int32_t) (band_free_ms[i] - start_ms) > 0 ? band_free_ms[i] - start_ms : 0;
+        if (wait < delay) {
+            delay = wait;
+        }
+    }
+    return delay;
+}
+
+/**********************************************************************************************************************
+ * \brief: Puts a frame on the air: takes a free sub-band off for its off-time, updates the statistics and writes a
+ *         line to the airtime log.
+ *
+ * \param: 4 params: frame type for the log, start time in ms, airtime in us and whether the frame is lost.
+ *
+ * \return:
+ *
+ * \remarks: The sub-band is free again airtime * 1000 / permille after the start of the frame, the same off-time rule
+ *           the modem applies.
+ **********************************************************************************************************************/
+static void transmit(const char *frame, uint32_t start_ms, uint32_t airtime_us, bool lost) {
+    for (int i = 0; i < SIM_BANDS; i++) {
+        if ((int32_t) (band_free_ms[i] - start_ms) <= 0) {
+            band_free_ms[i] = start_ms + (uint32_t) ((uint64_t) airtime_us * (1000 / SIM_DUTY_CYCLE_PERMILLE) / 1000);
+            break;
+        }
+    }
+    stats.transmissions++;
+    stats.airtime_us += airtime_us;
+    if (lost) {
+        stats.lost++;
+    }
+    if (NULL != config.airtime_log) {
+        fprintf(config.airtime_log, "%u,%s,%d,%u,%s\n", start_ms, frame, config.dr, airtime_us,
+                lost ? "lost" : "sent");
+        fflush(config.airtime_log);
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Answers an uplink command: AT+MSG, AT+CMSG, AT+MSGHEX or AT+CMSGHEX. Confirmed uplinks are acknowledged in
+ *         the first receive window unless the uplink is lost or the acknowledgement is dropped.
+ *
+ * \param: 3 params: response tag (MSG, CMSG, MSGHEX or CMSGHEX), quoted payload argument and its length.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void uplinkCommand(const char *tag, const char *argument, size_t length) {
+    char line[SIM_LINE_LEN];
+    bool confirmed = 'C' == tag[0];
+    bool hex = strstr(tag, "HEX") != NULL;
+    size_t payload = length >= 2 ? length - 2 : 0;
+    uint32_t start = now + config.response_latency_ms;
+
+    if (hex) {
+        payload /= 2;
+    }
+    if (false == joined) {
+        snprintf(line, sizeof(line), "+%s: Please join network first", tag);
+        respond(start, line);
+        return;
+    }
+    if (payload > dataRate(config.dr)->max_payload) {
+        snprintf(line, sizeof(line), "+%s: Length error %zu", tag, payload);
+        respond(start, line);
+        return;
+    }
+    uint32_t delay = bandDelay(start);
+    if (delay > 0) {
+        snprintf(line, sizeof(line), "+%s: No band in %ums", tag, delay);
+        respond(start, line);
+        stats.no_band++;
+        return;
+    }
+
+    uint32_t airtime = uplinkAirtimeUs(config.dr, payload);
+    uint32_t tx_end = start + airtime / 1000;
+    bool lost = chance(config.loss_percent);
+    transmit(confirmed ? "confirmed" : "unconfirmed", start, airtime, lost);
+
+    snprintf(line, sizeof(line), "+%s: Start", tag);
+    respond(start, line);
+    if (confirmed) {
+        snprintf(line, sizeof(line), "+%s: Wait ACK", tag);
+        respond(start, line);
+        if (false == lost && false == chance(config.ack_drop_percent)) {
+            snprintf(line, sizeof(line), "+%s: ACK Received", tag);
+            respond(tx_end + RX_DELAY_MS, line);
+            if (NULL != config.downlink) {
+                snprintf(line, sizeof(line), "+%s: PORT: %d; RX: \"%s\"", tag, DOWNLINK_PORT, config.downlink);
+                respond(tx_end + RX_DELAY_MS, line);
+                config.downlink = NULL;
+            }
+            snprintf(line, sizeof(line), "+%s: RXWIN1, RSSI -%u, SNR %u.0", tag, 60 + nextRandom() % 50,
+                     nextRandom() % 10);
+            respond(tx_end + RX_DELAY_MS, line);
+        }
+    }
+    snprintf(line, sizeof(line), "+%s: Done", tag);
+    respond(tx_end + 2 * RX_DELAY_MS, line);
+}
+
+/**********************************************************************************************************************
+ * \brief: Answers AT+JOIN and AT+JOIN=FORCE. The join request may be lost, then the modem reports a failed join.
+ *
+ * \param: 1 param: true for AT+JOIN=FORCE.
+ *
+ * \return:
+ *
+ * \remarks: A session is kept until a forced join, like the module keeps it in its flash.
+ **********************************************************************************************************************/
+static void joinCommand(bool force) {
+    char line[SIM_LINE_LEN];
+    uint32_t start = now + config.response_latency_ms;
+
+    if (true == joined && false == force) {
+        respond(start, "+JOIN: Joined already");
+        return;
+    }
+    uint32_t delay = bandDelay(start);
+    if (delay > 0) {
+        snprintf(line, sizeof(line), "+JOIN: No band in %ums", delay);
+        respond(start, line);
+        stats.no_band++;
+        return;
+    }
+
+    const data_rate *rate = dataRate(config.dr);
+    uint32_t airtime = airtimeUs(rate->sf, rate->bandwidth, JOIN_REQUEST_LEN);
+    bool lost = chance(config.loss_percent);
+    transmit("join", start, airtime, lost);
+    joined = false;
+
+    respond(start, "+JOIN: Start");
+    respond(start, force ? "+JOIN: FORCE" : "+JOIN: NORMAL");
+    uint32_t result = start + airtime / 1000 + config.join_delay_ms;
+    if (lost) {
+        respond(result, "+JOIN: Join failed");
+    } else {
+        respond(result, "+JOIN: Network joined");
+        snprintf(line, sizeof(line), "+JOIN: NetID 000013 DevAddr 26:0B:%02X:%02X", nextRandom() % 256,
+                 nextRandom() % 256);
+        respond(result, line);
+        joined = true;
+        stats.joins++;
+    }
+    respond(result, "+JOIN: Done");
+}
+
+/**********************************************************************************************************************
+ * \brief: Answers a setting command or its query: MODE, CLASS, PORT and ADR keep the value set, KEY=APPKEY is
+ *         echoed back but cannot be queried.
+ *
+ * \param: 2 params: setting name and the argument, NULL for a query.
+ *
+ * \return: true if the setting is known, false otherwise
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static bool settingCommand(const char *name, const char *argument) {
+    char line[SIM_LINE_LEN];
+
+    if (0 == strcmp(name, "MODE")) {
+        if (NULL != argument) {
+            snprintf(mode, sizeof(mode), "%s", argument);
+        }
+        snprintf(line, sizeof(line), "+MODE: %s", mode);
+    } else if (0 == strcmp(name, "CLASS")) {
+        if (NULL != argument) {
+            device_class = argument[0];
+        }
+        snprintf(line, sizeof(line), "+CLASS: %c", device_class);
+    } else if (0 == strcmp(name, "PORT")) {
+        if (NULL != argument) {
+            port = atoi(argument);
+        }
+        snprintf(line, sizeof(line), "+PORT: %d", port);
+    } else if (0 == strcmp(name, "ADR")) {
+        if (NULL != argument) {
+            adr = 0 == strcmp(argument, "ON");
+        }
+        snprintf(line, sizeof(line), "+ADR: %s", adr ? "ON" : "OFF");
+    } else if (0 == strcmp(name, "KEY") && NULL != argument && 0 == strncmp(argument, "APPKEY,", 7)) {
+        snprintf(appkey, sizeof(appkey), "%.*s", (int) strcspn(&argument[8], "\""), &argument[8]);
+        snprintf(line, sizeof(line), "+KEY: APPKEY %s", appkey);
+    } else {
+        return false;
+    }
+    respond(now + config.response_latency_ms, line);
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Wakes the modem up once the wake latency has passed.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void wakeCheck() {
+    if (true == waking && (int32_t) (now - wake_ms) >= 0) {
+        asleep = waking = false;
+        stats.wakes++;
+        stats.asleep_ms += wake_ms - sleep_ms;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Executes one complete command line received from the host.
+ *
+ * \param: 1 param: command without line ending.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void execute(const char *line) {
+    static const char *uplink_tags[] = {"CMSGHEX", "MSGHEX", "CMSG", "MSG"};
+    char name[SIM_LINE_LEN];
+    const char *argument = strchr(line, '=');
+    size_t name_len = argument ? (size_t) (argument - line) : strlen(line);
+
+    stats.commands++;
+    if (0 == strcmp(line, "AT")) {
+        respond(now + config.response_latency_ms, "+AT: OK");
+        return;
+    }
+    if (name_len <= 3 || 0 != strncmp(line, "AT+", 3)) {
+        respond(now + config.response_latency_ms, "ERROR(-1)");
+        return;
+    }
+    snprintf(name, sizeof(name), "%.*s", (int) (name_len - 3), &line[3]);
+    if (NULL != argument) {
+        argument++;
+    }
+
+    if (0 == strcmp(name, "DR")) {
+        char response[SIM_LINE_LEN];
+        int dr = NULL == argument ? config.dr : atoi(&argument['D' == argument[0] ? 2 : 0]);
+        if (dr >= 0 && dr < LORA_DR_COUNT) {
+            config.dr = dr;
+            snprintf(response, sizeof(response), "+DR: DR%d", dr);
+        } else {
+            snprintf(response, sizeof(response), "+DR: ERROR(-1)");
+        }
+        respond(now + config.response_latency_ms, response);
+        return;
+    }
+    if (0 == strcmp(name, "LOWPOWER") && NULL == argument) {
+        respond(now + config.response_latency_ms, "+LOWPOWER: SLEEP");
+        asleep = true;
+        sleep_ms = now + config.response_latency_ms;
+        stats.sleeps++;
+        return;
+    }
+    if (0 == strcmp(name, "JOIN")) {
+        joinCommand(NULL != argument && 0 == strcmp(argument, "FORCE"));
+        return;
+    }
+    if (true == settingCommand(name, argument)) {
+        return;
+    }
+    for (int i = 0; i < sizeof(uplink_tags) / sizeof(uplink_tags[0]); i++) {
+        if (0 == strcmp(name, uplink_tags[i]) && NULL != argument) {
+            uplinkCommand(uplink_tags[i], argument, strlen(argument));
+            return;
+        }
+    }
+    char response[SIM_LINE_LEN];
+    snprintf(response, sizeof(response), "+%.*s: ERROR(-1)", SIM_LINE_LEN - 16, name);
+    respond(now + config.response_latency_ms, response);
+}
+
+/**********************************************************************************************************************
+ * \brief: Resets the simulated modem. Settings return to the factory values, the session is kept if the
+ *         configuration says so.
+ *
+ * \param: 2 params: pointer to the configuration and random seed.
+ *
+ * \return:
+ *
+ * \remarks: Writes the header of the airtime log.
+ **********************************************************************************************************************/
+void simModemInit(const sim_modem_config *cfg, uint32_t seed) {
+    config = *cfg;
+    random_state = seed ? seed : 1;
+    now = 0;
+    command_len = 0;
+    output_head = output_count = output_pos = 0;
+    memset(&stats, 0, sizeof(stats));
+    memset(band_free_ms, 0, sizeof(band_free_ms));
+    asleep = waking = false;
+
+    joined = config.joined;
+    snprintf(mode, sizeof(mode), "LWABP");
+    appkey[0] = '\0';
+    device_class = 'A';
+    port = 8;
+    adr = true;
+
+    if (NULL != config.airtime_log) {
+        fprintf(config.airtime_log, "time_ms,frame,dr,airtime_us,result\n");
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Advances the simulated clock.
+ *
+ * \param: 1 param: current time in ms.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void simModemTick(uint32_t now_ms) {
+    now = now_ms;
+    wakeCheck();
+}
+
+/**********************************************************************************************************************
+ * \brief: Feeds bytes from the host to the modem. Commands are executed when their line ending arrives.
+ *
+ * \param: 2 params: pointer to the data and its length.
+ *
+ * \return:
+ *
+ * \remarks: A sleeping modem drops the bytes, the first one starts the wake up. 0xFF before a command is ignored, it
+ *           is what hosts send to wake the modem.
+ **********************************************************************************************************************/
+void simModemReceive(const char *data, size_t length) {
+    wakeCheck();
+    for (size_t i = 0; i < length; i++) {
+        if (true == asleep) {
+            if (false == waking) {
+                waking = true;
+                wake_ms = now + config.wake_latency_ms;
+                respond(wake_ms, "+LOWPOWER: WAKEUP");
+            }
+            stats.dropped++;
+        } else if ('\xFF' == data[i] && 0 == command_len) {
+            continue;
+        } else if ('\n' == data[i]) {
+            if (command_len > 0 && '\r' == command[command_len - 1]) {
+                command_len--;
+            }
+            command[command_len] = '\0';
+            execute(command);
+            command_len = 0;
+        } else if (command_len < sizeof(command) - 1) {
+            command[command_len++] = data[i];
+        }
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Takes the response bytes that are due by the current simulated time.
+ *
+ * \param: 2 params: pointer to the buffer and its size.
+ *
+ * \return: number of bytes copied.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int simModemTransmit(uint8_t *buffer, int size) {
+    int count = 0;
+
+    while (count < size && output_count > 0 && (int32_t) (now - output[output_head].due_ms) >= 0) {
+        const char *text = output[output_head].text;
+        buffer[count++] = text[output_pos++];
+        if ('\0' == text[output_pos]) {
+            output_pos = 0;
+            output_head = (output_head + 1) % SIM_OUTPUT_LINES;
+            output_count--;
+        }
+    }
+    return count;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the modem interface of the simulated modem, to be passed to uplinkInit().
+ *
+ * \param:
+ *
+ * \return: pointer to the modem interface.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const modem_io *simModemIo() {
+    return &sim_io;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the counters of the simulated modem.
+ *
+ * \param:
+ *
+ * \return: pointer to the statistics.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+const sim_modem_stats *simModemStatistics() {
+    return &stats;
+}
+
+static int simSend(const char *data) {
+    simModemReceive(data, strlen(data));
+    return strlen(data);
+}
+
+static int simRead(uint8_t *buffer, int size) {
+    return simModemTransmit(buffer, size);
+}
@@ -0,0 +1,50 @@
+#ifndef SIM_MODEM
+#define SIM_MODEM
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "uplink.h"
+
+#define SIM_LINE_LEN 160
+#define SIM_OUTPUT_LINES 64
+#define SIM_BANDS 2                          // g and g1, the sub-bands of the EU868 default channels
+#define SIM_DUTY_CYCLE_PERMILLE 10           // 1 % in both
+
+typedef struct sim_modem_config_ {
+    uint32_t response_latency_ms;            // from the end of a command to the first response line
+    uint8_t ack_drop_percent;                // confirmed uplinks that get no acknowledgement
+    int dr;                                  // data rate used for the airtime of uplinks
+    const char *downlink;                    // hex payload sent on DOWNLINK_PORT with the first ACK, or NULL
+    bool joined;                             // start with a network session, AT+JOIN answers Joined already
+    uint32_t join_delay_ms;                  // from AT+JOIN to the join result
+    uint8_t loss_percent;                    // uplinks and join requests lost on the air
+    bool duty_cycle;                         // refuse uplinks with No band while the sub-bands are off
+    uint8_t garble_percent;                  // response lines with a corrupted character or cut short
+    uint32_t wake_latency_ms;                // from the first byte received asleep to +LOWPOWER: WAKEUP
+    FILE *airtime_log;                       // one CSV line per transmission, or NULL
+} sim_modem_config;
+
+typedef struct sim_modem_stats_ {
+    uint32_t commands;
+    uint32_t transmissions;                  // uplinks and join requests sent on the air
+    uint32_t lost;
+    uint32_t no_band;                        // uplinks refused by the duty cycle
+    uint32_t garbled;
+    uint32_t joins;
+    uint32_t sleeps;
+    uint32_t wakes;
+    uint32_t dropped;                        // bytes received while asleep
+    uint32_t asleep_ms;
+    uint64_t airtime_us;
+} sim_modem_stats;
+
+void simModemInit(const sim_modem_config *config, uint32_t seed);
+void simModemTick(uint32_t now_ms);
+void simModemReceive(const char *data, size_t length);
+int simModemTransmit(uint8_t *buffer, int size);
+const modem_io *simModemIo();
+const sim_modem_stats *simModemStatistics();
+
+#endif
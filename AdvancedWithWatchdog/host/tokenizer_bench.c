@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ring_buffer.h"
+#include "tokenizer.h"
+
+#define RX_BUFFER_SIZE 256                   // as allocated by uart_setup()
+#define CHUNK 16                             // bytes received between two polls, about one uart FIFO
+#define STRLEN 128                           // response buffer of loraCommunication()
+#define TARGET_BYTES 20000000                // bytes run through each method
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+/* Responses the LoRa code waits for */
+static const char *expected[] = {"+AT: OK", "+JOIN: Network joined", "+JOIN: Joined already", "+CMSG: ACK Received",
+                                 "+CMSG: Done", "+MSG: Done", "ERROR"};
+
+#define EXPECTED  ( sizeof(expected) / sizeof(expected[0]) )
+
+static int expected_len[EXPECTED];
+
+static const char *class_names[] = {"unknown", "echo", "ok", "error", "urc", "payload", "value"};
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *readFile(const char *name, size_t *length) {
+    FILE *file = fopen(name, "rb");
+    if (NULL == file) {
+        perror(name);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    *length = ftell(file);
+    rewind(file);
+    char *data = malloc(*length);
+    if (fread(data, 1, *length, file) != *length) {
+        perror(name);
+        exit(1);
+    }
+    fclose(file);
+    return data;
+}
+
+/**********************************************************************************************************************
+ * \brief: Puts the next chunk of the transcript into the ring buffer like the uart interrupt does.
+ *
+ * \param: 4 params: ring buffer, transcript, its length and pointer to the read position in the transcript.
+ *
+ * \return:
+ *
+ * \remarks: Stops early if the ring buffer is full, the rest comes with the next chunk.
+ **********************************************************************************************************************/
+static void receive(ring_buffer *rb, const char *data, size_t length, size_t *position) {
+    for (int i = 0; i < CHUNK && *position < length && rb_put(rb, data[*position]); i++) {
+        (*position)++;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Only receives and discards the bytes, the cost every method pays before it looks at them.
+ *
+ * \param: 2 params: transcript and its length.
+ *
+ * \return: bytes processed
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static size_t receiveOnly(const char *data, size_t length) {
+    static uint8_t storage[RX_BUFFER_SIZE];
+    ring_buffer rb;
+    size_t position = 0;
+
+    rb_init(&rb, storage, RX_BUFFER_SIZE);
+    while (position < length) {
+        receive(&rb, data, length, &position);
+        rb_drop(&rb, rb_count(&rb));
+    }
+    return length;
+}
+
+/**********************************************************************************************************************
+ * \brief: The old way: every poll copies the waiting bytes into a response buffer and searches the whole buffer for
+ *         each expected response again. The buffer is restarted when a response is found or it fills up.
+ *
+ * \param: 3 params: transcript, its length and pointer to the count of matches.
+ *
+ * \return: bytes processed
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static size_t copyAndSearch(const char *data, size_t length, uint32_t *matches) {
+    static uint8_t storage[RX_BUFFER_SIZE];
+    ring_buffer rb;
+    char response[STRLEN];
+    int response_len = 0;
+    size_t position = 0;
+
+    rb_init(&rb, storage, RX_BUFFER_SIZE);
+    while (position < length || false == rb_empty(&rb)) {
+        receive(&rb, data, length, &position);
+        while (response_len < STRLEN - 1 && false == rb_empty(&rb)) {
+            response[response_len++] = rb_get(&rb);
+        }
+        response[response_len] = '\0';
+        for (int i = 0; i < EXPECTED; i++) {
+            char *found = strstr(response, expected[i]);
+            if (NULL != found && NULL != strchr(found, '\n')) {
+                (*matches)++;
+                response_len = 0;
+                break;
+            }
+        }
+        if (STRLEN - 1 == response_len) {
+            response_len = 0;
+        }
+    }
+    return length;
+}
+
+/**********************************************************************************************************************
+ * \brief: The tokenizer: every poll continues the line search over the new bytes only, complete lines are classified
+ *         and compared in the ring buffer and dropped.
+ *
+ * \param: 4 params: transcript, its length, pointer to the count of matches and the line counts per class.
+ *
+ * \return: bytes processed
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static size_t tokenize(const char *data, size_t length, uint32_t *matches, uint32_t *classes) {
+    static uint8_t storage[RX_BUFFER_SIZE];
+    ring_buffer rb;
+    at_tokenizer tokenizer;
+    at_line line;
+    size_t position = 0;
+
+    rb_init(&rb, storage, RX_BUFFER_SIZE);
+    atTokenizerReset(&tokenizer);
+    while (position < length) {
+        receive(&rb, data, length, &position);
+        while (true == atNextLine(&tokenizer, &rb, &line)) {
+            classes[line.type]++;
+            for (int i = 0; i < EXPECTED; i++) {
+                if (true == atLineEquals(&rb, &line, expected[i], expected_len[i])) {
+                    (*matches)++;
+                    break;
+                }
+            }
+            atLineDrop(&tokenizer, &rb, &line);
+        }
+    }
+    return length;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Runs recorded LoRa-E5 transcripts through the old copy-and-search response handling and through the line
+ *         tokenizer, and prints the time per received byte of both, less the time to receive the bytes.
+ *
+ * \param: transcript files, recorded modem output with CRLF line endings.
+ *
+ * \return: 0, 1 on error.
+ *
+ * \remarks: The bytes arrive in CHUNK sized pieces and are processed after each piece, like the firmware polls.
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s transcript...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 0; i < EXPECTED; i++) {
+        expected_len[i] = strlen(expected[i]);
+    }
+    for (int f = 1; f < argc; f++) {
+        size_t length;
+        char *data = readFile(argv[f], &length);
+        int rounds = TARGET_BYTES / length + 1;
+        uint32_t old_matches = 0, new_matches = 0, classes[LINE_VALUE + 1] = {0};
+
+        double start = seconds();
+        for (int i = 0; i < rounds; i++) {
+            receiveOnly(data, length);
+        }
+        double receive_ns = (seconds() - start) * 1e9 / ((double) rounds * length);
+
+        start = seconds();
+        for (int i = 0; i < rounds; i++) {
+            copyAndSearch(data, length, &old_matches);
+        }
+        double old_ns = (seconds() - start) * 1e9 / ((double) rounds * length);
+
+        start = seconds();
+        for (int i = 0; i < rounds; i++) {
+            tokenize(data, length, &new_matches, classes);
+        }
+        double new_ns = (seconds() - start) * 1e9 / ((double) rounds * length);
+
+        printf("%s: %zu bytes, %d rounds\n", argv[f], length, rounds);
+        printf("  receive only:    %6.2f ns/byte\n", receive_ns);
+        printf("  copy and search: %6.2f ns/byte, %u responses found per round\n", old_ns - receive_ns,
+               old_matches / rounds);
+        printf("  tokenizer:       %6.2f ns/byte, %u responses found per round\n", new_ns - receive_ns,
+               new_matches / rounds);
+        printf("  lines per round:");
+        for (int i = 0; i <= LINE_VALUE; i++) {
+            printf(" %s %u", class_names[i], classes[i] / rounds);
+        }
+        printf("\n");
+        free(data);
+    }
+    return 0;
+}
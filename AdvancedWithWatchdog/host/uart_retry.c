@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "pico/stdlib.h"
+#include "uart.h"
+#include "lorawan.h"
+
+#define RETRIES 10000
+#define IDLE_WAIT_MS 10000                   // a join waits this long for its answer
+#define TAIL_WRITES ( UART_TX_DESCRIPTORS + 4 )  // copied writes in a row, more than there are descriptors
+
+void uart1_handler(void);
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static size_t heapInUse() {
+    return mallinfo2().uordblks;
+}
+
+/* Lets the uart send everything that is waiting, one TX interrupt per FIFO */
+static int transmitAll(void) {
+    int interrupts = 0;
+    while (uart1->hw.imsc & UART_UARTIMSC_TXIM_BITS) {
+        fakeUartTransmit(uart1);
+        uart1_handler();
+        interrupts++;
+    }
+    fakeUartTransmit(uart1);
+    return interrupts;
+}
+
+/**********************************************************************************************************************
+ * \brief: One attempt of loraInit() as far as the uart is concerned: set up, DMA reception, one command and its
+ *         response.
+ *
+ * \param: 1 param: baud rate.
+ *
+ * \return: true if the response was read back intact
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static bool attempt(int speed) {
+    static const char response[] = "+AT: OK\r\n";
+    char received[sizeof(response)] = {0};
+
+    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, speed);
+    uart_rx_dma(UART_NR);
+    uart_send(UART_NR, "AT\r\n");
+    transmitAll();
+    fakeUartReceive(uart1, (const uint8_t *) response, sizeof(response) - 1);
+    fakeDmaRun();
+    return sizeof(response) - 1 == uart_read(UART_NR, (uint8_t *) received, sizeof(received))
+           && 0 == memcmp(received, response, sizeof(response) - 1);
+}
+
+/**********************************************************************************************************************
+ * \brief: Reads a multi-line response with uart_read_line(): the first line is waiting, the last arrives 3 s later,
+ *         then nothing does until the deadline.
+ *
+ * \param:
+ *
+ * \return: number of failed checks
+ *
+ * \remarks: Prints when each read returned, in ms of fake time after the command.
+ **********************************************************************************************************************/
+static int readLines(void) {
+    static const char start[] = "+MSG: Start\r\n", done[] = "+MSG: Done\r\n";
+    char line[32];
+    int failed = 0;
+
+    fakeUartReceive(uart1, (const uint8_t *) start, sizeof(start) - 1);
+    fakeDmaRun();
+    fakeUartReceiveLater(uart1, (const uint8_t *) done, sizeof(done) - 1, 3000000);
+    absolute_time_t sent = get_absolute_time();
+    absolute_time_t deadline = make_timeout_time_ms(10000);
+
+    failed += 11 != uart_read_line(UART_NR, line, sizeof(line), deadline) || 0 != strcmp(line, "+MSG: Start");
+    uint32_t start_ms = (uint32_t) (get_absolute_time() - sent) / 1000;
+    failed += 10 != uart_read_line(UART_NR, line, sizeof(line), deadline) || 0 != strcmp(line, "+MSG: Done");
+    uint32_t done_ms = (uint32_t) (get_absolute_time() - sent) / 1000;
+    fakeUartReceive(uart1, (const uint8_t *) "+MSG", 4);
+    fakeDmaRun();
+    failed += -1 != uart_read_line(UART_NR, line, sizeof(line), deadline);
+    uint32_t timeout_ms = (uint32_t) (get_absolute_time() - sent) / 1000;
+    failed += 4 != rb_count(uart_rx_ring(UART_NR));
+    failed += 0 != start_ms || 3000 != done_ms || 10000 != timeout_ms;
+
+    printf("uart_read_line(): Start after %u ms, Done after %u ms, timeout after %u ms, partial line kept: %s\n",
+           start_ms, done_ms, timeout_ms, 0 == failed ? "ok" : "failed");
+    return failed;
+}
+
+/**********************************************************************************************************************
+ * \brief: Waits for a line that does not come at 115200 baud under DMA receive and counts how often the core woke.
+ *
+ * \param:
+ *
+ * \return: number of failed checks
+ *
+ * \remarks: A quiet line is looked at every UART_RX_POLL_US, not every idle time of 350 us.
+ **********************************************************************************************************************/
+static int idleWakeups(void) {
+    uint32_t limit = IDLE_WAIT_MS * 1000 / UART_RX_POLL_US + 1;
+    char line[32];
+    int failed = 0;
+
+    uart_set_speed(UART_NR, 115200);
+    uint32_t before = fakeWakeups();
+    failed += -1 != uart_read_line(UART_NR, line, sizeof(line), make_timeout_time_ms(IDLE_WAIT_MS));
+    uint32_t wakeups = fakeWakeups() - before;
+    failed += wakeups > limit;
+    uart_set_speed(UART_NR, BAUD_RATE);
+
+    printf("idle wait of %d ms at 115200 baud: %u wakeups, at most %u: %s\n", IDLE_WAIT_MS, wakeups, limit,
+           0 == failed ? "ok" : "failed");
+    return failed;
+}
+
+/**********************************************************************************************************************
+ * \brief: Sends a copied write, a referenced write longer than the TX ring and more small copied writes than there are
+ *         descriptors, and checks that they go out whole and in order.
+ *
+ * \param:
+ *
+ * \return: number of failed checks
+ *
+ * \remarks: The ticket of the referenced write must not be done before its bytes are in the FIFO. The copied writes in
+ *           a row share one descriptor, so they are only limited by the ring.
+ **********************************************************************************************************************/
+static int writeScatter(void) {
+    static uint8_t command[600];
+    uint32_t ticket;
+    int failed = 0;
+
+    for (int i = 0; i < sizeof(command); i++) {
+        command[i] = 'a' + i % 26;
+    }
+    uart1->tx_length = 0;
+    failed += 4 != uart_write(UART_NR, (const uint8_t *) "AT+A", 4);
+    failed += true != uart_write_ref(UART_NR, command, sizeof(command), &ticket);
+    for (int i = 0; i < TAIL_WRITES; i++) {
+        failed += 2 != uart_write(UART_NR, (const uint8_t *) "XY", 2);
+    }
+    failed += true == uart_tx_done(UART_NR, ticket);
+    int interrupts = transmitAll();
+
+    failed += 4 + sizeof(command) + 2 * TAIL_WRITES != uart1->tx_length || true != uart_tx_done(UART_NR, ticket);
+    failed += 0 != memcmp(uart1->tx, "AT+A", 4) || 0 != memcmp(&uart1->tx[4], command, sizeof(command));
+    for (int i = 0; i < TAIL_WRITES; i++) {
+        failed += 0 != memcmp(&uart1->tx[4 + sizeof(command) + 2 * i], "XY", 2);
+    }
+    printf("scatter-gather write of %d bytes in %d writes: %d sent in %d TX interrupts, in order: %s\n",
+           (int) (4 + sizeof(command) + 2 * TAIL_WRITES), 2 + TAIL_WRITES, uart1->tx_length, interrupts,
+           0 == failed ? "ok" : "failed");
+    return failed;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Runs the uart part of RETRIES join attempts against the fake Pico SDK and checks that the heap stays flat,
+ *         then changes the baud rate of the running uart. Checks overrun counting, the timing of uart_read_line()
+ *         and the order of a scatter-gather write as well, and that an idle wait under DMA seldom wakes the core.
+ *
+ * \param:
+ *
+ * \return: 0 if the heap did not grow and every response arrived, 1 otherwise.
+ *
+ * \remarks: For comparison, the heap growth of allocating the ring buffers on every attempt is printed as well.
+ **********************************************************************************************************************/
+int main(void) {
+    int failed = 0;
+
+    attempt(BAUD_RATE);
+    size_t before = heapInUse();
+    for (int i = 0; i < RETRIES; i++) {
+        failed += false == attempt(BAUD_RATE);
+    }
+    size_t growth = heapInUse() - before;
+    printf("%d setup retries: heap growth %zu bytes, %d responses lost\n", RETRIES, growth, failed);
+
+    failed += false == attempt(115200);
+    failed += 115200 != uart1->baudrate || false == attempt(BAUD_RATE) || BAUD_RATE != uart1->baudrate;
+    printf("baud rate changed and restored without setup: %s\n", 0 == failed ? "ok" : "failed");
+
+    uint8_t burst[UART_RX_BUFFER_SIZE + 44];
+    uart_stats stats;
+    memset(burst, 'x', sizeof(burst));
+    uart_take_stats(UART_NR, &stats);
+    fakeUartReceive(uart1, burst, sizeof(burst));
+    fakeDmaRun();
+    (void) uart_rx_ring(UART_NR);
+    const uart_stats *counted = uart_get_stats(UART_NR);
+    failed += 44 != counted->rx_dropped || UART_RX_BUFFER_SIZE != counted->rx_high_water;
+    printf("unread burst of %zu bytes: %u dropped, high water %u\n", sizeof(burst),
+           (unsigned) counted->rx_dropped, (unsigned) counted->rx_high_water);
+
+    uart_read(UART_NR, burst, sizeof(burst));
+    failed += readLines();
+    failed += writeScatter();
+    uart_read(UART_NR, burst, sizeof(burst));
+    failed += idleWakeups();
+
+    ring_buffer legacy[2];
+    before = heapInUse();
+    for (int i = 0; i < RETRIES; i++) {
+        rb_alloc(&legacy[0], 256);
+        rb_alloc(&legacy[1], 256);
+    }
+    printf("for comparison, rb_alloc() of both rings per retry: heap growth %zu bytes\n", heapInUse() - before);
+
+    return 0 == growth && 0 == failed ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "decoder.h"
+
+#define BATCH_BYTES ( 1 << 20 )              // capture bytes taken by a worker at a time
+#define MAX_THREADS 64
+
+/////////////////////////////////////////////////////
+//                GLOBAL VARIABLES                 //
+/////////////////////////////////////////////////////
+
+/* Decoded output of one batch, written out in batch order */
+typedef struct batch_output_ {
+    char *text;
+    size_t length;
+} batch_output;
+
+typedef struct worker_ {
+    pthread_t thread;
+    uint64_t lines;
+    uint64_t malformed;
+    uint64_t events[EV_COUNT];
+} worker;
+
+static const char *data;                     // the mapped capture file
+static size_t data_len;
+static atomic_size_t next_batch;
+static size_t batch_count;
+static batch_output *outputs;                // NULL without -o
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-t threads] [-o events.csv] capture...\n"
+                    "  capture lines: device,time_ms,payload_hex\n"
+                    "  events.csv: device,time_ms,event,arg0,arg1\n", name);
+}
+
+/**********************************************************************************************************************
+ * \brief: Appends the CSV line of an event to the output of a batch.
+ *
+ * \param: 3 params: pointer to the output, its capacity and the event.
+ *
+ * \return:
+ *
+ * \remarks: Grows the buffer as needed.
+ **********************************************************************************************************************/
+static void appendEvent(batch_output *output, size_t *capacity, const decoded_event *event) {
+    if (*capacity - output->length < 128) {
+        *capacity = *capacity ? 2 * *capacity : BATCH_BYTES;
+        output->text = realloc(output->text, *capacity);
+    }
+    output->length += sprintf(&output->text[output->length], "%u,%llu,%s,%d,%d\n", event->device,
+                              (unsigned long long) event->time_ms, decoderEventName(event->type), event->arg[0],
+                              event->arg[1]);
+}
+
+/**********************************************************************************************************************
+ * \brief: Decodes the lines that start in one batch of the capture. A line crossing the end of the batch belongs to
+ *         it, the next batch skips it.
+ *
+ * \param: 2 params: pointer to the statistics of the worker and the batch number.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void decodeBatch(worker *self, size_t batch) {
+    size_t start = batch * BATCH_BYTES;
+    size_t stop = start + BATCH_BYTES < data_len ? start + BATCH_BYTES : data_len;
+    batch_output *output = NULL != outputs ? &outputs[batch] : NULL;
+    size_t capacity = 0;
+    decoded_event events[DECODER_MAX_EVENTS];
+
+    if (start > 0 && '\n' != data[start - 1]) {
+        const char *newline = memchr(&data[start], '\n', data_len - start);
+        start = NULL != newline ? (size_t) (newline - data) + 1 : data_len;
+    }
+    while (start < stop) {
+        const char *line = &data[start];
+        const char *newline = memchr(line, '\n', data_len - start);
+        size_t length = NULL != newline ? (size_t) (newline - line) : data_len - start;
+        start += length + 1;
+        if (length > 0 && '\r' == line[length - 1]) {
+            length--;
+        }
+
+        int count = decodeLine(line, length, events, DECODER_MAX_EVENTS);
+        self->lines++;
+        if (0 == count) {
+            self->malformed++;
+        }
+        for (int i = 0; i < count; i++) {
+            self->events[events[i].type]++;
+            if (NULL != output) {
+                appendEvent(output, &capacity, &events[i]);
+            }
+        }
+    }
+}
+
+/* Worker thread: takes batches until none are left */
+static void *work(void *argument) {
+    worker *self = argument;
+    size_t batch;
+
+    while ((batch = atomic_fetch_add(&next_batch, 1)) < batch_count) {
+        decodeBatch(self, batch);
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Decodes capture files of fleet uplinks into structured events on all cores and prints the events per type
+ *         and the throughput.
+ *
+ * \param: options, see usage(), and the capture files. Each file is memory mapped and cut into BATCH_BYTES batches
+ *         that the worker threads take from a shared counter.
+ *
+ * \return: 0, 1 on error.
+ *
+ * \remarks: With -o the events are written in the order of the capture.
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    static worker workers[MAX_THREADS];
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    const char *output_name = NULL;
+    FILE *output_file = NULL;
+    uint64_t lines = 0, malformed = 0, events[EV_COUNT] = {0}, total_events = 0, total_bytes = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "t:o:h")) != -1) {
+        switch (option) {
+            case 't': threads = atoi(optarg); break;
+            case 'o': output_name = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (NULL != output_name && NULL == (output_file = fopen(output_name, "w"))) {
+        perror(output_name);
+        return 1;
+    }
+
+    double start = seconds();
+    for (int f = optind; f < argc; f++) {
+        int fd = open(argv[f], O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            perror(argv[f]);
+            return 1;
+        }
+        data_len = st.st_size;
+        if (0 == data_len) {
+            close(fd);
+            continue;
+        }
+        data = mmap(NULL, data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == data) {
+            perror(argv[f]);
+            return 1;
+        }
+        /* advice values are not flags, each needs its own call */
+        madvise((void *) data, data_len, MADV_SEQUENTIAL);
+        madvise((void *) data, data_len, MADV_WILLNEED);
+
+        batch_count = (data_len + BATCH_BYTES - 1) / BATCH_BYTES;
+        atomic_store(&next_batch, 0);
+        outputs = NULL != output_file ? calloc(batch_count, sizeof(batch_output)) : NULL;
+        for (int i = 0; i < threads; i++) {
+            pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+        }
+        for (int i = 0; i < threads; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        if (NULL != outputs) {
+            for (size_t i = 0; i < batch_count; i++) {
+                fwrite(outputs[i].text, 1, outputs[i].length, output_file);
+                free(outputs[i].text);
+            }
+            free(outputs);
+        }
+        munmap((void *) data, data_len);
+        close(fd);
+        total_bytes += data_len;
+    }
+    double elapsed = seconds() - start;
+
+    for (int i = 0; i < threads; i++) {
+        lines += workers[i].lines;
+        malformed += workers[i].malformed;
+        for (int type = 0; type < EV_COUNT; type++) {
+            events[type] += workers[i].events[type];
+            total_events += workers[i].events[type];
+        }
+    }
+    if (NULL != output_file) {
+        fclose(output_file);
+    }
+
+    fprintf(stderr, "%llu lines, %llu malformed, %llu events in %.3f s on %d threads: %.2f M events/s, %.0f MB/s\n",
+            (unsigned long long) lines, (unsigned long long) malformed, (unsigned long long) total_events, elapsed,
+            threads, total_events / elapsed / 1e6, total_bytes / elapsed / 1e6);
+    for (int type = 0; type < EV_COUNT; type++) {
+        if (0 != events[type]) {
+            fprintf(stderr, "  %-20s %llu\n", decoderEventName(type), (unsigned long long) events[type]);
+        }
+    }
+    return 0;
+}
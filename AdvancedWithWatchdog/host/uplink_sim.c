@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "airtime.h"
+#include "dutycycle.h"
+#include "uplink.h"
+#include "downlink.h"
+#include "sim_modem.h"
+#include "metrics.h"
+#include "adr.h"
+#include "messages.h"
+#include "uart.h"
+#include "lorawan.h"
+
+#define TICK_MS 10
+
+static const char *histogram_names[MH_COUNT] = {"exchange ms", "delivery ms", "RSSI dBm", "SNR 0.1 dB",
+                                                "serial us"};
+static int log_entries;
+int *log_counter = &log_entries;             // of eeprom.c, linked in for lorawan.c
+
+/////////////////////////////////////////////////////
+//                  FUNCTIONS                      //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Carries the bytes between the uart of the firmware and the simulated modem, both ways.
+ *
+ * \param: none
+ *
+ * \return: none
+ *
+ * \remarks: The fake uart keeps every byte it sent, the ones not yet handed to the modem are taken from there.
+ **********************************************************************************************************************/
+static void bridge() {
+    static int sent;
+    uint8_t buffer[SIM_LINE_LEN];
+
+    while (sent != uart1->tx_length) {
+        char c = (char) uart1->tx[sent++ % sizeof(uart1->tx)];
+        simModemReceive(&c, 1);
+    }
+    int count = simModemTransmit(buffer, sizeof(buffer));
+    if (count > 0) {
+        fakeUartReceive(uart1, buffer, count);
+        fakeDmaRun();
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Sends a few uplinks through lorawan.c and the uart driver at a baud rate, on the fake Pico SDK.
+ *
+ * \param: 2 parameters. Takes the simulated modem configuration and the baud rate.
+ *
+ * \return: median of the MH_SERIAL samples in us, 0 if none were recorded
+ *
+ * \remarks: The fake clock advances in TICK_MS steps and while a command is on the line, so MH_SERIAL holds the
+ *           measured time from queuing a command to its last byte leaving the uart.
+ **********************************************************************************************************************/
+static int serialRun(const sim_modem_config *config, int speed) {
+    uint8_t health[METRICS_HEALTH_LEN];
+    uint32_t samples;
+
+    uart_set_speed(UART_NR, speed);
+    simModemInit(config, 12345);
+    uplinkInit(loraModem(), 67890);
+    uplinkSetDataRate(config->dr);
+    adrSetDataRate(config->dr);
+    metricsHealth(health);
+    for (int i = 0; i < 3; i++) {
+        uplinkEnqueue((const uint8_t *) fixed_msg[i], strlen(fixed_msg[i]), UPLINK_CONFIRMED, time_us_32() / 1000);
+    }
+    while (false == uplinkIdle()) {
+        uint32_t now = time_us_32() / 1000;
+        simModemTick(now);
+        uplinkPoll(now);
+        bridge();
+        fakeAdvanceUs(TICK_MS * 1000);
+    }
+    int median = metricsPercentile(MH_SERIAL, 50, &samples);
+    printf("through the uart at %d baud: delivered %u, %u serial samples, median from %d us\n", speed,
+           uplinkStatistics()->delivered, samples, metricsBucketValue(MH_SERIAL, median));
+    return samples ? metricsBucketValue(MH_SERIAL, median) : 0;
+}
+
+/////////////////////////////////////////////////////
+//                     MAIN                        //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Sends dispense messages through the uplink queue to a simulated modem that drops a share of the
+ *         acknowledgements, and prints the delivery statistics.
+ *
+ * \param: optional arguments: ACK drop percentage (default 30), number of messages (default 20), interval between
+ *         messages in ms (default 30000, the test dispense interval), data rate (default DR5) and a hex downlink payload
+ *         delivered with the first acknowledgement (default none).
+ *
+ * \return: 0, 1 if the health uplink or the long texts are not delivered at LORA_DEFAULT_DR or no serial time is
+ *          recorded through the uart
+ *
+ * \remarks: Every message is sent confirmed, the modem sleeps between the uplinks. The simulated clock advances in TICK_MS steps, the queue is polled every
+ *           step just like the firmware polls it from its waits. At the end the health uplink of the run is sent on
+ *           its own at LORA_DEFAULT_DR, the slowest data rate with the smallest payload limit. Then the adaptation is
+ *           forced to DR0 with the two fixed messages longer than its 51 bytes queued, they must go out at a faster
+ *           data rate instead of being refused. Last a few uplinks go through lorawan.c and the uart driver on the
+ *           fake Pico SDK at both baud rates, the serial time must be recorded and shorter at FAST_BAUD_RATE.
+ **********************************************************************************************************************/
+int main(int argc, char *argv[]) {
+    sim_modem_config config = {.response_latency_ms = 20, .ack_drop_percent = 30, .dr = 5, .joined = true,
+                               .wake_latency_ms = 30};
+    int messages = 20;
+    uint32_t interval = 30000;
+    char message[UPLINK_PAYLOAD_MAX];
+    downlink dl;
+
+    if (argc > 1) config.ack_drop_percent = atoi(argv[1]);
+    if (argc > 2) messages = atoi(argv[2]);
+    if (argc > 3) interval = strtoul(argv[3], NULL, 10);
+    if (argc > 4) config.dr = atoi(argv[4]);
+    if (argc > 5) config.downlink = argv[5];
+
+    simModemInit(&config, 12345);
+    uplinkInit(simModemIo(), 67890);
+    uplinkSetDataRate(config.dr);
+    uplinkLowPower(true);
+    dutyCycleReset(0);
+
+    uint32_t now = 0;
+    int queued = 0;
+    while (queued < messages || false == uplinkIdle()) {
+        if (queued < messages && now >= (uint32_t) queued * interval) {
+            int length = snprintf(message, sizeof(message), "Day %d: Pill not dispensed. Number of pills left: %d.",
+                                  queued % 7 + 1, 6 - queued % 7);
+            uplinkEnqueue((const uint8_t *) message, length, UPLINK_CONFIRMED, now);
+            queued++;
+        }
+        simModemTick(now);
+        uplinkPoll(now);
+        if (downlinkTake(&dl)) {
+            printf("%u ms: downlink on port %u, %u bytes, command 0x%02X\n", now, dl.port, dl.length,
+                   dl.length ? dl.payload[0] : 0);
+        }
+        now += TICK_MS;
+    }
+
+    const uplink_stats *stats = uplinkStatistics();
+    printf("ACK drop %u %%, %d confirmed uplinks at DR%d, simulated %u s\n", config.ack_drop_percent, messages,
+           config.dr, now / 1000);
+    printf("delivered %u, failed %u, dropped %u, retries %u, attempts without ACK %u\n", stats->delivered,
+           stats->failed, stats->dropped, stats->retries, stats->no_ack);
+    for (int i = 0; i <= UPLINK_MAX_RETRIES; i++) {
+        printf("  delivered on attempt %d: %u\n", i + 1, stats->attempts[i]);
+    }
+    printf("latency: average %u ms, worst %u ms\n", stats->delivered ? stats->latency_total_ms / stats->delivered : 0,
+           stats->latency_max_ms);
+    printf("modem sleeps %u, wakes %u, wake failures %u, wake latency last %u ms, worst %u ms, asleep %u s of %u s\n",
+           stats->sleeps, stats->wakes, stats->wake_failures, stats->wake_latency_last_ms, stats->wake_latency_max_ms,
+           stats->asleep_ms / 1000, now / 1000);
+    for (int i = 0; i < MH_COUNT; i++) {
+        uint32_t samples;
+        int median = metricsPercentile(i, 50, &samples);
+        printf("%-12s %u samples, median from %d, 90th percentile from %d\n", histogram_names[i], samples,
+               metricsBucketValue(i, median), metricsBucketValue(i, metricsPercentile(i, 90, NULL)));
+    }
+
+    uint8_t health[METRICS_HEALTH_LEN];
+    size_t length = metricsHealth(health);
+    printf("health uplink %zu bytes:", length);
+    for (size_t i = 0; i < length; i++) {
+        printf(" %02X", health[i]);
+    }
+    printf("\n");
+
+    config.dr = LORA_DEFAULT_DR;
+    config.ack_drop_percent = 0;
+    config.downlink = NULL;
+    simModemInit(&config, 12345);
+    uplinkInit(simModemIo(), 67890);
+    uplinkSetDataRate(config.dr);
+    uint32_t refused = metricsGet()->counters.count[MC_REFUSED];
+    uplinkEnqueue(health, length, UPLINK_BINARY, now);
+    while (false == uplinkIdle()) {
+        simModemTick(now);
+        uplinkPoll(now);
+        now += TICK_MS;
+    }
+    refused = metricsGet()->counters.count[MC_REFUSED] - refused;
+    printf("health uplink at DR%d (%u bytes max): delivered %u, refused %u\n", config.dr,
+           dataRate(config.dr)->max_payload, stats->delivered, refused);
+    int failed = 1 != stats->delivered || 0 != refused;
+
+    simModemInit(&config, 12345);
+    uplinkInit(simModemIo(), 67890);
+    uplinkSetDataRate(config.dr);
+    adrSetDataRate(ADR_MIN_DR);
+    refused = metricsGet()->counters.count[MC_REFUSED];
+    uplinkEnqueue((const uint8_t *) fixed_msg[4], strlen(fixed_msg[4]), UPLINK_CONFIRMED | UPLINK_ALERT, now);
+    uplinkEnqueue((const uint8_t *) fixed_msg[5], strlen(fixed_msg[5]), 0, now);
+    int highest_dr = uplinkDataRate();
+    while (false == uplinkIdle()) {
+        simModemTick(now);
+        uplinkPoll(now);
+        if (uplinkDataRate() > highest_dr) {
+            highest_dr = uplinkDataRate();
+        }
+        now += TICK_MS;
+    }
+    refused = metricsGet()->counters.count[MC_REFUSED] - refused;
+    printf("texts of %zu and %zu bytes with ADR at DR%d: delivered %u, refused %u, sent at DR%d\n",
+           strlen(fixed_msg[4]), strlen(fixed_msg[5]), ADR_MIN_DR, stats->delivered, refused, highest_dr);
+    failed += 2 != stats->delivered || 0 != refused;
+
+    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE);
+    uart_rx_dma(UART_NR);
+    config.dr = 5;
+    int slow = serialRun(&config, BAUD_RATE);
+    int fast = serialRun(&config, FAST_BAUD_RATE);
+    failed += 0 == slow || 0 == fast || fast >= slow;
+    return 0 == failed ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+#include "work_pool.h"
+
+/////////////////////////////////////////////////////
+//                   FUNCTIONS                     //
+/////////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Takes the next task of a worker's own deque.
+ *
+ * \param: 2 params: pointer to the deque and pointer to the task number.
+ *
+ * \return: true if a task was taken
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static bool takeOwn(work_deque *deque, size_t *task) {
+    bool taken = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->begin < deque->end) {
+        *task = deque->begin++;
+        taken = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return taken;
+}
+
+/**********************************************************************************************************************
+ * \brief: Moves the upper half of the tasks of another worker to an empty deque.
+ *
+ * \param: 2 params: pointer to the pool and the number of the stealing worker.
+ *
+ * \return: true if tasks were stolen
+ *
+ * \remarks: Victims are tried in order from the next worker on, so the thieves spread over the pool.
+ **********************************************************************************************************************/
+static bool steal(work_pool *pool, int self) {
+    for (int i = 1; i < pool->threads; i++) {
+        work_deque *victim = &pool->deque[(self + i) % pool->threads];
+        size_t begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->end > victim->begin) {
+            end = victim->end;
+            begin = victim->end - (victim->end - victim->begin + 1) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (end > begin) {
+            work_deque *own = &pool->deque[self];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            __atomic_fetch_add(&pool->steals, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Runs the tasks of one batch on a worker until no deque has tasks left */
+static void runBatch(work_pool *pool, int self) {
+    size_t task;
+
+    do {
+        while (true == takeOwn(&pool->deque[self], &task)) {
+            pool->fn(pool->context, task, self);
+        }
+    } while (true == steal(pool, self));
+}
+
+struct worker_start_ {
+    work_pool *pool;
+    int self;
+};
+
+static struct worker_start_ worker_start[WORK_POOL_MAX_THREADS];
+
+/* Worker thread: waits for a batch, runs it and reports back */
+static void *worker(void *argument) {
+    work_pool *pool = ((struct worker_start_ *) argument)->pool;
+    int self = ((struct worker_start_ *) argument)->self;
+    unsigned int generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (generation == pool->generation && 0 == pool->stop) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (0 != pool->stop) {
+            break;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        runBatch(pool, self);
+
+        pthread_mutex_lock(&pool->lock);
+        if (0 == --pool->running) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**********************************************************************************************************************
+ * \brief: Starts the worker threads of a pool. The calling thread is worker 0, threads - 1 threads are created.
+ *
+ * \param: 2 params: pointer to the pool and the number of workers, limited to 1..WORK_POOL_MAX_THREADS.
+ *
+ * \return: number of workers
+ *
+ * \remarks: One pool at a time.
+ **********************************************************************************************************************/
+int workPoolInit(work_pool *pool, int threads) {
+    pool->threads = threads < 1 ? 1 : threads > WORK_POOL_MAX_THREADS ? WORK_POOL_MAX_THREADS : threads;
+    pool->generation = 0;
+    pool->running = 0;
+    pool->stop = 0;
+    pool->steals = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int i = 0; i < pool->threads; i++) {
+        pthread_mutex_init(&pool->deque[i].lock, NULL);
+        pool->deque[i].begin = pool->deque[i].end = 0;
+    }
+    for (int i = 1; i < pool->threads; i++) {
+        worker_start[i].pool = pool;
+        worker_start[i].self = i;
+        pthread_create(&pool->thread[i], NULL, worker, &worker_start[i]);
+    }
+    return pool->threads;
+}
+
+/**********************************************************************************************************************
+ * \brief: Runs a batch of tasks on the pool and returns when all of them are done.
+ *
+ * \param: 4 params: pointer to the pool, number of tasks, the task function and its context.
+ *
+ * \return:
+ *
+ * \remarks: The tasks are dealt to the workers in contiguous ranges. A worker that runs out steals half of the
+ *           remaining range of another one, so uneven tasks still keep every worker busy.
+ **********************************************************************************************************************/
+void workPoolRun(work_pool *pool, size_t tasks, work_fn fn, void *context) {
+    for (int i = 0; i < pool->threads; i++) {
+        pthread_mutex_lock(&pool->deque[i].lock);
+        pool->deque[i].begin = tasks * i / pool->threads;
+        pool->deque[i].end = tasks * (i + 1) / pool->threads;
+        pthread_mutex_unlock(&pool->deque[i].lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->context = context;
+    pool->running = pool->threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    runBatch(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (0 != pool->running) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**********************************************************************************************************************
+ * \brief: Stops and joins the worker threads of a pool.
+ *
+ * \param: 1 param: pointer to the pool.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void workPoolDestroy(work_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < pool->threads; i++) {
+        pthread_join(pool->thread[i], NULL);
+    }
+}
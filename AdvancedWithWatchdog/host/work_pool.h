@@ -0,0 +1,39 @@
+#ifndef WORK_POOL
+#define WORK_POOL
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define WORK_POOL_MAX_THREADS 64
+
+/* Runs task numbers 0..tasks-1 of a batch, worker is the number of the calling thread */
+typedef void (*work_fn)(void *context, size_t task, int worker);
+
+/* Tasks left to a worker, the owner takes from begin and thieves split off the end */
+typedef struct work_deque_ {
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+} work_deque;
+
+typedef struct work_pool_ {
+    int threads;
+    pthread_t thread[WORK_POOL_MAX_THREADS];
+    work_deque deque[WORK_POOL_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned int generation;                 // batch number, wakes the workers
+    int running;                             // workers still busy with the batch
+    int stop;
+    work_fn fn;
+    void *context;
+    unsigned long steals;
+} work_pool;
+
+int workPoolInit(work_pool *pool, int threads);
+void workPoolRun(work_pool *pool, size_t tasks, work_fn fn, void *context);
+void workPoolDestroy(work_pool *pool);
+
+#endif
@@ -1,15 +1,25 @@
 #include <stdio.h>
 #include <string.h>
 #include "pico/time.h"
+#include "pico/multicore.h"
 #include "hardware/uart.h"
 #include "hardware/irq.h"
 #include "uart.h"
 #include "lorawan.h"
+#include "airtime.h"
+#include "dutycycle.h"
+#include "eeprom.h"
+#include "uplink.h"
+#include "tokenizer.h"
+#include "metrics.h"
+#include "debuglog.h"
 
 #ifdef DEBUG_PRINT
-#define DBG_PRINT(f_, ...)  printf((f_), ##__VA_ARGS__)
+#define DBG_PRINT(f_, ...)  debugLog((f_), ##__VA_ARGS__)
+#define DBG_STRING(f_, s_)  debugLogString((f_), (s_))
 #else
 #define DBG_PRINT(f_, ...)
+#define DBG_STRING(f_, s_)
 #endif
 
 //////////////////////////////////////////////////
@@ -17,64 +27,397 @@
 //////////////////////////////////////////////////
 
 static const int uart_nr = UART_NR;
-static lorawan_item lorawan[] = {{"AT\r\n", "+AT: OK\r\n", STD_WAITING_TIME},
-                                 {"AT+MODE=LWOTAA\r\n", "+MODE: LWOTAA\r\n", STD_WAITING_TIME},
-                                 {"AT+KEY=APPKEY,\"511F30D4D81E7B806536733DE7155FDE\"\r\n", "+KEY: APPKEY 511F30D4D81E7B806536733DE7155FDE\r\n", STD_WAITING_TIME},  // Gemma
-                                 //{"AT+KEY=APPKEY,\"83A228D811E594812D8735EDDCCE28D0\"\r\n", "+KEY: APPKEY 83A228D811E594812D8735EDDCCE28D0\r\n", STD_WAITING_TIME},  // Mong
-                                 //{"AT+KEY=APPKEY,\"3D036E4388F937105A649BA6B0AD6366\"\r\n", "+KEY: APPKEY 3D036E4388F937105A649BA6B0AD6366\r\n", STD_WAITING_TIME},  // Xuan
-                                 {"AT+CLASS=A\r\n", "+CLASS: A\r\n", STD_WAITING_TIME},
-                                 {"AT+PORT=8\r\n", "+PORT: 8\r\n", STD_WAITING_TIME},
-                                 {"AT+JOIN\r\n", "Network joined\r\n", MSG_WAITING_TIME}};
+static bool lora_init_done = false;
+static bool lora_init_result = false;
+static at_tokenizer tokenizer;
+static char scratch[STRLEN];    // shared by loraMsg() and the debug prints, the LoRa code runs on one core at a time
+
+/* const: the table and its strings stay in flash */
+static const lorawan_item lorawan[] = {{AT_STRING("AT\r\n"), AT_STRING("+AT: OK"), STD_WAITING_TIME, NO_QUERY},
+                                       {AT_STRING("AT+MODE=LWOTAA\r\n"), AT_STRING("+MODE: LWOTAA"), STD_WAITING_TIME, AT_STRING("AT+MODE\r\n")},
+                                       {AT_STRING("AT+KEY=APPKEY,\"511F30D4D81E7B806536733DE7155FDE\"\r\n"), AT_STRING("+KEY: APPKEY 511F30D4D81E7B806536733DE7155FDE"), STD_WAITING_TIME, NO_QUERY},  // Gemma
+                                       //{AT_STRING("AT+KEY=APPKEY,\"83A228D811E594812D8735EDDCCE28D0\"\r\n"), AT_STRING("+KEY: APPKEY 83A228D811E594812D8735EDDCCE28D0"), STD_WAITING_TIME, NO_QUERY},  // Mong
+                                       //{AT_STRING("AT+KEY=APPKEY,\"3D036E4388F937105A649BA6B0AD6366\"\r\n"), AT_STRING("+KEY: APPKEY 3D036E4388F937105A649BA6B0AD6366"), STD_WAITING_TIME, NO_QUERY},  // Xuan
+                                       {AT_STRING("AT+CLASS=A\r\n"), AT_STRING("+CLASS: A"), STD_WAITING_TIME, AT_STRING("AT+CLASS\r\n")},
+                                       {AT_STRING("AT+PORT=8\r\n"), AT_STRING("+PORT: 8"), STD_WAITING_TIME, AT_STRING("AT+PORT\r\n")},
+                                       {AT_STRING("AT+ADR=OFF\r\n"), AT_STRING("+ADR: OFF"), STD_WAITING_TIME, AT_STRING("AT+ADR\r\n")},  // data rate is chosen by adr.c
+                                       {AT_STRING("AT+JOIN\r\n"), AT_STRING("+JOIN: Network joined"), MSG_WAITING_TIME, NO_QUERY}};
+
+static const at_string join_force = AT_STRING(JOIN_FORCE_COMMAND);
+static const at_string joined_already = AT_STRING(JOINED_ALREADY);
+
+#define BAUD_STRING(rate)  #rate
+#define BAUD_TEXT(rate)    BAUD_STRING(rate)
+
+static const at_string baud_command = AT_STRING("AT+UART=BR, " BAUD_TEXT(FAST_BAUD_RATE) "\r\n");
+static const at_string baud_retval = AT_STRING("+UART: BR, " BAUD_TEXT(FAST_BAUD_RATE));
+static const at_string reset_command = AT_STRING("AT+RESET\r\n");
+static const at_string reset_retval = AT_STRING("+RESET: OK");
+
+#define LORAWAN_ITEMS  ( sizeof(lorawan) / sizeof(lorawan[0]) )
+#define JOIN_INDEX     ( LORAWAN_ITEMS - 1 )
+
+static bool linkProbe(int speed);
+static bool linkFind();
+static void linkRaise();
+static int serialSend(const char *command, int length);
+static bool settingApplied(const int index);
+static void storeSetting(const int index);
+static bool loraJoin(bool force);
+static bool loraCommand(const at_string *command, const at_string *expect, uint32_t timeout_ms);
+static int awaitLine(const at_string *const *expect, int count, uint32_t timeout_ms);
+static int modemSend(const char *command);
+static int modemRead(uint8_t *buffer, int size);
+
+static const modem_io lora_modem = {.send = modemSend, .read = modemRead};
 
 //////////////////////////////////////////////////
 //              LORAWAN FUNCTIONS               //
 //////////////////////////////////////////////////
 
 /**********************************************************************************************************************
- * \brief: Initialises the uart and sets up lorawan communication
+ * \brief: Initialises the uart and sets up lorawan communication. Queries the current configuration of the module
+ *         first and only sends the settings that differ. The join is skipped if the module still holds a session.
  *
  * \param:
  *
  * \return: true: if connection established, false: if connection not established
  *
- * \remarks: Programmer should use this to initialize uart and lorawan communication.
+ * \remarks: Programmer should use this to initialize uart and lorawan communication. The module keeps its settings in
+ *           flash and its session over a reboot of the Pico, so after a watchdog reboot nothing is sent on air. The
+ *           link is raised to FAST_BAUD_RATE first, see linkRaise().
  **********************************************************************************************************************/
 bool loraInit() {
-    char return_message[STRLEN];
-    int lorawanState = 0;
+    bool settings_changed = false;
 
     uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE);
+    uart_rx_dma(UART_NR);
 
-    while (true) {
-        for (; lorawanState < (sizeof(lorawan)/sizeof(lorawan[0]) - 1); lorawanState++) {
-            if (false == retvalChecker(lorawanState)) {
-                return false;
-            }
+    if (false == linkFind()) {
+        DBG_PRINT("[0] command failed, exiting lora communication.\n");
+        metricsCount(MC_COMMAND_FAILURES);
+        return false;
+    }
+    linkRaise();
+    for (int lorawanState = 1; lorawanState < JOIN_INDEX; lorawanState++) {
+        if (true == settingApplied(lorawanState)) {
+            DBG_PRINT("Already set: %s\n", lorawan[lorawanState].retval.text);
+            continue;
         }
-        if (true == loraCommunication(lorawan[lorawanState].command, lorawan[lorawanState].sleep_time, return_message)) {
-            if (strstr(return_message, lorawan[lorawanState].retval) != NULL) {
-                DBG_PRINT("Comparison->same for: %s\n", return_message);
-                return true;
-            }
+        if (false == retvalChecker(lorawanState)) {
+            return false;
+        }
+        storeSetting(lorawanState);
+        settings_changed = true;
+    }
+    return loraJoin(settings_changed);
+}
+
+/**********************************************************************************************************************
+ * \brief: Starts the LoRaWAN initialisation on core 1, at boot and again for a rejoin after a failed one. The result
+ *         is collected with loraInitDone() or loraInitWait().
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Call from core 0 only, with core 1 not launched yet or reset by multicore_reset_core1(). Core 0 releases
+ *           the uart interrupts it took over from an earlier run, core 1 takes them in loraInitCore1().
+ **********************************************************************************************************************/
+void loraInitLaunch() {
+    if (true == lora_init_done) {
+        uart_irq_detach(UART_NR);
+    }
+    lora_init_done = false;
+    multicore_launch_core1(loraInitCore1);
+}
+
+/**********************************************************************************************************************
+ * \brief: Entry point of core 1 at multicore boot. Runs loraInit() up to LORA_INIT_ATTEMPTS times and hands the result
+ *         back to core 0 through the multicore FIFO.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Started by loraInitLaunch(). Uart interrupts are released before the result is pushed so that core 0 can
+ *           take them over in loraInitDone(). On a rejoin the uart is already set up and uart_setup() does not touch
+ *           the interrupts, so they are taken here.
+ **********************************************************************************************************************/
+void loraInitCore1() {
+    bool connected = false;
+
+    uart_irq_attach(UART_NR);
+    for (int attempt = 0; attempt < LORA_INIT_ATTEMPTS && false == connected; attempt++) {
+        connected = loraInit();
+    }
+    uart_irq_detach(UART_NR);
+    multicore_fifo_push_blocking(connected);
+}
+
+/**********************************************************************************************************************
+ * \brief: Checks without blocking if core 1 has finished the LoRaWAN initialisation. Takes over the uart interrupts on
+ *         the calling core when the result arrives.
+ *
+ * \param:
+ *
+ * \return: true: if the initialisation has finished, false: if core 1 is still working
+ *
+ * \remarks: Call from core 0 only.
+ **********************************************************************************************************************/
+bool loraInitDone() {
+    if (false == lora_init_done && multicore_fifo_rvalid()) {
+        lora_init_result = multicore_fifo_pop_blocking();
+        lora_init_done = true;
+        uart_irq_attach(UART_NR);
+    }
+    return lora_init_done;
+}
+
+/**********************************************************************************************************************
+ * \brief: Waits until core 1 has finished the LoRaWAN initialisation.
+ *
+ * \param:
+ *
+ * \return: true: if connection established, false: if connection not established
+ *
+ * \remarks: Call from core 0 only.
+ **********************************************************************************************************************/
+bool loraInitWait() {
+    while (false == loraInitDone()) {
+        tight_loop_contents();
+    }
+    return lora_init_result;
+}
+
+/**********************************************************************************************************************
+ * \brief: Sets the uart to a baud rate and checks that the module answers at it.
+ *
+ * \param: 1 parameter. Takes the baud rate.
+ *
+ * \return: true: if the module answered AT, false: otherwise
+ *
+ * \remarks: Bytes garbled by the change are dropped by loraCommand().
+ **********************************************************************************************************************/
+static bool linkProbe(int speed) {
+    uart_set_speed(UART_NR, speed);
+    return loraCommand(&lorawan[0].command, &lorawan[0].retval, lorawan[0].sleep_time);
+}
+
+/**********************************************************************************************************************
+ * \brief: Finds the baud rate the module answers at: BAUD_RATE, the rate after a reset to defaults, or FAST_BAUD_RATE
+ *         kept from an earlier negotiation over a reboot of the Pico.
+ *
+ * \param:
+ *
+ * \return: true: if the module answered, the uart is left at its rate, false: if it answered at neither
+ *
+ * \remarks: Called by loraInit() on every attempt, so a module that has been reset is found again.
+ **********************************************************************************************************************/
+static bool linkFind() {
+    return linkProbe(BAUD_RATE) || linkProbe(FAST_BAUD_RATE);
+}
+
+/**********************************************************************************************************************
+ * \brief: Raises the link to FAST_BAUD_RATE with AT+UART=BR. Newer firmware of the module changes the rate at once,
+ *         older only after a reset, so the module is reset if it still answers at the old rate.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Called by loraInit() once the module answers. On any error the link falls back to the rate the module
+ *           answers at, BAUD_RATE unless the change has taken effect. The module keeps the rate in flash, so this
+ *           costs a reset at most once per module.
+ **********************************************************************************************************************/
+static void linkRaise() {
+    if (FAST_BAUD_RATE == uart_get_handle(UART_NR)->speed) {
+        return;
+    }
+    DBG_PRINT("Serial time of %d bytes at %d baud: %u us\n", SERIAL_SAMPLE_BYTES, BAUD_RATE,
+              loraSerialTimeUs(SERIAL_SAMPLE_BYTES));
+    bool raised = false;
+    if (true == loraCommand(&baud_command, &baud_retval, STD_WAITING_TIME)) {
+        raised = linkProbe(FAST_BAUD_RATE);
+        if (false == raised && true == linkProbe(BAUD_RATE) &&
+            true == loraCommand(&reset_command, &reset_retval, STD_WAITING_TIME)) {
+            sleep_ms(LORA_RESET_TIME);
+            raised = linkProbe(FAST_BAUD_RATE);
         }
+    }
+    if (true == raised) {
+        DBG_PRINT("Link raised to %d baud: %u us\n", FAST_BAUD_RATE, loraSerialTimeUs(SERIAL_SAMPLE_BYTES));
+        return;
+    }
+    DBG_PRINT("Baud rate not raised, staying at %d baud.\n", BAUD_RATE);
+    linkFind();
+}
+
+/**********************************************************************************************************************
+ * \brief: Checks if a setting is already in effect on the module. Readable settings are queried from the module,
+ *         write only settings (APPKEY) are compared against the CRC stored to EEPROM when they were last applied.
+ *
+ * \param: 1 parameter. Takes the index of the struct element.
+ *
+ * \return: true: if the setting is in effect, false: if the setting has to be sent
+ *
+ * \remarks: Called by loraInit().
+ **********************************************************************************************************************/
+static bool settingApplied(const int index) {
+    if (NULL != lorawan[index].query.text) {
+        return loraCommand(&lorawan[index].query, &lorawan[index].retval, lorawan[index].sleep_time);
+    }
+
+    loraSettings settings;
+    const at_string *command = &lorawan[index].command;
+    return readRecord(LORA_SETTINGS_ADDRESS, &settings, sizeof(settings)) &&
+           settings.appkeyCrc == crc16((const uint8_t *) command->text, command->length);
+}
+
+/**********************************************************************************************************************
+ * \brief: Stores the CRC of an applied write only setting to EEPROM.
+ *
+ * \param: 1 parameter. Takes the index of the struct element.
+ *
+ * \return:
+ *
+ * \remarks: Called by loraInit(). Readable settings are not stored.
+ **********************************************************************************************************************/
+static void storeSetting(const int index) {
+    if (NULL != lorawan[index].query.text) {
+        return;
+    }
+    const at_string *command = &lorawan[index].command;
+    loraSettings settings = {.appkeyCrc = crc16((const uint8_t *) command->text, command->length)};
+    writeRecord(LORA_SETTINGS_ADDRESS, &settings, sizeof(settings));
+}
+
+/**********************************************************************************************************************
+ * \brief: Joins the network. A module that still holds a session answers at once that it is joined already, otherwise
+ *         the join procedure is waited for.
+ *
+ * \param: 1 parameter. true: forces a new join because the settings have changed.
+ *
+ * \return: true: if joined, false: if join failed
+ *
+ * \remarks: Called by loraInit(). A failed join forgets the stored settings, so the next attempt sends all of them.
+ **********************************************************************************************************************/
+static bool loraJoin(bool force) {
+    const lorawan_item *join = &lorawan[JOIN_INDEX];
+    const at_string *expect[] = {&join->retval, &joined_already};
+
+    metricsCount(MC_JOINS);
+    loraCommand(force ? &join_force : &join->command, NULL, 0);
+    switch (awaitLine(expect, 2, join->sleep_time)) {
+        case 0:
+            DBG_PRINT("Comparison->same for: %s\n", join->retval.text);
+            return true;
+        case 1:
+            DBG_PRINT("Session still valid, join skipped.\n");
+            return true;
+    }
+    metricsCount(MC_JOIN_FAILURES);
+    eraseRecord(LORA_SETTINGS_ADDRESS, sizeof(loraSettings));
+    return false;
+}
+
+/**********************************************************************************************************************
+ * \brief: Sends a command and waits for its response. Responses left over from earlier commands are discarded first.
+ *
+ * \param: 3 parameters. Takes the command, the expected response line without line ending and the longest time to
+ *         wait for it in ms. A NULL response only sends the command.
+ *
+ * \return: true: if the expected line arrived, false: on an error response, timeout or if the command was not sent
+ *
+ * \remarks: Returns as soon as the expected line arrives, the timeout is not slept through.
+ **********************************************************************************************************************/
+static bool loraCommand(const at_string *command, const at_string *expect, uint32_t timeout_ms) {
+    ring_buffer *rx = uart_rx_ring(UART_NR);
+
+    rb_drop(rx, rb_count(rx));
+    atTokenizerReset(&tokenizer);
+    if (0 == serialSend(command->text, command->length)) {
         return false;
     }
+    return NULL == expect || 0 == awaitLine(&expect, 1, timeout_ms);
+}
+
+/**********************************************************************************************************************
+ * \brief: Waits for one of the expected lines. The lines are tokenized in the uart ring buffer as they arrive and
+ *         compared there, lines that do not match are dropped.
+ *
+ * \param: 3 parameters. Takes the expected lines without line ending, their count and the longest time to wait in ms.
+ *
+ * \return: index of the expected line that arrived, -1 on an error response or timeout
+ *
+ * \remarks: Progress lines (LINE_URC) do not end the wait, so multi-line responses are handled. The received bytes
+ *           are tokenized when the line has gone idle, i.e. once per response instead of once per poll, or when the
+ *           ring buffer is half full. In between the core sleeps in uart_rx_wait().
+ **********************************************************************************************************************/
+static int awaitLine(const at_string *const *expect, int count, uint32_t timeout_ms) {
+    absolute_time_t deadline = make_timeout_time_ms(timeout_ms);
+    at_line line;
+
+    do {
+        ring_buffer *rx = uart_rx_ring(UART_NR);
+        if (false == uart_rx_idle(UART_NR) && rb_count(rx) < rx->size / 2) {
+            continue;
+        }
+        while (true == atNextLine(&tokenizer, rx, &line)) {
+            for (int i = 0; i < count; i++) {
+                if (true == atLineEquals(rx, &line, expect[i]->text, expect[i]->length)) {
+                    atLineDrop(&tokenizer, rx, &line);
+                    return i;
+                }
+            }
+#ifdef DEBUG_PRINT
+            atLineCopy(rx, &line, scratch, sizeof(scratch));
+            DBG_STRING("Comparison->no match: %s\n", scratch);
+#endif
+            atLineDrop(&tokenizer, rx, &line);
+            if (LINE_ERROR == line.type) {
+                return -1;
+            }
+        }
+    } while (true == uart_rx_wait(UART_NR, deadline));
+    return -1;
 }
 
 /**********************************************************************************************************************
  * \brief: Communicates with uart.
  *
- * \param: 3 parameters. Takes the command to be sent, the sleep time to wait before read and the string to read the
- *         returned message to.
+ * \param: 3 parameters. Takes the command to be sent, the longest time to wait for the response in ms and the string
+ *         to read the returned message to.
  *
- * \return: true: if uart responses, false: if uart does not response
+ * \return: true: if uart responses, false: if uart does not response or the command was not sent
  *
- * \remarks: Called by loraInit(), loraMsg(), retvalChecker(). Can be used directly from main().
+ * \remarks: Called by loraMsg(). Can be used directly from main() to see the raw response. Returns with the line that
+ *           ends the response: OK, Done, an error or the value of a setting. Progress lines are read on, at the
+ *           timeout the bytes received so far are returned.
  **********************************************************************************************************************/
 bool loraCommunication(const char* command, const uint sleep_time, char* str) {
-    uart_send(uart_nr, command);
-    sleep_ms(sleep_time);
-    int pos = uart_read(UART_NR, (uint8_t *) str, STRLEN - 1);
+    absolute_time_t deadline = make_timeout_time_ms(sleep_time);
+    int pos = 0;
+
+    if (0 == serialSend(command, (int) strlen(command))) {
+        return false;
+    }
+    while (pos < STRLEN - 1) {
+        int count = uart_read_until(UART_NR, (uint8_t *) &str[pos], STRLEN - 1 - pos, '\n', deadline);
+        if (0 == count) {
+            pos += uart_read(UART_NR, (uint8_t *) &str[pos], STRLEN - 1 - pos);
+            break;
+        }
+        int length = count;
+        while (length > 0 && ('\n' == str[pos + length - 1] || '\r' == str[pos + length - 1])) {
+            length--;
+        }
+        enum LineClass type = atClassify(&str[pos], length);
+        pos += count;
+        if (LINE_OK == type || LINE_ERROR == type || LINE_VALUE == type) {
+            break;
+        }
+    }
     if (pos > 0) {
         str[pos] = '\0';
         return true;
@@ -89,24 +432,37 @@ bool loraCommunication(const char* command, const uint sleep_time, char* str) {
  *
  * \return: true: if uart responses, false: if uart does not response
  *
- * \remarks: Programmer should use this to send message.
+ * \remarks: Programmer should use this to send message. Sleeps until the duty cycle budget allows the uplink.
  **********************************************************************************************************************/
 bool loraMsg(const char* message, size_t msg_size, char* return_message) {
 
-    const char start_tag[] = "AT+MSG=\"";
-    const char end_tag[] = "\"\r\n";
-    char lorawan_message[STRLEN];
+    static const at_string start_tag = AT_STRING("AT+MSG=\"");
+    static const at_string end_tag = AT_STRING("\"\r\n");
+
+    if (msg_size > STRLEN - start_tag.length - end_tag.length - 1) {
+        return false;
+    }
+
+    memcpy(scratch, start_tag.text, start_tag.length);
+    memcpy(&scratch[start_tag.length], message, msg_size);
+    memcpy(&scratch[start_tag.length + msg_size], end_tag.text, end_tag.length + 1);
+    //printf("%s", scratch);
 
-    if (msg_size > STRLEN-strlen(start_tag)-strlen(end_tag)-1) {
+    uint32_t airtime = uplinkAirtimeUs(uplinkDataRate(), msg_size);
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    uint32_t delay = dutyCycleDelay(airtime, now);
+    if (DUTY_CYCLE_NEVER == delay) {
+        DBG_PRINT("Message does not fit in duty cycle budget at DR%d.\n", uplinkDataRate());
         return false;
     }
+    if (0 != delay) {
+        DBG_PRINT("Duty cycle: uplink deferred by %u ms.\n", delay);
+        sleep_ms(delay);
+        now += delay;
+    }
+    dutyCycleConsume(airtime, now);
 
-    strcpy(lorawan_message, start_tag);
-    strncpy(&lorawan_message[strlen(start_tag)], message, STRLEN-strlen(start_tag)-strlen(end_tag)-1);
-    strcat(lorawan_message, end_tag);
-    lorawan_message[STRLEN-1] = '\0';
-    //printf("%s", lorawan_message);
-    if(true == loraCommunication(lorawan_message, MSG_WAITING_TIME, return_message)) {
+    if(true == loraCommunication(scratch, MSG_WAITING_TIME, return_message)) {
         return true;
     } else {
         return false;
@@ -114,28 +470,92 @@ bool loraMsg(const char* message, size_t msg_size, char* return_message) {
 }
 
 /**********************************************************************************************************************
- * \brief: Calls loraCommunication and compares the returned value with the value in case of success.
+ * \brief: Returns the interface the uplink queue uses to talk to the LoRa module over the uart.
+ *
+ * \param:
+ *
+ * \return: pointer to the modem interface.
+ *
+ * \remarks: Pass to uplinkInit(). The uart is set up by loraInit().
+ **********************************************************************************************************************/
+const modem_io *loraModem() {
+    return &lora_modem;
+}
+
+static int modemSend(const char *command) {
+    return serialSend(command, (int) strlen(command));
+}
+
+/**********************************************************************************************************************
+ * \brief: Time a number of bytes takes on the link to the module at its current baud rate: a start bit, 8 data bits
+ *         and a stop bit each.
+ *
+ * \param: 1 parameter. Takes the number of bytes.
+ *
+ * \return: time in us
+ *
+ * \remarks: 0 before the uart is set up.
+ **********************************************************************************************************************/
+uint32_t loraSerialTimeUs(int bytes) {
+    int speed = uart_get_handle(UART_NR)->speed;
+    if (0 == speed) {
+        return 0;
+    }
+    return (uint32_t) ((uint64_t) bytes * 10 * 1000000 / speed);
+}
+
+/**********************************************************************************************************************
+ * \brief: Sends a command to the module and records the time it takes on the serial link in MH_SERIAL.
+ *
+ * \param: 2 parameters. Takes the command and its length.
+ *
+ * \return: bytes sent, 0 if UART_TX_DESCRIPTORS writes were still waiting after SERIAL_SEND_TIMEOUT ms
+ *
+ * \remarks: All commands go through here, so the histogram shows the cost of each before and after the rate is
+ *           raised. Every command is sent from where it is by uart_write_ref(), none is truncated in a partly full
+ *           TX ring. The time from queuing the command until it is in the transmit FIFO is measured, so the caller
+ *           may reuse a buffer in RAM after the return. Constants stay in flash. A command that is not sent is counted
+ *           in the tx_dropped of the uart, the callers do not wait for its response.
+ **********************************************************************************************************************/
+static int serialSend(const char *command, int length) {
+    uint32_t ticket;
+    uint32_t start = time_us_32();
+    absolute_time_t deadline = make_timeout_time_ms(SERIAL_SEND_TIMEOUT);
+
+    while (false == uart_tx_ready(uart_nr) && false == time_reached(deadline)) {
+        best_effort_wfe_or_timeout(deadline);
+    }
+    if (false == uart_write_ref(uart_nr, (const uint8_t *) command, length, &ticket)) {
+        DBG_PRINT("No uart TX descriptor for %d bytes\n", length);
+        return 0;
+    }
+    while (false == uart_tx_done(uart_nr, ticket)) {
+        // each uart interrupt wakes the wait
+        best_effort_wfe_or_timeout(make_timeout_time_ms(1));
+    }
+    metricsRecord(MH_SERIAL, (int32_t) (time_us_32() - start));
+    return length;
+}
+
+static int modemRead(uint8_t *buffer, int size) {
+    return uart_read(uart_nr, buffer, size);
+}
+
+/**********************************************************************************************************************
+ * \brief: Sends the command of a struct element and waits for the response expected in case of success.
  *
  * \param: 1 parameter. Takes the index of the struct element.
  *
- * \return: true: if compared strings are the same, false: if compared strings are not the same
+ * \return: true: if the expected response arrived, false: on an error response or if sleep_time passed without it
  *
  * \remarks: Called by loraInit(). Programmer should not use this function.
  **********************************************************************************************************************/
 bool retvalChecker(const int index) {
-    char return_message[STRLEN];
-
-    if (true == loraCommunication(lorawan[index].command, lorawan[index].sleep_time, return_message)) {
-        if (strcmp(lorawan[index].retval, return_message) == 0) {
-            DBG_PRINT("Comparison->same for: %s\n", return_message);
-            return true;
-        } else {
-            DBG_PRINT("Comparison->no match, return_message: %s lorawan[%d].retval: %s\n", return_message, index, lorawan[index].retval);
-            DBG_PRINT("Exiting lora communication.\n");
-            return false;
-        }
-    } else {
-        DBG_PRINT("[%d] command failed, exiting lora communication.\n", index);
-        return false;
+    if (true == loraCommand(&lorawan[index].command, &lorawan[index].retval, lorawan[index].sleep_time)) {
+        DBG_PRINT("Comparison->same for: %s\n", lorawan[index].retval.text);
+        return true;
     }
+    DBG_PRINT("[%d] command failed, exiting lora communication.\n", index);
+    metricsCount(MC_COMMAND_FAILURES);
+    return false;
 }
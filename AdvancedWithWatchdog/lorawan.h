@@ -1,6 +1,8 @@
 #ifndef LORAWAN
 #define LORAWAN
 
+#include "uplink.h"
+
 #if 0
 #define UART_NR 0
 #define UART_TX_PIN 0
@@ -11,22 +13,53 @@
 #define UART_RX_PIN 5
 #endif
 
-#define BAUD_RATE 9600
+#define BAUD_RATE 9600                       // default of the module, every link starts here
+#define FAST_BAUD_RATE 115200                // negotiated with AT+UART=BR once the module answers
+#define LORA_RESET_TIME 1000                 // ms for the module to boot after AT+RESET
+#define SERIAL_SAMPLE_BYTES 60               // a typical AT+MSG line, its serial time is printed before and after
+#define SERIAL_SEND_TIMEOUT 250              // ms to wait for a free uart TX descriptor, a STRLEN command takes 133
 
 #define STD_WAITING_TIME 500
 #define MSG_WAITING_TIME 10000
 
+#define LORA_INIT_ATTEMPTS 3
+
+#define JOIN_FORCE_COMMAND "AT+JOIN=FORCE\r\n"
+#define JOINED_ALREADY "+JOIN: Joined already"
+
 #define STRLEN 128
 
+/* Constant string and its length, so that nothing has to be copied or measured at run time */
+typedef struct at_string_ {
+    const char *text;
+    uint8_t length;
+} at_string;
+
+#define AT_STRING(literal)  { (literal), sizeof(literal) - 1 }
+#define NO_QUERY            { NULL, 0 }
+
 typedef struct lorawan_item_ {
-    char command[STRLEN];
-    char retval[STRLEN];
-    uint sleep_time;
+    at_string command;
+    at_string retval;       // expected response line, without line ending
+    uint16_t sleep_time;    // longest wait for the response
+    at_string query;        // reads the setting back, NO_QUERY if the module cannot report it
 } lorawan_item;
 
+/* Settings the module cannot report back, stored to EEPROM once applied */
+typedef struct __attribute__((__packed__)) loraSettings {
+    uint16_t appkeyCrc;
+    uint16_t crc16;
+} loraSettings;
+
 bool loraInit();
+void loraInitLaunch();
+void loraInitCore1();
+bool loraInitDone();
+bool loraInitWait();
 bool loraCommunication(const char* command, const uint sleep_time, char* str);
 bool loraMsg(const char* message, size_t msg_size, char* return_message);
 bool retvalChecker(const int index);
+uint32_t loraSerialTimeUs(int bytes);
+const modem_io *loraModem();
 
 #endif
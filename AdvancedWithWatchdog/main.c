@@ -3,6 +3,7 @@
 #include <ctype.h>
 #include "pico/stdlib.h"
 #include "pico/time.h"
+#include "pico/multicore.h"
 #include "hardware/gpio.h"
 
 #include "led.h"
@@ -12,27 +13,51 @@
 #include "eeprom.h"
 #include "steppermotor.h" // includes stepper motor, optofork and piezo related codes
 #include "watchdog.h"
+#include "downlink.h"
+#include "config.h"
+#include "adr.h"
+#include "airtime.h"
+#include "memory.h"
+#include "metrics.h"
+#include "fragment.h"
+#include "debuglog.h"
+#include "messages.h"
 
 #ifdef DEBUG_PRINT
-#define DBG_PRINT(f_, ...)  printf((f_), ##__VA_ARGS__)
+#define DBG_PRINT(f_, ...)  debugLog((f_), ##__VA_ARGS__)
+#define DBG_STRING(f_, s_)  debugLogString((f_), (s_))
 #else
 #define DBG_PRINT(f_, ...)
+#define DBG_STRING(f_, s_)
 #endif
 
 //#define DEBUG
 #ifdef DEBUG
-#define COMPARTMENT_TIME  ( SLEEP_BETWEEN / 6 )
+#define DEFAULT_COMPARTMENT_TIME  ( SLEEP_BETWEEN / 6 )
 #else
-#define COMPARTMENT_TIME  ( SLEEP_BETWEEN )
+#define DEFAULT_COMPARTMENT_TIME  ( SLEEP_BETWEEN )
 #endif
 
+/* Can be changed over the downlink command channel */
+#define COMPARTMENT_TIME  ( configGet()->dispenseInterval )
+
 #define LORAWAN_CONN
 
-#ifdef LORAWAN_CONN
-#define LORAWAN_COMM_TIME  ( MSG_WAITING_TIME )
-#else
-#define LORAWAN_COMM_TIME  ( 0 )
-#endif
+/* Joins LoRaWAN on core 1 while core 0 reads EEPROM and calibrates */
+#define MULTICORE_BOOT
+
+#define POLL_PERIOD 10
+
+/* Priority of the messages of eepromLorawanComm() */
+enum MessagePriority {
+    ROUTINE,
+    ALERT
+};
+
+#define HEALTH_INTERVAL 86400000             // ms between health uplinks, the first one is sent after the join
+#define METRICS_SAVE_INTERVAL 3600000        // ms between metrics writes to EEPROM
+#define JOIN_RETRY_MIN 60000                 // ms from a failed join to the next one, doubled after each failure
+#define JOIN_RETRY_MAX 3600000
 
 /////////////////////////////////////////////////////
 //             FUNCTION DECLARATIONS               //
@@ -42,7 +67,15 @@ bool repeatingTimerCallback(struct repeating_timer *t);
 bool blinkTimerCallback(struct repeating_timer *t);
 void resetValues();
 void dispensePills();
-void eepromLorawanComm(const char* message, size_t msg_size);
+void eepromLorawanComm(const char* message, size_t msg_size, enum MessagePriority priority);
+void loraPoll();
+void startJoin();
+void pollingSleep(uint32_t ms);
+void handleDownlink();
+void startLogDump();
+void continueLogDump();
+void reportHealth();
+void collectUartStats();
 void noDetectBlink();
 
 /////////////////////////////////////////////////////
@@ -53,23 +86,18 @@ static volatile bool sw0_buttonEvent = false;
 static volatile bool sw2_buttonEvent = false;
 
 static bool lora_connected = false;
-
-static char retval_str[STRLEN];
+static bool join_running = false;            // core 1 is joining, its result has not been collected
+static uint32_t next_join_ms = 0;
+static uint32_t join_backoff_ms = JOIN_RETRY_MIN;
+static bool recalibrate_request = false;
+static uint32_t next_health_ms = 0;
+static uint32_t next_metrics_save_ms = METRICS_SAVE_INTERVAL;
 
 extern int calibration_count;
 extern bool calibrated;
 extern bool pill_detected;
 extern bool fallingEdge;
 
-static const char *fixed_msg[8] = {"Clean boot.",
-                                   "Calibrated. Waiting for button to dispense pills.",
-                                   "Powered off during dispense. Motor was not turning.",
-                                   "Powered off during dispense. Motor was turning.",
-                                   "All pills dispensed. Waiting for button to calibrate.",
-                                   "Booted after calibration. Waiting for button to dispense.",
-                                   "Waiting for button to calibrate.",
-                                   "Reboot by Watchdog."};
-
 /////////////////////////////////////////////////////
 //                     STRUCT                      //
 /////////////////////////////////////////////////////
@@ -93,7 +121,9 @@ static uint32_t blink_counter;
 
 int main(void) {
 
+    stackPaintCore0();
     stdio_init_all();
+    debugLogInit();
     ledsInit();
     buttonsInit();
     pwmInit();
@@ -101,19 +131,33 @@ int main(void) {
     optoforkInit();
     piezoInit();
     i2cInit();
+    configLoad(DEFAULT_COMPARTMENT_TIME);
+    adrPin(configGet()->dataRate);
+    readMetrics(metricsGet());
+    metricsCount(MC_BOOTS);
+    writeMetrics(metricsGet());
+    fragmentSeed(metricsGet()->counters.count[MC_BOOTS]);
 
     //eraseAll(); /* Deletes all data from eeprom from log area */
 
 #ifdef LORAWAN_CONN
+    uplinkInit(loraModem(), time_us_32());
+    uplinkLowPower(true);
+#ifdef MULTICORE_BOOT
+    /* Initializes lorawan on core 1, the result is collected by loraPoll() */
+    startJoin();
+#else
     /* Initializes lorawan */
     /*
     while (!lora_connected) {
         lora_connected = loraInit();
     }*/
 #endif
+#endif
 
 #if 0
     /* to set the uart TIMEOUT value: */
+    char retval_str[STRLEN];
     if (true == loraCommunication("AT+UART=TIMEOUT,0\r\n", STD_WAITING_TIME, retval_str)) {
         printf("%s\n",retval_str);
     }
@@ -127,11 +171,11 @@ int main(void) {
     if (readStruct(&machine)) {
         if (machine.currentState == CALIB_WAITING) {
             if (watchdog_caused_reboot()) {
-                eepromLorawanComm(fixed_msg[7], strlen(fixed_msg[7]));
+                eepromLorawanComm(fixed_msg[7], strlen(fixed_msg[7]), ALERT);
             } else {
-                eepromLorawanComm(fixed_msg[0], strlen(fixed_msg[0]));
+                eepromLorawanComm(fixed_msg[0], strlen(fixed_msg[0]), ROUTINE);
             }
-            eepromLorawanComm(fixed_msg[6], strlen(fixed_msg[6]));
+            eepromLorawanComm(fixed_msg[6], strlen(fixed_msg[6]), ROUTINE);
         }
         if (machine.currentState == DISPENSE_WAITING) {
             calibration_count = machine.calibrationCount;
@@ -140,20 +184,20 @@ int main(void) {
             allLedsOff();
 
             if (watchdog_caused_reboot()) {
-                eepromLorawanComm(fixed_msg[7], strlen(fixed_msg[7]));
+                eepromLorawanComm(fixed_msg[7], strlen(fixed_msg[7]), ALERT);
             } else {
-                eepromLorawanComm(fixed_msg[0], strlen(fixed_msg[0]));
+                eepromLorawanComm(fixed_msg[0], strlen(fixed_msg[0]), ROUTINE);
             }
 
             switch (machine.compartmentFinished) {
                 case IN_THE_MIDDLE:
 
                     if (0 != machine.compartmentsMoved) {
-                        eepromLorawanComm(fixed_msg[3], strlen(fixed_msg[3]));
+                        eepromLorawanComm(fixed_msg[3], strlen(fixed_msg[3]), ALERT);
                     }
 
                     realignMotor();
-                    sleep_ms(COMPARTMENT_TIME);
+                    pollingSleep(COMPARTMENT_TIME);
                     machine.compartmentFinished = FINISHED;
                     writeStruct(&machine);
                     dispensePills();
@@ -163,14 +207,14 @@ int main(void) {
                     break;
                 case FINISHED:
                     if (0 == machine.compartmentsMoved) {
-                        eepromLorawanComm(fixed_msg[5], strlen(fixed_msg[5]));
+                        eepromLorawanComm(fixed_msg[5], strlen(fixed_msg[5]), ROUTINE);
                         machine.compartmentsMoved = 1;
                         allLedsOn();
                         break;
                     } else {
                         machine.compartmentsMoved++;
-                        eepromLorawanComm(fixed_msg[2], strlen(fixed_msg[2]));
-                        sleep_ms(COMPARTMENT_TIME);
+                        eepromLorawanComm(fixed_msg[2], strlen(fixed_msg[2]), ALERT);
+                        pollingSleep(COMPARTMENT_TIME);
                         dispensePills();
                         printLog();
                         resetValues();
@@ -181,16 +225,31 @@ int main(void) {
         }
     } else {
         if (watchdog_caused_reboot()) {
-            eepromLorawanComm(fixed_msg[7], strlen(fixed_msg[7]));
+            eepromLorawanComm(fixed_msg[7], strlen(fixed_msg[7]), ALERT);
         } else {
-            eepromLorawanComm(fixed_msg[0], strlen(fixed_msg[0]));
+            eepromLorawanComm(fixed_msg[0], strlen(fixed_msg[0]), ROUTINE);
         }
-        eepromLorawanComm(fixed_msg[6], strlen(fixed_msg[6]));
+        eepromLorawanComm(fixed_msg[6], strlen(fixed_msg[6]), ROUTINE);
     }
 
     watchdogInit(20);
 
     while(true) {
+        if (true == recalibrate_request) {
+            recalibrate_request = false;
+            switch (machine.currentState) {
+                case CALIB_WAITING:
+                    sw0_buttonEvent = true;
+                    break;
+                case DISPENSE_WAITING:
+                    calibrateMotor();
+                    allLedsOn();
+                    machine.calibrationCount = calibration_count;
+                    eepromLorawanComm(fixed_msg[1], strlen(fixed_msg[1]), ROUTINE);
+                    break;
+            }
+        }
+
         if (true == sw0_buttonEvent) {
             sw0_buttonEvent = false;
             switch (machine.currentState) {
@@ -200,7 +259,7 @@ int main(void) {
                     machine.currentState = DISPENSE_WAITING;
                     machine.calibrationCount = calibration_count;
                     machine.compartmentFinished = 1;
-                    eepromLorawanComm(fixed_msg[1], strlen(fixed_msg[1]));
+                    eepromLorawanComm(fixed_msg[1], strlen(fixed_msg[1]), ROUTINE);
                     break;
                 case DISPENSE_WAITING:
                     break;
@@ -224,6 +283,7 @@ int main(void) {
         if (CALIB_WAITING == machine.currentState) {
             blink();
         }
+        loraPoll();
     }
     return 0;
 }
@@ -342,18 +402,18 @@ void dispensePills() {
 
         if (true == pill_dispensed) {
             sprintf(dispensed_msg, "Day %d: Pill dispensed. Number of pills left: %d.", (const char *) machine.compartmentsMoved, COMPARTMENTS - machine.compartmentsMoved - 1);
-            eepromLorawanComm(dispensed_msg, strlen(dispensed_msg));
+            eepromLorawanComm(dispensed_msg, strlen(dispensed_msg), ROUTINE);
         } else {
             noDetectBlink();
             sprintf(dispensed_msg, "Day %d: Pill not dispensed. Number of pills left: %d.", (const char *) machine.compartmentsMoved, COMPARTMENTS - machine.compartmentsMoved - 1);
-            eepromLorawanComm(dispensed_msg, strlen(dispensed_msg));
+            eepromLorawanComm(dispensed_msg, strlen(dispensed_msg), ALERT);
         }
 
         if ((COMPARTMENTS - 1) > machine.compartmentsMoved) {
-            sleep_ms(COMPARTMENT_TIME - I2C_MEM_WRITE_TIME - LORAWAN_COMM_TIME);
+            pollingSleep(COMPARTMENT_TIME - I2C_MEM_WRITE_TIME);
         } else {
-            eepromLorawanComm(fixed_msg[4], strlen(fixed_msg[4]));
-            sleep_ms(MSG_WAITING_TIME);
+            eepromLorawanComm(fixed_msg[4], strlen(fixed_msg[4]), ALERT);
+            pollingSleep(MSG_WAITING_TIME);
         }
     }
 }
@@ -377,24 +437,252 @@ void resetValues() {
 }
 
 /**********************************************************************************************************************
- * \brief: Transmits passed message to EEPROM as a log message and also via LoRaWAN to the network. Updates the struct
- *         to EEPROM.
+ * \brief: Transmits passed message to EEPROM as a log message and queues it for LoRaWAN transmission to the network.
+ *         Updates the struct to EEPROM.
  *
- * \param: 2 params: pointer to a const char message and its length as size_t type.
+ * \param: 3 params: pointer to a const char message, its length as size_t type and its priority. An ALERT must reach the
+ *         server: it is sent before any routine message and retried until the network acknowledges it. ROUTINE
+ *         messages are sent unconfirmed and may be joined into one uplink.
  *
  * \return:
  *
- * \remarks:
+ * \remarks: Does not wait for the transmission, the queue is served by loraPoll().
  **********************************************************************************************************************/
-void eepromLorawanComm(const char* message, size_t msg_size) {
-    DBG_PRINT("%s\n", message);
+void eepromLorawanComm(const char* message, size_t msg_size, enum MessagePriority priority) {
+    DBG_STRING("%s\n", message);
     writeLogEntry(message);
     writeStruct(&machine);
 #ifdef LORAWAN_CONN
-    loraMsg(message, msg_size, retval_str);
+    uplinkEnqueue((const uint8_t *) message, msg_size, ALERT == priority ? UPLINK_CONFIRMED | UPLINK_ALERT : 0,
+                  to_ms_since_boot(get_absolute_time()));
+    loraPoll();
+#endif
+}
+
+/**********************************************************************************************************************
+ * \brief: Starts the LoRaWAN join on core 1.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: The result is collected by loraPoll(). Core 1 is reset first, after a failed join it is still parked
+ *           where loraInitCore1() returned to, and its stack is painted only once it no longer runs.
+ **********************************************************************************************************************/
+void startJoin() {
+    multicore_reset_core1();
+    stackPaintCore1();
+    loraInitLaunch();
+    join_running = true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Serves the uplink queue once the network has been joined and sends the waiting debug output.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Never blocks. With MULTICORE_BOOT, collects the join result from core 1 when it becomes available. After a
+ *           failed join it starts another one on core 1, JOIN_RETRY_MIN later at first and up to JOIN_RETRY_MAX later
+ *           after repeated failures, so messages queued meanwhile are sent once the network is back.
+ **********************************************************************************************************************/
+void loraPoll() {
+    debugLogDrain();
+#ifdef LORAWAN_CONN
+#ifdef MULTICORE_BOOT
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    if (true == join_running && true == loraInitDone()) {
+        join_running = false;
+        lora_connected = loraInitWait();
+        memoryReport();
+        if (false == lora_connected) {
+            DBG_PRINT("Join failed, next attempt in %u s.\n", join_backoff_ms / 1000);
+            next_join_ms = now_ms + join_backoff_ms;
+            join_backoff_ms = join_backoff_ms < JOIN_RETRY_MAX / 2 ? join_backoff_ms * 2 : JOIN_RETRY_MAX;
+        }
+    } else if (false == lora_connected && false == join_running && (int32_t) (now_ms - next_join_ms) >= 0) {
+        startJoin();
+    }
+#endif
+    if (true == lora_connected) {
+        uplinkPoll(to_ms_since_boot(get_absolute_time()));
+        handleDownlink();
+        continueLogDump();
+        reportHealth();
+    }
 #endif
 }
 
+/**********************************************************************************************************************
+ * \brief: Executes a command received on the downlink command channel. The first payload byte selects the command,
+ *         see enum DownlinkCommand. Settings are stored to EEPROM and survive a reboot.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Called from loraPoll(), also during the dispense sequence. A new interval applies from the next wait
+ *           between compartments, recalibration waits for the main loop.
+ **********************************************************************************************************************/
+void handleDownlink() {
+    downlink dl;
+    if (false == downlinkTake(&dl) || DOWNLINK_PORT != dl.port || 0 == dl.length) {
+        return;
+    }
+
+    deviceConfig config = *configGet();
+    switch (dl.payload[0]) {
+        case DL_SET_INTERVAL:
+            if (5 == dl.length) {
+                uint32_t seconds = (uint32_t) dl.payload[1] << 24 | (uint32_t) dl.payload[2] << 16 |
+                                   (uint32_t) dl.payload[3] << 8 | dl.payload[4];
+                if (seconds >= MIN_DISPENSE_INTERVAL / 1000 && seconds <= MAX_DISPENSE_INTERVAL / 1000) {
+                    config.dispenseInterval = seconds * 1000;
+                    configUpdate(&config);
+                    DBG_PRINT("Dispense interval set to %u s.\n", seconds);
+                    return;
+                }
+            }
+            break;
+        case DL_LOG_DUMP:
+            if (1 == dl.length) {
+                startLogDump();
+                return;
+            }
+            break;
+        case DL_RECALIBRATE:
+            if (1 == dl.length) {
+                recalibrate_request = true;
+                return;
+            }
+            break;
+        case DL_SET_DATA_RATE:
+            if (2 == dl.length && (0xFF == dl.payload[1] || dl.payload[1] < LORA_DR_COUNT)) {
+                config.dataRate = 0xFF == dl.payload[1] ? ADR_AUTO : dl.payload[1];
+                configUpdate(&config);
+                adrPin(config.dataRate);
+                DBG_PRINT("Data rate set to %d.\n", config.dataRate);
+                return;
+            }
+            break;
+    }
+    DBG_PRINT("Invalid downlink command.\n");
+}
+
+/**********************************************************************************************************************
+ * \brief: Reads the log messages from EEPROM into one long message, each ended by a newline, to be sent in fragments.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Ignored while a previous dump is still being sent.
+ **********************************************************************************************************************/
+void startLogDump() {
+    char message[MAX_LOG_SIZE];
+
+    if (true == fragmentBusy()) {
+        return;
+    }
+    fragmentBegin();
+    for (int i = 0; true == readLogEntry(i, message); i++) {
+        size_t length = strlen(message);
+        message[length] = '\n';
+        fragmentAppend((const uint8_t *) message, length + 1);
+    }
+    fragmentSend();
+}
+
+/**********************************************************************************************************************
+ * \brief: Queues the fragments of the log dump as uplinks, as many as fit the uplink queue at a time. Each fragment is
+ *         filled up to the payload limit of the data rate in use, so the dump takes the fewest frames.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: One place of the queue is left free for the events of the device. The fragments are confirmed, the
+ *           receiver drops the ones it gets twice.
+ **********************************************************************************************************************/
+void continueLogDump() {
+    uint8_t frame[UPLINK_PAYLOAD_MAX];
+
+    while (true == fragmentBusy() && uplinkQueueSpace() > 1) {
+        size_t length = fragmentNext(frame, uplinkMaxPayload());
+        if (length > 0) {
+            uplinkEnqueue(frame, length, UPLINK_CONFIRMED | UPLINK_BINARY,
+                          to_ms_since_boot(get_absolute_time()));
+        }
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Queues the health uplink every HEALTH_INTERVAL and stores the metrics to EEPROM every METRICS_SAVE_INTERVAL
+ *         and with each health uplink.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Waits for a free place in the uplink queue, one place is left for the events of the device.
+ **********************************************************************************************************************/
+void reportHealth() {
+    uint8_t payload[METRICS_HEALTH_LEN];
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+
+    if ((int32_t) (now - next_health_ms) >= 0 && uplinkQueueSpace() > 1) {
+        collectUartStats();
+        size_t length = metricsHealth(payload);
+        uplinkEnqueue(payload, length, UPLINK_BINARY, now);
+        next_health_ms = now + HEALTH_INTERVAL;
+        next_metrics_save_ms = now;
+    }
+    if ((int32_t) (now - next_metrics_save_ms) >= 0) {
+        collectUartStats();
+        writeMetrics(metricsGet());
+        next_metrics_save_ms = now + METRICS_SAVE_INTERVAL;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Moves the statistics of the modem uart into the metrics: drops and interrupts are added, the fill levels
+ *         and the interrupt time are kept at their highest.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: uart_get_stats() shows the statistics since the last call at any time.
+ **********************************************************************************************************************/
+void collectUartStats() {
+    uart_stats stats;
+    uart_take_stats(UART_NR, &stats);
+    metricsAdd(MC_UART_RX_DROPPED, stats.rx_dropped);
+    metricsAdd(MC_UART_TX_DROPPED, stats.tx_dropped);
+    metricsPeak(MC_UART_RX_HIGH_WATER, stats.rx_high_water);
+    metricsPeak(MC_UART_TX_HIGH_WATER, stats.tx_high_water);
+    metricsAdd(MC_UART_IRQS, stats.irqs);
+    metricsPeak(MC_UART_IRQ_MAX_CYCLES, stats.irq_max_cycles);
+}
+
+/**********************************************************************************************************************
+ * \brief: Sleeps for the given time while serving the uplink queue.
+ *
+ * \param: 1 param: time to sleep in ms.
+ *
+ * \return:
+ *
+ * \remarks: Replaces sleep_ms() in the dispense sequence so that uplinks and their retries go out meanwhile.
+ **********************************************************************************************************************/
+void pollingSleep(uint32_t ms) {
+    absolute_time_t until = make_timeout_time_ms(ms);
+    while (false == time_reached(until)) {
+        loraPoll();
+        sleep_ms(POLL_PERIOD);
+    }
+}
+
 /**********************************************************************************************************************
  * \brief: Activates the timer to no pill detection blinking.
  *
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <malloc.h>
+#include "memory.h"
+#include "debuglog.h"
+
+#ifdef DEBUG_PRINT
+#define DBG_PRINT(f_, ...)  debugLog((f_), ##__VA_ARGS__)
+#else
+#define DBG_PRINT(f_, ...)
+#endif
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+/* Defined by the linker script of the Pico SDK. Core 0 runs on the stack in SCRATCH_Y, core 1 on the one in
+ * SCRATCH_X. */
+extern uint32_t __data_start__, __bss_end__;
+extern uint32_t __StackBottom, __StackTop;
+extern uint32_t __StackOneBottom, __StackOneTop;
+
+//////////////////////////////////////////////////
+//               MEMORY FUNCTIONS               //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Fills a stack area with the paint pattern.
+ *
+ * \param: 2 params: lowest and highest word of the area.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void paint(uint32_t *bottom, uint32_t *top) {
+    while (bottom < top) {
+        *bottom++ = STACK_PAINT;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Measures the deepest use of a painted stack: the stack grows down, so the paint left untouched from the
+ *         bottom is the part never used.
+ *
+ * \param: 2 params: lowest and highest word of the stack.
+ *
+ * \return: bytes used at most
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static uint32_t highWater(const uint32_t *bottom, const uint32_t *top) {
+    const uint32_t *word = bottom;
+    while (word < top && STACK_PAINT == *word) {
+        word++;
+    }
+    return (uint32_t) (top - word) * sizeof(uint32_t);
+}
+
+/**********************************************************************************************************************
+ * \brief: Paints the unused part of the core 0 stack.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Call first in main(), the frames already on the stack are left alone.
+ **********************************************************************************************************************/
+void stackPaintCore0() {
+    uint8_t *stack_pointer = __builtin_frame_address(0);
+    paint(&__StackBottom, (uint32_t *) (stack_pointer - STACK_PAINT_MARGIN));
+}
+
+/**********************************************************************************************************************
+ * \brief: Paints the core 1 stack.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Call before multicore_launch_core1().
+ **********************************************************************************************************************/
+void stackPaintCore1() {
+    paint(&__StackOneBottom, &__StackOneTop);
+}
+
+/**********************************************************************************************************************
+ * \brief: Collects the RAM use: static data, heap and the stack high-water mark of both cores.
+ *
+ * \param: 1 param: pointer to the struct to fill.
+ *
+ * \return:
+ *
+ * \remarks: The high-water marks are only meaningful when the stacks have been painted.
+ **********************************************************************************************************************/
+void memoryUsage(memory_usage *usage) {
+    usage->static_ram = (uint32_t) ((uint8_t *) &__bss_end__ - (uint8_t *) &__data_start__);
+    usage->heap = mallinfo().uordblks;
+    usage->stack_size[0] = (uint32_t) ((uint8_t *) &__StackTop - (uint8_t *) &__StackBottom);
+    usage->stack_size[1] = (uint32_t) ((uint8_t *) &__StackOneTop - (uint8_t *) &__StackOneBottom);
+    usage->stack_high_water[0] = highWater(&__StackBottom, &__StackTop);
+    usage->stack_high_water[1] = highWater(&__StackOneBottom, &__StackOneTop);
+}
+
+/**********************************************************************************************************************
+ * \brief: Prints the RAM use.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: Prints only with DEBUG_PRINT.
+ **********************************************************************************************************************/
+void memoryReport() {
+    memory_usage usage;
+    memoryUsage(&usage);
+    DBG_PRINT("RAM: static %u B, heap %u B, stack core 0 %u/%u B, core 1 %u/%u B\n", usage.static_ram, usage.heap,
+              usage.stack_high_water[0], usage.stack_size[0], usage.stack_high_water[1], usage.stack_size[1]);
+}
@@ -0,0 +1,21 @@
+#ifndef MEMORY
+#define MEMORY
+
+#include <stdint.h>
+
+#define STACK_PAINT 0xA5A5A5A5               // fill pattern of unused stack
+#define STACK_PAINT_MARGIN 64                // bytes below the current stack pointer left unpainted
+
+typedef struct memory_usage_ {
+    uint32_t static_ram;                     // .data and .bss
+    uint32_t heap;                           // allocated with malloc, e.g. the uart ring buffers
+    uint32_t stack_size[2];
+    uint32_t stack_high_water[2];            // deepest stack use seen on core 0 and core 1
+} memory_usage;
+
+void stackPaintCore0();
+void stackPaintCore1();
+void memoryUsage(memory_usage *usage);
+void memoryReport();
+
+#endif
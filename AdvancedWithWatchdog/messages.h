@@ -0,0 +1,17 @@
+#ifndef MESSAGES
+#define MESSAGES
+
+/* Fixed messages of main(), logged and sent as they are. host/decoder.c maps them to its EventType in this order, so
+ * a new message goes at the end. */
+#define FIXED_MSG_COUNT 8
+
+static const char *const fixed_msg[FIXED_MSG_COUNT] = {"Clean boot.",
+                                                       "Calibrated. Waiting for button to dispense pills.",
+                                                       "Powered off during dispense. Motor was not turning.",
+                                                       "Powered off during dispense. Motor was turning.",
+                                                       "All pills dispensed. Waiting for button to calibrate.",
+                                                       "Booted after calibration. Waiting for button to dispense.",
+                                                       "Waiting for button to calibrate.",
+                                                       "Reboot by Watchdog."};
+
+#endif
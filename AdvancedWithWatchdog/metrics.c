@@ -0,0 +1,222 @@
+#include <string.h>
+#include "metrics.h"
+#include "airtime.h"
+
+_Static_assert(METRICS_HEALTH_LEN <= LORA_MIN_PAYLOAD, "the health uplink does not fit DR0");
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+/* Maps a value to the histogram range: (value + offset) >> shift */
+typedef struct metrics_scale_ {
+    int32_t offset;
+    uint8_t shift;
+} metrics_scale;
+
+static const metrics_scale scale[MH_COUNT] = {
+        [MH_EXCHANGE] = {0, 6},
+        [MH_DELIVERY] = {0, 10},
+        [MH_RSSI] = {150, 0},
+        [MH_SNR] = {200, 2},
+        [MH_SERIAL] = {0, 10}
+};
+
+static metrics current;
+
+//////////////////////////////////////////////////
+//              METRICS FUNCTIONS               //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Returns the bucket of a scaled value: the position of the highest set bit selects the power of two, the
+ *         METRICS_SUB_BITS bits below it the bucket within.
+ *
+ * \param: 1 param: scaled value.
+ *
+ * \return: bucket index 0 - METRICS_BUCKETS - 1
+ *
+ * \remarks: Constant time, no loop.
+ **********************************************************************************************************************/
+static int bucketOf(uint32_t value) {
+    if (value < METRICS_SUB_BUCKETS) {
+        return (int) value;
+    }
+    int exponent = 31 - __builtin_clz(value);
+    int bucket = (exponent - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS +
+                 (int) ((value >> (exponent - METRICS_SUB_BITS)) & (METRICS_SUB_BUCKETS - 1));
+    return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+/**********************************************************************************************************************
+ * \brief: Counts an event.
+ *
+ * \param: 1 param: counter.
+ *
+ * \return:
+ *
+ * \remarks: Safe to call from the uplink and modem code on every command.
+ **********************************************************************************************************************/
+void metricsCount(enum MetricCounter counter) {
+    current.counters.count[counter]++;
+}
+
+/**********************************************************************************************************************
+ * \brief: Adds an amount to a counter.
+ *
+ * \param: 2 params: counter and the amount.
+ *
+ * \return:
+ *
+ * \remarks: For events counted elsewhere and folded in now and then, like the uart statistics.
+ **********************************************************************************************************************/
+void metricsAdd(enum MetricCounter counter, uint32_t amount) {
+    current.counters.count[counter] += amount;
+}
+
+/**********************************************************************************************************************
+ * \brief: Keeps the highest value seen in a counter.
+ *
+ * \param: 2 params: counter and the value.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void metricsPeak(enum MetricCounter counter, uint32_t value) {
+    if (value > current.counters.count[counter]) {
+        current.counters.count[counter] = value;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Adds a sample to a histogram.
+ *
+ * \param: 2 params: histogram and the value in the unit of the histogram, see enum MetricHistogram.
+ *
+ * \return:
+ *
+ * \remarks: Constant time and allocation free. A full bucket stays at UINT16_MAX.
+ **********************************************************************************************************************/
+void metricsRecord(enum MetricHistogram histogram, int32_t value) {
+    metrics_histogram *counts = &current.histogram[histogram];
+    int bucket = metricsBucket(histogram, value);
+    if (UINT16_MAX != counts->count[bucket]) {
+        counts->count[bucket]++;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the bucket a value is counted in.
+ *
+ * \param: 2 params: histogram and the value in its unit.
+ *
+ * \return: bucket index
+ *
+ * \remarks: Values below the start of the histogram are counted in bucket 0.
+ **********************************************************************************************************************/
+int metricsBucket(enum MetricHistogram histogram, int32_t value) {
+    int32_t scaled = value + scale[histogram].offset;
+    return bucketOf(scaled > 0 ? (uint32_t) scaled >> scale[histogram].shift : 0);
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the lowest value counted in a bucket, for the receiver of the health uplink to decode the buckets.
+ *
+ * \param: 2 params: histogram and bucket index.
+ *
+ * \return: value in the unit of the histogram
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int32_t metricsBucketValue(enum MetricHistogram histogram, int bucket) {
+    uint32_t low = (uint32_t) bucket;
+    if (bucket >= METRICS_SUB_BUCKETS) {
+        int exponent = bucket / METRICS_SUB_BUCKETS + METRICS_SUB_BITS - 1;
+        low = (uint32_t) (METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS) << (exponent - METRICS_SUB_BITS);
+    }
+    return (int32_t) (low << scale[histogram].shift) - scale[histogram].offset;
+}
+
+/**********************************************************************************************************************
+ * \brief: Finds the bucket holding the given percentile of the samples of a histogram.
+ *
+ * \param: 3 params: histogram, percentile 1 - 100 and pointer to store the number of samples to, may be NULL.
+ *
+ * \return: bucket index, 0 if the histogram is empty
+ *
+ * \remarks: Walks the buckets, meant for reporting and not for the hot path.
+ **********************************************************************************************************************/
+int metricsPercentile(enum MetricHistogram histogram, int percent, uint32_t *samples) {
+    const metrics_histogram *counts = &current.histogram[histogram];
+    uint32_t total = 0, seen = 0;
+
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        total += counts->count[i];
+    }
+    if (NULL != samples) {
+        *samples = total;
+    }
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += counts->count[i];
+        if (seen > 0 && seen * 100 >= total * (uint32_t) percent) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/**********************************************************************************************************************
+ * \brief: Builds the health uplink and starts a new histogram period. Big-endian layout, METRICS_HEALTH_LEN bytes:
+ *         METRICS_HEALTH_TAG, the low 16 bits of each counter in enum MetricCounter order, then for each histogram
+ *         in enum MetricHistogram order the samples of the period (8 bits, saturated) and the buckets of the median,
+ *         the 90th percentile and the highest sample.
+ *
+ * \param: 1 param: buffer of at least METRICS_HEALTH_LEN bytes.
+ *
+ * \return: payload length
+ *
+ * \remarks: Counters run since the first start, the receiver takes the difference to the previous report modulo 2^16.
+ *           Decode the buckets with metricsBucketValue(). The payload fits LORA_MIN_PAYLOAD, it is sent at any DR.
+ **********************************************************************************************************************/
+size_t metricsHealth(uint8_t *payload) {
+    size_t pos = 0;
+
+    payload[pos++] = METRICS_HEALTH_TAG;
+    for (int i = 0; i < MC_COUNT; i++) {
+        payload[pos++] = (uint8_t) (current.counters.count[i] >> 8);
+        payload[pos++] = (uint8_t) current.counters.count[i];
+    }
+    for (int i = 0; i < MH_COUNT; i++) {
+        uint32_t samples;
+        int median = metricsPercentile(i, 50, &samples);
+        int highest = 0;
+        for (int bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+            if (0 != current.histogram[i].count[bucket]) {
+                highest = bucket;
+            }
+        }
+        if (samples > UINT8_MAX) {
+            samples = UINT8_MAX;
+        }
+        payload[pos++] = (uint8_t) samples;
+        payload[pos++] = (uint8_t) median;
+        payload[pos++] = (uint8_t) metricsPercentile(i, 90, NULL);
+        payload[pos++] = (uint8_t) highest;
+    }
+    memset(current.histogram, 0, sizeof(current.histogram));
+    return pos;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the metrics, to be stored to and restored from EEPROM.
+ *
+ * \param:
+ *
+ * \return: pointer to the metrics.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+metrics *metricsGet() {
+    return &current;
+}
@@ -0,0 +1,72 @@
+#ifndef METRICS
+#define METRICS
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Log-linear histograms: 4 buckets per power of two, values 0 - 3 have a bucket each. A bucket is at most 25 % wide,
+ * values beyond the last bucket are counted in it. */
+#define METRICS_SUB_BITS 2
+#define METRICS_SUB_BUCKETS ( 1 << METRICS_SUB_BITS )
+#define METRICS_BUCKETS 24                   // scaled values 0 - 127
+
+#define METRICS_HEALTH_TAG 0x01              // first byte of the health uplink, text messages start printable
+#define METRICS_HEALTH_LEN ( 1 + 2 * MC_COUNT + 4 * MH_COUNT )
+
+enum MetricCounter {
+    MC_BOOTS,
+    MC_JOINS,                                // join requests sent
+    MC_JOIN_FAILURES,
+    MC_COMMAND_FAILURES,                     // AT commands answered with an error or not at all
+    MC_UPLINKS,                              // uplink attempts sent to the modem
+    MC_ACKS,
+    MC_NO_ACKS,                              // confirmed uplinks without acknowledgement
+    MC_REFUSED,                              // uplinks refused by the modem: No band, Length error, not joined
+    MC_TIMEOUTS,                             // uplinks the modem did not finish in time
+    MC_UART_RX_DROPPED,                      // bytes from the modem lost in the full RX ring
+    MC_UART_TX_DROPPED,                      // bytes to the modem that did not fit in the TX ring
+    MC_UART_RX_HIGH_WATER,                   // peaks, the highest value seen
+    MC_UART_TX_HIGH_WATER,
+    MC_UART_IRQS,
+    MC_UART_IRQ_MAX_CYCLES,                  // longest uart interrupt handler run
+    MC_COUNT
+};
+
+/* Scaled into the histogram range by the table in metrics.c */
+enum MetricHistogram {
+    MH_EXCHANGE,                             // ms from the uplink command to Done, 64 ms units
+    MH_DELIVERY,                             // ms from enqueue to delivery, 1024 ms units
+    MH_RSSI,                                 // dBm of downlinks, from -150 dBm
+    MH_SNR,                                  // 0.1 dB of downlinks, from -20 dB in 0.4 dB units
+    MH_SERIAL,                               // us a command takes on the uart to the modem, 1024 us units
+    MH_COUNT
+};
+
+/* Records are written to EEPROM as they are, the CRC is the last member of each */
+typedef struct __attribute__((__packed__)) metrics_histogram_ {
+    uint16_t count[METRICS_BUCKETS];         // saturates at UINT16_MAX
+    uint16_t crc16;
+} metrics_histogram;
+
+typedef struct __attribute__((__packed__)) metrics_counters_ {
+    uint32_t count[MC_COUNT];
+    uint16_t crc16;
+} metrics_counters;
+
+typedef struct metrics_ {
+    metrics_counters counters;               // since the device was first started
+    metrics_histogram histogram[MH_COUNT];   // since the last health uplink
+} metrics;
+
+void metricsCount(enum MetricCounter counter);
+void metricsAdd(enum MetricCounter counter, uint32_t amount);
+void metricsPeak(enum MetricCounter counter, uint32_t value);
+void metricsRecord(enum MetricHistogram histogram, int32_t value);
+int metricsBucket(enum MetricHistogram histogram, int32_t value);
+int32_t metricsBucketValue(enum MetricHistogram histogram, int bucket);
+int metricsPercentile(enum MetricHistogram histogram, int percent, uint32_t *samples);
+size_t metricsHealth(uint8_t *payload);
+metrics *metricsGet();
+
+#endif
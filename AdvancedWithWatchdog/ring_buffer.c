@@ -1,45 +1,140 @@
+#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ring_buffer.h"
 
+// The producer publishes a byte with a release store of head, the consumer frees a slot with a release store of
+// tail. Reading the other side's index with acquire makes the byte (or the free slot) visible before it is used.
+#define LOAD_ACQUIRE(index)  __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(index, value)  __atomic_store_n(&(index), (value), __ATOMIC_RELEASE)
+
+// size must be a power of two, the index mask depends on it
 void rb_init(ring_buffer *rb, uint8_t *buffer, int size)
 {
+    assert(size > 0 && 0 == (size & (size - 1)));
     rb->tail = 0;
     rb->head = 0;
     rb->size = size;
+    rb->mask = size - 1;
     rb->buffer = buffer;
 }
 
 bool rb_empty(ring_buffer *rb)
 {
-    return rb->head == rb->tail;
+    return LOAD_ACQUIRE(rb->head) == LOAD_ACQUIRE(rb->tail);
 }
 
 bool rb_full(ring_buffer *rb)
 {
-    return (rb->head + 1) % rb->size == rb->tail;
+    return LOAD_ACQUIRE(rb->head) - LOAD_ACQUIRE(rb->tail) >= (uint32_t) rb->size;
 }
 
+// producer side
 bool rb_put(ring_buffer *rb, uint8_t data)
 {
-    // calculate new head (position where to store the value)
-    int nh = (rb->head + 1) % rb->size;
-    // return false if buffer would be full
-    if(nh == rb->tail) return false;
+    uint32_t head = rb->head;
+    // return false if buffer is full
+    if(head - LOAD_ACQUIRE(rb->tail) >= (uint32_t) rb->size) return false;
 
-    rb->buffer[rb->head] = data;
-    rb->head = nh;
+    rb->buffer[head & rb->mask] = data;
+    STORE_RELEASE(rb->head, head + 1);
     return true;
 }
 
+// consumer side, returns 0 if the buffer is empty
 uint8_t rb_get(ring_buffer *rb)
 {
-    uint8_t value = rb->buffer[rb->tail];
-    if(rb->head != rb->tail) {
-        rb->tail = (rb->tail + 1) % rb->size;
-    }
+    uint32_t tail = rb->tail;
+    if(LOAD_ACQUIRE(rb->head) == tail) return 0;
+
+    uint8_t value = rb->buffer[tail & rb->mask];
+    STORE_RELEASE(rb->tail, tail + 1);
     return value;
 }
 
+// number of bytes waiting, the difference stays right when the indices wrap
+int rb_count(ring_buffer *rb)
+{
+    return (int) (LOAD_ACQUIRE(rb->head) - LOAD_ACQUIRE(rb->tail));
+}
+
+// reads a waiting byte without removing it, offset counts from the oldest byte
+uint8_t rb_peek(ring_buffer *rb, int offset)
+{
+    return rb->buffer[(rb->tail + offset) & rb->mask];
+}
+
+// removes bytes that have been read with rb_peek
+void rb_drop(ring_buffer *rb, int count)
+{
+    int waiting = rb_count(rb);
+    if(count > waiting) count = waiting;
+    STORE_RELEASE(rb->tail, rb->tail + count);
+}
+
+// consumer side: waiting bytes from the tail up to the end of the buffer, remove them with rb_drop
+int rb_read_span(ring_buffer *rb, const uint8_t **span)
+{
+    uint32_t tail = rb->tail;
+    uint32_t waiting = LOAD_ACQUIRE(rb->head) - tail;
+    uint32_t to_end = rb->size - (tail & rb->mask);
+
+    *span = &rb->buffer[tail & rb->mask];
+    return (int) (waiting < to_end ? waiting : to_end);
+}
+
+// producer side: free bytes from the head up to the end of the buffer, publish them with rb_commit
+int rb_write_span(ring_buffer *rb, uint8_t **span)
+{
+    uint32_t head = rb->head;
+    uint32_t room = rb->size - (head - LOAD_ACQUIRE(rb->tail));
+    uint32_t to_end = rb->size - (head & rb->mask);
+
+    *span = &rb->buffer[head & rb->mask];
+    return (int) (room < to_end ? room : to_end);
+}
+
+// producer side: publishes bytes written to the span of rb_write_span
+void rb_commit(ring_buffer *rb, int count)
+{
+    STORE_RELEASE(rb->head, rb->head + count);
+}
+
+// consumer side: takes up to size bytes, returns the number taken
+int rb_read(ring_buffer *rb, uint8_t *data, int size)
+{
+    const uint8_t *span;
+    int count = 0;
+
+    // at most two spans: up to the end of the buffer and from its start
+    for(int i = 0; i < 2 && count < size; i++) {
+        int length = rb_read_span(rb, &span);
+        if(length > size - count) length = size - count;
+        if(0 == length) break;
+        memcpy(&data[count], span, length);
+        STORE_RELEASE(rb->tail, rb->tail + length);
+        count += length;
+    }
+    return count;
+}
+
+// producer side: puts up to size bytes, returns the number put
+int rb_write(ring_buffer *rb, const uint8_t *data, int size)
+{
+    uint8_t *span;
+    int count = 0;
+
+    for(int i = 0; i < 2 && count < size; i++) {
+        int length = rb_write_span(rb, &span);
+        if(length > size - count) length = size - count;
+        if(0 == length) break;
+        memcpy(span, &data[count], length);
+        rb_commit(rb, length);
+        count += length;
+    }
+    return count;
+}
+
 void rb_alloc(ring_buffer *rb, int size)
 {
     uint8_t  *buffer = calloc(size, sizeof(uint8_t));
@@ -4,10 +4,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// single producer, single consumer: one side may be an interrupt handler or the other core.
+// head and tail run freely and wrap at 2^32, the size is a power of two and all of it is usable.
 typedef struct  {
-    int head;
-    int tail;
+    uint32_t head;      // written by the producer only
+    uint32_t tail;      // written by the consumer only
     int size;
+    uint32_t mask;      // size - 1
     uint8_t *buffer;
 } ring_buffer;
 
@@ -16,6 +19,16 @@ bool rb_empty(ring_buffer *rb);
 bool rb_full(ring_buffer *rb);
 bool rb_put(ring_buffer *rb, uint8_t data);
 uint8_t rb_get(ring_buffer *rb);
+int rb_count(ring_buffer *rb);
+uint8_t rb_peek(ring_buffer *rb, int offset);
+void rb_drop(ring_buffer *rb, int count);
+
+// bulk: spans are contiguous, a second call after the commit returns the part after the wrap
+int rb_read_span(ring_buffer *rb, const uint8_t **span);
+int rb_write_span(ring_buffer *rb, uint8_t **span);
+void rb_commit(ring_buffer *rb, int count);
+int rb_read(ring_buffer *rb, uint8_t *data, int size);
+int rb_write(ring_buffer *rb, const uint8_t *data, int size);
 
 void rb_alloc(ring_buffer *rb, int size);
 void rb_free(ring_buffer *rb);
@@ -2,9 +2,10 @@
 #include "steppermotor.h"
 #include <stdio.h>
 #include "eeprom.h"
+#include "debuglog.h"
 
 #ifndef DEBUG_PRINT
-#define DBG_PRINT(f_, ...)  printf((f_), ##__VA_ARGS__)
+#define DBG_PRINT(f_, ...)  debugLog((f_), ##__VA_ARGS__)
 #else
 #define DBG_PRINT(f_, ...)
 #endif
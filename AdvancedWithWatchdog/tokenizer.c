@@ -0,0 +1,260 @@
+#include <string.h>
+#include "tokenizer.h"
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+typedef struct line_prefix_ {
+    const char *text;
+    enum LineClass type;
+} line_prefix;
+
+/* Classes by the text after "+NAME: ", the first match wins. Anything else is the value of a setting. */
+static const line_prefix body_prefixes[] = {{"OK",             LINE_OK},
+                                            {"Done",           LINE_OK},
+                                            {"ERROR",          LINE_ERROR},
+                                            {"Please join",    LINE_ERROR},
+                                            {"No band",        LINE_ERROR},
+                                            {"Length error",   LINE_ERROR},
+                                            {"Join failed",    LINE_ERROR},
+                                            {"PORT: ",         LINE_PAYLOAD},
+                                            {"RX: ",           LINE_PAYLOAD},
+                                            {"Start",          LINE_URC},
+                                            {"Wait ACK",       LINE_URC},
+                                            {"ACK Received",   LINE_URC},
+                                            {"RXWIN",          LINE_URC},
+                                            {"FPENDING",       LINE_URC},
+                                            {"MACCMD",         LINE_URC},
+                                            {"NORMAL",         LINE_URC},
+                                            {"FORCE",          LINE_URC},
+                                            {"Network joined", LINE_URC},
+                                            {"Joined already", LINE_URC},
+                                            {"NetID",          LINE_URC}};
+
+#define BODY_PREFIXES  ( sizeof(body_prefixes) / sizeof(body_prefixes[0]) )
+
+//////////////////////////////////////////////////
+//             TOKENIZER FUNCTIONS              //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Reads a waiting byte of the ring buffer without removing it.
+ *
+ * \param: 2 params: ring buffer and offset from the oldest byte.
+ *
+ * \return: the byte
+ *
+ * \remarks: Same as rb_peek(), inlined.
+ **********************************************************************************************************************/
+static inline uint8_t peek(ring_buffer *rb, int offset) {
+    return rb->buffer[(rb->tail + offset) & rb->mask];
+}
+
+/**********************************************************************************************************************
+ * \brief: Searches the waiting bytes for a line ending. The bytes are searched where they are, in at most two pieces
+ *         when they wrap around the end of the ring buffer.
+ *
+ * \param: 3 params: ring buffer, offset to start from and the number of waiting bytes.
+ *
+ * \return: offset of the line ending, the number of waiting bytes if there is none.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static int findLineEnd(ring_buffer *rb, int from, int waiting) {
+    if (from >= waiting) {
+        return waiting;
+    }
+    int start = (int) ((rb->tail + from) & rb->mask);
+    int first = waiting - from < rb->size - start ? waiting - from : rb->size - start;
+
+    const uint8_t *found = memchr(&rb->buffer[start], '\n', first);
+    if (NULL != found) {
+        return from + (int) (found - &rb->buffer[start]);
+    }
+    found = memchr(rb->buffer, '\n', waiting - from - first);
+    if (NULL != found) {
+        return from + first + (int) (found - rb->buffer);
+    }
+    return waiting;
+}
+
+/**********************************************************************************************************************
+ * \brief: Classifies a complete line: echoed commands start with AT, modem responses with "+NAME: " followed by a body
+ *         that is looked up in the prefix table.
+ *
+ * \param: 2 params: ring buffer holding the line and the line to classify.
+ *
+ * \return:
+ *
+ * \remarks: Reads at most the name and the longest prefix of the line.
+ **********************************************************************************************************************/
+static void classify(ring_buffer *rb, at_line *line) {
+    line->type = LINE_UNKNOWN;
+    line->body = 0;
+
+    if (true == atLineStartsWith(rb, line, 0, "AT")) {
+        line->type = LINE_ECHO;
+        return;
+    }
+    if ('+' != peek(rb, 0)) {
+        return;
+    }
+    for (int i = 1; i < line->length; i++) {
+        char c = peek(rb, i);
+        if (':' == c) {
+            if (i > 1 && i + 1 < line->length && ' ' == peek(rb, i + 1)) {
+                line->body = i + 2;
+            }
+            break;
+        }
+        if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || '_' == c)) {
+            return;
+        }
+    }
+    if (0 == line->body) {
+        return;
+    }
+
+    line->type = LINE_VALUE;
+    for (int i = 0; i < BODY_PREFIXES; i++) {
+        if (true == atLineStartsWith(rb, line, line->body, body_prefixes[i].text)) {
+            line->type = body_prefixes[i].type;
+            return;
+        }
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Starts scanning from the tail of the ring buffer again.
+ *
+ * \param: 1 param: pointer to the tokenizer.
+ *
+ * \return:
+ *
+ * \remarks: Needed after bytes have been taken from the ring buffer without atLineDrop(), e.g. with uart_read().
+ **********************************************************************************************************************/
+void atTokenizerReset(at_tokenizer *tokenizer) {
+    tokenizer->scanned = 0;
+}
+
+/**********************************************************************************************************************
+ * \brief: Finds the next complete line in the ring buffer and classifies it. Every received byte is searched for the
+ *         line ending once, no matter how often this is called while the line arrives.
+ *
+ * \param: 3 params: pointer to the tokenizer, ring buffer with the received bytes and the line to fill.
+ *
+ * \return: true: if a complete line is at the tail, false: if the line has not been received completely yet
+ *
+ * \remarks: The line stays in the ring buffer until atLineDrop(). Empty lines are dropped. A ring buffer that fills up
+ *           without a line ending is handed out as one LINE_UNKNOWN line so that reception does not stall.
+ **********************************************************************************************************************/
+bool atNextLine(at_tokenizer *tokenizer, ring_buffer *rb, at_line *line) {
+    while (true) {
+        int waiting = rb_count(rb);
+
+        tokenizer->scanned = findLineEnd(rb, tokenizer->scanned, waiting);
+        if (tokenizer->scanned < waiting) {
+            line->consumed = tokenizer->scanned + 1;
+            line->length = tokenizer->scanned;
+            if (line->length > 0 && '\r' == peek(rb, line->length - 1)) {
+                line->length--;
+            }
+        } else if (waiting == rb->size) {
+            line->consumed = line->length = waiting;
+        } else {
+            return false;
+        }
+
+        if (line->length > 0) {
+            classify(rb, line);
+            return true;
+        }
+        atLineDrop(tokenizer, rb, line);
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Compares a line in the ring buffer with a string.
+ *
+ * \param: 4 params: ring buffer holding the line, the line, the string without line ending and its length.
+ *
+ * \return: true: if they are the same, false: otherwise
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+bool atLineEquals(ring_buffer *rb, const at_line *line, const char *text, int length) {
+    return length == line->length && atLineStartsWith(rb, line, 0, text);
+}
+
+/**********************************************************************************************************************
+ * \brief: Checks if a line in the ring buffer continues with a string from the given offset.
+ *
+ * \param: 4 params: ring buffer holding the line, the line, offset in the line and the string.
+ *
+ * \return: true: if the line continues with the string, false: otherwise
+ *
+ * \remarks: Pass line->body as the offset to look at the body of a response.
+ **********************************************************************************************************************/
+bool atLineStartsWith(ring_buffer *rb, const at_line *line, int offset, const char *text) {
+    for (int i = 0; '\0' != text[i]; i++) {
+        if (offset + i >= line->length || text[i] != (char) peek(rb, offset + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Copies a line out of the ring buffer as a string.
+ *
+ * \param: 4 params: ring buffer holding the line, the line, buffer to copy to and its size.
+ *
+ * \return: number of characters copied.
+ *
+ * \remarks: For printing and for the callers that need the text, the line is cut to fit the buffer.
+ **********************************************************************************************************************/
+int atLineCopy(ring_buffer *rb, const at_line *line, char *buffer, int size) {
+    int count = line->length < size - 1 ? line->length : size - 1;
+    for (int i = 0; i < count; i++) {
+        buffer[i] = peek(rb, i);
+    }
+    buffer[count] = '\0';
+    return count;
+}
+
+/**********************************************************************************************************************
+ * \brief: Removes a line and its line ending from the ring buffer.
+ *
+ * \param: 3 params: pointer to the tokenizer, ring buffer holding the line and the line returned by atNextLine().
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void atLineDrop(at_tokenizer *tokenizer, ring_buffer *rb, const at_line *line) {
+    rb_drop(rb, line->consumed);
+    tokenizer->scanned = tokenizer->scanned > line->consumed ? tokenizer->scanned - line->consumed : 0;
+}
+
+/**********************************************************************************************************************
+ * \brief: Classifies a line that has already been taken out of the ring buffer, e.g. by uart_read_line().
+ *
+ * \param: 2 params: the line without line ending and its length.
+ *
+ * \return: class of the line
+ *
+ * \remarks: The line is looked at through a ring buffer that never wraps: the tail is at its start and every index
+ *           is inside it.
+ **********************************************************************************************************************/
+enum LineClass atClassify(const char *text, int length) {
+    ring_buffer view = {.head = (uint32_t) length, .tail = 0, .size = length, .mask = UINT32_MAX,
+                        .buffer = (uint8_t *) text};
+    at_line line = {.length = length, .consumed = length};
+
+    if (0 == length) {
+        return LINE_UNKNOWN;
+    }
+    classify(&view, &line);
+    return line.type;
+}
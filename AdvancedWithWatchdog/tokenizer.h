@@ -0,0 +1,39 @@
+#ifndef TOKENIZER
+#define TOKENIZER
+
+#include <stdbool.h>
+#include "ring_buffer.h"
+
+/* Classes of the lines sent by the LoRa-E5, decided by the prefix table in tokenizer.c */
+enum LineClass {
+    LINE_UNKNOWN,                            // not a "+NAME: " line, e.g. garbled or cut short
+    LINE_ECHO,                               // command echoed back
+    LINE_OK,                                 // command finished successfully: OK, Done
+    LINE_ERROR,                              // command refused or failed
+    LINE_URC,                                // progress of a running command: Start, Wait ACK, RXWIN1, ...
+    LINE_PAYLOAD,                            // downlink data: PORT: 10; RX: "..."
+    LINE_VALUE                               // value of a setting: +MODE: LWOTAA
+};
+
+/* A complete line at the tail of the ring buffer. It is not copied, the bytes stay in the ring buffer until
+ * atLineDrop(). */
+typedef struct at_line_ {
+    enum LineClass type;
+    int length;                              // without the line ending
+    int body;                                // offset after "+NAME: ", 0 for untagged lines
+    int consumed;                            // with the line ending
+} at_line;
+
+typedef struct at_tokenizer_ {
+    int scanned;                             // bytes after the tail already searched for a line ending
+} at_tokenizer;
+
+void atTokenizerReset(at_tokenizer *tokenizer);
+bool atNextLine(at_tokenizer *tokenizer, ring_buffer *rb, at_line *line);
+bool atLineEquals(ring_buffer *rb, const at_line *line, const char *text, int length);
+bool atLineStartsWith(ring_buffer *rb, const at_line *line, int offset, const char *text);
+int atLineCopy(ring_buffer *rb, const at_line *line, char *buffer, int size);
+void atLineDrop(at_tokenizer *tokenizer, ring_buffer *rb, const at_line *line);
+enum LineClass atClassify(const char *text, int length);
+
+#endif
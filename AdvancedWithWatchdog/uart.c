@@ -1,6 +1,9 @@
 #include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
 #include "ring_buffer.h"
 
 #include "uart.h"
@@ -20,8 +23,16 @@ void uart1_handler(void);
 #if 0
 static uart_t *uart_get_handle(int uart_nr);
 #endif
-static uart_t u0 = { .uart = uart0, .irqn = UART0_IRQ, .handler = uart0_handler };
-static uart_t u1 = { .uart = uart1, .irqn = UART1_IRQ, .handler = uart1_handler };
+static uart_t u0 = { .uart = uart0, .irqn = UART0_IRQ, .handler = uart0_handler, .dma_channel = -1 };
+static uart_t u1 = { .uart = uart1, .irqn = UART1_IRQ, .handler = uart1_handler, .dma_channel = -1 };
+
+// one pair of buffers per uart, the ring wrap of the DMA needs the receive buffers aligned to their size
+static uint8_t rx_buffer[2][UART_RX_BUFFER_SIZE] __attribute__((aligned(UART_RX_BUFFER_SIZE)));
+static uint8_t tx_buffer[2][UART_TX_BUFFER_SIZE];
+
+_Static_assert(0 == (UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1)), "UART_RX_BUFFER_SIZE is not a power of two");
+_Static_assert(0 == (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)), "UART_TX_BUFFER_SIZE is not a power of two");
+_Static_assert(0 == (UART_TX_DESCRIPTORS & (UART_TX_DESCRIPTORS - 1)), "UART_TX_DESCRIPTORS is not a power of two");
 #if 0
 static uart_t *uart_get_handle(int uart_nr) {
 #else
@@ -31,19 +42,40 @@ uart_t *uart_get_handle(int uart_nr) {
 }
 
 
+// Starts SysTick free running on the processor clock, it times the interrupt handlers. SysTick is per core, so
+// this runs on the core that services the uart interrupts.
+static void systick_start(void)
+{
+    if(!(systick_hw->csr & 1)) {
+        systick_hw->rvr = 0xFFFFFF;
+        systick_hw->cvr = 0;
+        systick_hw->csr = 0x5;
+    }
+}
+
+// Sets up a uart with its static buffers. Calling it again, e.g. on a retry, only changes the speed: the buffers,
+// the waiting bytes and the DMA receiver stay as they are and nothing is allocated.
 void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed)
 {
     uart_t *uart = uart_get_handle(uart_nr);
 
+    if(uart->ready) {
+        uart_set_speed(uart_nr, speed);
+        return;
+    }
+
     // ensure that we don't get any interrupts from the uart during configuration
     irq_set_enabled(uart->irqn, false);
 
-    // allocate space for ring buffers
-    rb_alloc(&uart->rx, 256);
-    rb_alloc(&uart->tx, 256);
+    systick_start();
+
+    rb_init(&uart->rx, rx_buffer[uart_nr ? 1 : 0], UART_RX_BUFFER_SIZE);
+    rb_init(&uart->tx, tx_buffer[uart_nr ? 1 : 0], UART_TX_BUFFER_SIZE);
 
     // Set up our UART with the required speed.
     uart_init(uart->uart, speed);
+    uart->speed = speed;
+    uart->idle_us = UART_RX_IDLE_CHARS * 10 * 1000000 / speed;
 
     // Set the TX and RX pins by using the function select on the GPIO
     // See datasheet for more information on function select
@@ -56,35 +88,210 @@ void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed)
     uart_set_irq_enables(uart->uart, true, false);
     // enable UART0 interrupts on NVIC
     irq_set_enabled(uart->irqn, true);
+    uart->ready = true;
 }
 
-int uart_read(int uart_nr, uint8_t *buffer, int size)
+// Changes the baud rate of a set up uart, the buffers and the receiver are kept
+void uart_set_speed(int uart_nr, int speed)
+{
+    uart_t *uart = uart_get_handle(uart_nr);
+    if(!uart->ready || speed == uart->speed) return;
+
+    uart_set_baudrate(uart->uart, speed);
+    uart->speed = speed;
+    uart->idle_us = UART_RX_IDLE_CHARS * 10 * 1000000 / speed;
+}
+
+// Moves the head of the receive ring to the bytes the DMA has written. Only the consumer calls this, so head still
+// has a single writer. If the DMA has lapped the reader, the oldest bytes are lost and the tail skips past them.
+static void rx_sync(uart_t *u)
+{
+    if(u->dma_channel < 0) return;
+
+    uint32_t remaining = dma_channel_hw_addr(u->dma_channel)->transfer_count;
+    uint32_t head = u->dma_base + (UART_RX_DMA_COUNT - remaining);
+    if(0 == remaining && !dma_channel_is_busy(u->dma_channel)) {
+        // the run is over, the write address carries on around the ring
+        u->dma_base += UART_RX_DMA_COUNT;
+        dma_channel_set_trans_count(u->dma_channel, UART_RX_DMA_COUNT, true);
+    }
+    uint32_t waiting = head - u->rx.tail;
+    if(waiting > (uint32_t) u->rx.size) {
+        u->stats.rx_dropped += waiting - u->rx.size;
+        waiting = u->rx.size;
+        __atomic_store_n(&u->rx.tail, head - u->rx.size, __ATOMIC_RELEASE);
+    }
+    if(waiting > u->stats.rx_high_water) u->stats.rx_high_water = waiting;
+    __atomic_store_n(&u->rx.head, head, __ATOMIC_RELEASE);
+}
+
+// Switches the receiver of a set up uart to DMA into a circular buffer. The RX interrupt is turned off, the CPU
+// only touches the received bytes when they are read. Returns false if the uart is not set up or no DMA channel is
+// free, reception then stays interrupt driven. Bytes waiting in the receive ring are discarded.
+bool uart_rx_dma(int uart_nr)
 {
-    int count = 0;
     uart_t *u = uart_get_handle(uart_nr);
-    while(count < size && !rb_empty(&u->rx)) {
-        *buffer++ = rb_get(&u->rx);
-        ++count;
+    if(u->dma_channel >= 0) return true;
+    if(!u->ready) return false;
+
+    int channel = dma_claim_unused_channel(false);
+    if(channel < 0) return false;
+
+    irq_set_enabled(u->irqn, false);
+    hw_clear_bits(&uart_get_hw(u->uart)->imsc, UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS);
+    rb_init(&u->rx, rx_buffer[uart_nr ? 1 : 0], UART_RX_BUFFER_SIZE);
+
+    dma_channel_config config = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, UART_RX_BUFFER_BITS);
+    channel_config_set_dreq(&config, uart_get_dreq(u->uart, false));
+    dma_channel_configure(channel, &config, u->rx.buffer, &uart_get_hw(u->uart)->dr, UART_RX_DMA_COUNT, true);
+
+    u->dma_channel = channel;
+    u->dma_base = 0;
+    u->rx_seen = 0;
+    u->rx_burst = false;
+    hw_set_bits(&uart_get_hw(u->uart)->dmacr, UART_UARTDMACR_RXDMAE_BITS);
+    irq_set_enabled(u->irqn, true);
+    return true;
+}
+
+// The receive ring, up to date with the DMA. Read it with the rb_* consumer functions.
+ring_buffer *uart_rx_ring(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    rx_sync(u);
+    return &u->rx;
+}
+
+// Notes when the head of the receive ring last moved, returns true if it has moved since the last look
+static bool rx_watch(uart_t *u, uint32_t now)
+{
+    rx_sync(u);
+    uint32_t head = __atomic_load_n(&u->rx.head, __ATOMIC_ACQUIRE);
+    if(head == u->rx_seen) return false;
+    u->rx_seen = head;
+    u->rx_changed_us = now;
+    u->rx_burst = true;
+    return true;
+}
+
+// True once per burst of received bytes, when the line has then been quiet for UART_RX_IDLE_CHARS. A modem
+// response is complete at that point and can be parsed in one go.
+bool uart_rx_idle(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    uint32_t now = time_us_32();
+
+    if(rx_watch(u, now)) return false;
+    if(u->rx_burst && now - u->rx_changed_us >= u->idle_us) {
+        u->rx_burst = false;
+        return true;
     }
-    return count;
+    return false;
 }
 
-int uart_write(int uart_nr, const uint8_t *buffer, int size)
+// Sleeps the core until received bytes may be waiting or the deadline has passed. The RX interrupt wakes it. Under
+// DMA there is no interrupt per byte, and a line that has gone quiet does not raise one either: while bytes come in
+// the core wakes when the line has been quiet for the idle time, on a quiet line every UART_RX_POLL_US.
+// Returns false once the deadline has passed.
+bool uart_rx_wait(int uart_nr, absolute_time_t deadline)
 {
-    int count = 0;
     uart_t *u = uart_get_handle(uart_nr);
-    // write data to ring buffer
-    while(count < size && !rb_full(&u->tx)) {
-        rb_put(&u->tx, *buffer++);
-        ++count;
+    absolute_time_t wake = deadline;
+
+    if(u->dma_channel >= 0) {
+        uint32_t now = time_us_32();
+        rx_watch(u, now);
+        uint32_t quiet = now - u->rx_changed_us;
+        uint32_t poll = u->rx_burst && quiet < u->idle_us ? u->idle_us - quiet : UART_RX_POLL_US;
+        wake = absolute_time_min(deadline, make_timeout_time_us(poll));
+    } else if(!rb_empty(&u->rx)) {
+        wake = absolute_time_min(deadline, make_timeout_time_us(u->idle_us));
     }
+    if(!time_reached(wake)) best_effort_wfe_or_timeout(wake);
+    return !time_reached(deadline);
+}
+
+// Reads up to and including the delimiter, sleeping until it arrives. Returns the bytes read, size if the buffer
+// fills up first, or 0 at the deadline: bytes without a delimiter stay in the ring for the next call.
+int uart_read_until(int uart_nr, uint8_t *buffer, int size, uint8_t delimiter, absolute_time_t deadline)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    int scanned = 0;
+
+    while(true) {
+        rx_sync(u);
+        int waiting = rb_count(&u->rx);
+        // bytes already searched are not searched again after a wake up
+        for(; scanned < waiting && scanned < size; scanned++) {
+            if(delimiter == rb_peek(&u->rx, scanned)) return rb_read(&u->rx, buffer, scanned + 1);
+        }
+        if(scanned == size) return rb_read(&u->rx, buffer, size);
+        if(time_reached(deadline)) return 0;
+        uart_rx_wait(uart_nr, deadline);
+    }
+}
+
+// Reads a line into a string without its line ending. Returns the length, -1 at the deadline. A line longer than
+// the string arrives in parts.
+int uart_read_line(int uart_nr, char *line, int size, absolute_time_t deadline)
+{
+    int count = uart_read_until(uart_nr, (uint8_t *) line, size - 1, '\n', deadline);
+    if(0 == count) return -1;
+
+    if('\n' == line[count - 1]) count--;
+    if(count > 0 && '\r' == line[count - 1]) count--;
+    line[count] = '\0';
+    return count;
+}
+
+// Counters of a uart for reading at runtime, see uart_take_stats() for a consistent copy
+const uart_stats *uart_get_stats(int uart_nr)
+{
+    return &uart_get_handle(uart_nr)->stats;
+}
+
+// Copies the counters of a uart and starts them again, e.g. once per telemetry report. Call it from the core that
+// services the uart interrupt.
+void uart_take_stats(int uart_nr, uart_stats *stats)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    irq_set_enabled(u->irqn, false);
+    *stats = u->stats;
+    memset(&u->stats, 0, sizeof(u->stats));
+    irq_set_enabled(u->irqn, u->ready);
+}
+
+int uart_read(int uart_nr, uint8_t *buffer, int size)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    rx_sync(u);
+    return rb_read(&u->rx, buffer, size);
+}
+
+static bool tx_desc_full(uart_t *u)
+{
+    return u->tx_desc_head - __atomic_load_n(&u->tx_desc_tail, __ATOMIC_ACQUIRE) == UART_TX_DESCRIPTORS;
+}
+
+// Queues a descriptor and gets the transmit interrupt going. Only the writer calls this, the queue is SPSC like the
+// rings: head is written here, tail by the interrupt.
+static uint32_t tx_queue(uart_t *u, const uint8_t *data, int length)
+{
+    uint32_t head = u->tx_desc_head;
+    u->tx_desc[head & (UART_TX_DESCRIPTORS - 1)] = (uart_tx_desc) { .data = data, .length = length };
+    __atomic_store_n(&u->tx_desc_head, head + 1, __ATOMIC_RELEASE);
+
     // disable interrupts on NVIC while managing transmit interrupts
     irq_set_enabled(u->irqn, false);
 
     // if transmit interrupt is not enabled we need to enable it and give fifo an initial filling
     if(!(uart_get_hw(u->uart)->imsc & (1 << UART_UARTIMSC_TXIM_LSB))) {
-        // enable transmit interrupt
-        uart_set_irq_enables(u->uart, true, true);
+        // enable transmit interrupt, the receive interrupts stay as they are
+        hw_set_bits(&uart_get_hw(u->uart)->imsc, UART_UARTIMSC_TXIM_BITS);
         // fifo requires initial filling
         uart_irq_tx(u);
     }
@@ -92,44 +299,160 @@ int uart_write(int uart_nr, const uint8_t *buffer, int size)
     // enable interrupts on NVIC
     irq_set_enabled(u->irqn, true);
 
+    return head + 1;
+}
+
+// Copies the bytes to the TX ring, the caller can reuse the buffer at once. What does not fit is dropped.
+int uart_write(int uart_nr, const uint8_t *buffer, int size)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    int count = 0;
+
+    // copies in a row share the last descriptor while it waits, only the ring limits them. The interrupt is held off
+    // so it cannot finish the descriptor while it grows.
+    irq_set_enabled(u->irqn, false);
+    uint32_t head = u->tx_desc_head;
+    uart_tx_desc *last = &u->tx_desc[(head - 1) & (UART_TX_DESCRIPTORS - 1)];
+    bool append = head != __atomic_load_n(&u->tx_desc_tail, __ATOMIC_ACQUIRE) && NULL == last->data;
+    // write data to ring buffer, a descriptor keeps it in order with the referenced writes
+    if(append || !tx_desc_full(u)) count = rb_write(&u->tx, buffer, size);
+    if(append) last->length += count;
+    irq_set_enabled(u->irqn, true);
+
+    u->stats.tx_dropped += size - count;
+    uint32_t waiting = rb_count(&u->tx);
+    if(waiting > u->stats.tx_high_water) u->stats.tx_high_water = waiting;
+    if(count > 0 && !append) tx_queue(u, NULL, count);
     return count;
 }
 
+// Sends the bytes from where they are, of any length: nothing is copied or truncated. The buffer must stay as it is
+// until uart_tx_done() returns true for the ticket, constants in flash can be passed without a ticket (NULL).
+// Returns false if UART_TX_DESCRIPTORS writes are already waiting.
+bool uart_write_ref(int uart_nr, const uint8_t *buffer, int size, uint32_t *ticket)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    if(tx_desc_full(u)) {
+        u->stats.tx_dropped += size;
+        return false;
+    }
+    uint32_t queued = size > 0 ? tx_queue(u, buffer, size) : u->tx_desc_head;
+    if(ticket) *ticket = queued;
+    return true;
+}
+
+// True once the bytes of a uart_write_ref() are in the transmit FIFO and its buffer can be reused
+bool uart_tx_done(int uart_nr, uint32_t ticket)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    return (int32_t) (__atomic_load_n(&u->tx_desc_tail, __ATOMIC_ACQUIRE) - ticket) >= 0;
+}
+
+// True if a uart_write_ref() would be taken now, i.e. fewer than UART_TX_DESCRIPTORS writes are waiting
+bool uart_tx_ready(int uart_nr)
+{
+    return !tx_desc_full(uart_get_handle(uart_nr));
+}
+
 int uart_send(int uart_nr, const char *str)
 {
     return uart_write(uart_nr, (const uint8_t *)str, strlen(str));
 }
 
+// Interrupts are serviced by the core that enabled them on its NVIC. These move the
+// handling of an already set up uart from one core to the other.
+void uart_irq_attach(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    systick_start();
+    irq_set_exclusive_handler(u->irqn, u->handler);
+    irq_set_enabled(u->irqn, true);
+}
+
+void uart_irq_detach(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    irq_set_enabled(u->irqn, false);
+}
+
 
 void uart_irq_rx(uart_t *u)
 {
+    uint8_t *span;
+    // the DMA takes the bytes
+    if(u->dma_channel >= 0) return;
+    // the FIFO is emptied into the free span, head is published once per span
     while(uart_is_readable(u->uart)) {
-        uint8_t c = uart_getc(u->uart);
-        // ignoring return value for now
-        rb_put(&u->rx, c);
+        int room = rb_write_span(&u->rx, &span);
+        int count = 0;
+        if(0 == room) {
+            // buffer full, the byte is dropped
+            (void) uart_getc(u->uart);
+            u->stats.rx_dropped++;
+            continue;
+        }
+        while(count < room && uart_is_readable(u->uart)) {
+            span[count++] = (uint8_t) uart_get_hw(u->uart)->dr;
+        }
+        rb_commit(&u->rx, count);
     }
+    uint32_t waiting = rb_count(&u->rx);
+    if(waiting > u->stats.rx_high_water) u->stats.rx_high_water = waiting;
 }
 
 void uart_irq_tx(uart_t *u)
 {
-    while(!rb_empty(&u->tx) && uart_is_writable(u->uart)) {
-        uart_get_hw(u->uart)->dr = rb_get((&u->tx));
+    uint32_t tail = u->tx_desc_tail;
+    // descriptors are sent in order: referenced bytes from where they are, copied bytes from the ring
+    while(tail != __atomic_load_n(&u->tx_desc_head, __ATOMIC_ACQUIRE) && uart_is_writable(u->uart)) {
+        const uart_tx_desc *desc = &u->tx_desc[tail & (UART_TX_DESCRIPTORS - 1)];
+        const uint8_t *span;
+        int waiting = desc->length - u->tx_offset;
+        if(NULL == desc->data) {
+            // the copy may wrap around the end of the ring, the rest is the next span
+            int contiguous = rb_read_span(&u->tx, &span);
+            if(contiguous < waiting) waiting = contiguous;
+        } else {
+            span = &desc->data[u->tx_offset];
+        }
+        // the FIFO is filled from the span, tail is moved once per span
+        int count = 0;
+        while(count < waiting && uart_is_writable(u->uart)) {
+            uart_get_hw(u->uart)->dr = span[count++];
+        }
+        if(NULL == desc->data) rb_drop(&u->tx, count);
+        u->tx_offset += count;
+        if(u->tx_offset == desc->length) {
+            u->tx_offset = 0;
+            __atomic_store_n(&u->tx_desc_tail, ++tail, __ATOMIC_RELEASE);
+        }
     }
 
-    if (rb_empty(&u->tx)) {
-        // disable tx interrupt if transmit buffer is empty
-        uart_set_irq_enables(u->uart, true, false);
+    if (tail == __atomic_load_n(&u->tx_desc_head, __ATOMIC_ACQUIRE)) {
+        // disable tx interrupt if nothing is waiting to be sent
+        hw_clear_bits(&uart_get_hw(u->uart)->imsc, UART_UARTIMSC_TXIM_BITS);
     }
 }
 
+static void uart_irq(uart_t *u)
+{
+    uint32_t start = systick_hw->cvr;
+    uart_irq_rx(u);
+    uart_irq_tx(u);
+    // SysTick counts down and wraps at 24 bits
+    uint32_t cycles = (start - systick_hw->cvr) & 0xFFFFFF;
+    u->stats.irqs++;
+    if(cycles > u->stats.irq_max_cycles) u->stats.irq_max_cycles = cycles;
+    // wake a reader waiting on either core
+    __sev();
+}
+
 void uart0_handler(void)
 {
-    uart_irq_rx(&u0);
-    uart_irq_tx(&u0);
+    uart_irq(&u0);
 }
 
 void uart1_handler(void)
 {
-    uart_irq_rx(&u1);
-    uart_irq_tx(&u1);
+    uart_irq(&u1);
 }
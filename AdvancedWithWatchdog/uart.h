@@ -3,17 +3,74 @@
 
 #include "ring_buffer.h"
 
+// buffer sizes are powers of two, set at compile time, e.g. -DUART_RX_BUFFER_BITS=9
+#ifndef UART_RX_BUFFER_BITS
+#define UART_RX_BUFFER_BITS 8                // receive ring of 2^8 bytes, aligned so the DMA write address wraps
+#endif
+#ifndef UART_TX_BUFFER_BITS
+#define UART_TX_BUFFER_BITS 8
+#endif
+#define UART_RX_BUFFER_SIZE  ( 1 << UART_RX_BUFFER_BITS )
+#define UART_TX_BUFFER_SIZE  ( 1 << UART_TX_BUFFER_BITS )
+#define UART_RX_DMA_COUNT 0xFFFFFFFFu        // transfers per run of the DMA channel, it is restarted when done
+#define UART_RX_IDLE_CHARS 4                 // quiet character times that end a response
+#define UART_RX_POLL_US 10000                // a quiet line under DMA is looked at this often, the ring fills in 22 ms
+#define UART_TX_DESCRIPTORS 16               // referenced writes and runs of copies waiting at a time, a power of two
+
+// A write waiting to be sent: bytes the caller keeps in place, or with data NULL, bytes copied to the TX ring
+typedef struct uart_tx_desc_ {
+    const uint8_t *data;
+    int length;
+} uart_tx_desc;
+
+// Counted since the last uart_take_stats(), peaks are the highest seen in that time
+typedef struct uart_stats_ {
+    uint32_t rx_dropped;                     // received bytes lost: RX ring full or lapped by the DMA
+    uint32_t tx_dropped;                     // bytes uart_write() could not queue
+    uint32_t rx_high_water;                  // most bytes waiting in the RX ring
+    uint32_t tx_high_water;
+    uint32_t irqs;
+    uint32_t irq_max_cycles;                 // longest interrupt handler run, SysTick cycles
+} uart_stats;
+
 void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed);
+void uart_set_speed(int uart_nr, int speed);
+bool uart_rx_dma(int uart_nr);
+ring_buffer *uart_rx_ring(int uart_nr);
+bool uart_rx_idle(int uart_nr);
+bool uart_rx_wait(int uart_nr, absolute_time_t deadline);
+int uart_read_until(int uart_nr, uint8_t *buffer, int size, uint8_t delimiter, absolute_time_t deadline);
+int uart_read_line(int uart_nr, char *line, int size, absolute_time_t deadline);
+const uart_stats *uart_get_stats(int uart_nr);
+void uart_take_stats(int uart_nr, uart_stats *stats);
 int uart_read(int uart_nr, uint8_t *buffer, int size);
 int uart_write(int uart_nr, const uint8_t *buffer, int size);
+bool uart_write_ref(int uart_nr, const uint8_t *buffer, int size, uint32_t *ticket);
+bool uart_tx_done(int uart_nr, uint32_t ticket);
+bool uart_tx_ready(int uart_nr);
 int uart_send(int uart_nr, const char *str);
+void uart_irq_attach(int uart_nr);
+void uart_irq_detach(int uart_nr);
 
 typedef struct {
     ring_buffer tx;
     ring_buffer rx;
+    uart_tx_desc tx_desc[UART_TX_DESCRIPTORS];
+    uint32_t tx_desc_head;                   // written by the writer only, descriptors queued so far
+    uint32_t tx_desc_tail;                   // written by the TX interrupt only, descriptors sent so far
+    int tx_offset;                           // bytes of the descriptor at the tail already sent
     uart_inst_t *uart;
     int irqn;
     irq_handler_t handler;
+    bool ready;                              // set up, the buffers are in place
+    int speed;
+    int dma_channel;                         // receiving by DMA if >= 0, by the RX interrupt otherwise
+    uint32_t dma_base;                       // bytes received by earlier runs of the DMA channel
+    uint32_t idle_us;                        // UART_RX_IDLE_CHARS at the baud rate
+    uint32_t rx_seen;                        // head at the last idle check or wait
+    uint32_t rx_changed_us;                  // time head last moved
+    bool rx_burst;                           // bytes received since the line was last idle
+    uart_stats stats;
 } uart_t;
 uart_t *uart_get_handle(int uart_nr);
 
@@ -0,0 +1,799 @@
+#include <stdio.h>
+#include <string.h>
+#include "uplink.h"
+#include "airtime.h"
+#include "dutycycle.h"
+#include "adr.h"
+#include "downlink.h"
+#include "metrics.h"
+#include "debuglog.h"
+
+#ifdef DEBUG_PRINT
+#define DBG_PRINT(f_, ...)  debugLog((f_), ##__VA_ARGS__)
+#define DBG_STRING(f_, s_)  debugLogString((f_), (s_))
+#else
+#define DBG_PRINT(f_, ...)
+#define DBG_STRING(f_, s_)
+#endif
+
+//////////////////////////////////////////////////
+//              GLOBAL VARIABLES                //
+//////////////////////////////////////////////////
+
+static const modem_io *modem = NULL;
+static uplink queue[UPLINK_QUEUE_SIZE];
+static uplink *in_flight = NULL;
+static uint32_t deadline_ms;
+static uint32_t sent_ms;                     // when the uplink in flight was sent to the modem
+static char response[UPLINK_RESPONSE_LEN];
+static int response_len;
+static uplink_control control;
+static uplink_control power_control;         // sleep and wake, kept apart so they never wait for the control slot
+static uplink_control *active_control = NULL;    // control command in flight
+static bool low_power = false;
+static modem_power power = MODEM_AWAKE;
+static uint32_t power_changed_ms;            // when the last sleep or wake command was sent
+static uint32_t wake_lead_ms = UPLINK_WAKE_LATENCY_MS;
+static uint32_t poll_ms;
+static int current_dr = LORA_DEFAULT_DR;
+static int requested_dr;
+static uint32_t random_state = 1;
+static uplink_stats stats;
+
+//////////////////////////////////////////////////
+//              UPLINK FUNCTIONS                //
+//////////////////////////////////////////////////
+
+/**********************************************************************************************************************
+ * \brief: Xorshift pseudo random number generator for the backoff jitter.
+ *
+ * \param:
+ *
+ * \return: uint32_t pseudo random number
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static uint32_t nextRandom() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**********************************************************************************************************************
+ * \brief: Calculates the wait before the next attempt: exponential backoff with equal jitter, so that the wait is
+ *         between half and all of base * 2^(attempts - 1), limited to UPLINK_BACKOFF_MAX_MS.
+ *
+ * \param: 1 param: number of attempts made so far.
+ *
+ * \return: wait in ms
+ *
+ * \remarks: Jitter keeps a fleet of dispensers that lost the network together from retrying in lockstep.
+ **********************************************************************************************************************/
+static uint32_t backoff(uint8_t attempts) {
+    uint32_t window = UPLINK_BACKOFF_BASE_MS;
+
+    while (--attempts > 0 && window < UPLINK_BACKOFF_MAX_MS) {
+        window *= 2;
+    }
+    if (window > UPLINK_BACKOFF_MAX_MS) {
+        window = UPLINK_BACKOFF_MAX_MS;
+    }
+    return window / 2 + nextRandom() % (window / 2 + 1);
+}
+
+/**********************************************************************************************************************
+ * \brief: Formats the AT command for an uplink: AT+MSG / AT+CMSG for text, AT+MSGHEX / AT+CMSGHEX for binary payload.
+ *
+ * \param: 2 params: pointer to the uplink and the buffer of UPLINK_COMMAND_LEN bytes to format to.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void formatCommand(const uplink *msg, char *command) {
+    static const char hex[] = "0123456789ABCDEF";
+    bool confirmed = msg->flags & UPLINK_CONFIRMED;
+    int pos;
+
+    if (msg->flags & UPLINK_BINARY) {
+        pos = sprintf(command, confirmed ? "AT+CMSGHEX=\"" : "AT+MSGHEX=\"");
+        for (int i = 0; i < msg->length; i++) {
+            command[pos++] = hex[msg->payload[i] >> 4];
+            command[pos++] = hex[msg->payload[i] & 0x0F];
+        }
+    } else {
+        pos = sprintf(command, confirmed ? "AT+CMSG=\"" : "AT+MSG=\"");
+        memcpy(&command[pos], msg->payload, msg->length);
+        pos += msg->length;
+    }
+    strcpy(&command[pos], "\"\r\n");
+}
+
+/**********************************************************************************************************************
+ * \brief: Closes the exchange of the uplink in flight. A delivered uplink is released and its latency recorded, a
+ *         failed one is rescheduled with backoff until it runs out of retries.
+ *
+ * \param: 2 params: boolean delivered and current time in ms.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void finishAttempt(bool delivered, uint32_t now_ms) {
+    uplink *msg = in_flight;
+    in_flight = NULL;
+
+    if (true == delivered) {
+        uint32_t latency = now_ms - msg->queued_ms;
+        stats.delivered++;
+        stats.attempts[msg->attempts - 1]++;
+        stats.latency_last_ms = latency;
+        stats.latency_total_ms += latency;
+        metricsRecord(MH_DELIVERY, (int32_t) latency);
+        if (latency > stats.latency_max_ms) {
+            stats.latency_max_ms = latency;
+        }
+        DBG_PRINT("Uplink delivered in %u ms, %u attempt(s).\n", latency, msg->attempts);
+        msg->state = UPLINK_FREE;
+    } else if (msg->attempts > UPLINK_MAX_RETRIES) {
+        stats.failed++;
+        DBG_PRINT("Uplink failed after %u attempts.\n", msg->attempts);
+        msg->state = UPLINK_FREE;
+    } else {
+        uint32_t wait = backoff(msg->attempts);
+        stats.retries++;
+        DBG_PRINT("Uplink not delivered, retry in %u ms.\n", wait);
+        msg->next_attempt_ms = now_ms + wait;
+        msg->state = UPLINK_PENDING;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Collects the modem response of the uplink in flight and decides the outcome once the modem reports Done, an
+ *         error, or the exchange times out.
+ *
+ * \param: 1 param: current time in ms.
+ *
+ * \return:
+ *
+ * \remarks: A confirmed uplink is delivered only if "ACK Received" was seen before Done.
+ **********************************************************************************************************************/
+static void checkResponse(uint32_t now_ms) {
+    static const char *done[] = {"+MSG: Done", "+CMSG: Done", "+MSGHEX: Done", "+CMSGHEX: Done"};
+    bool confirmed = in_flight->flags & UPLINK_CONFIRMED;
+    bool binary = in_flight->flags & UPLINK_BINARY;
+    int received = modem->read((uint8_t *) &response[response_len], UPLINK_RESPONSE_LEN - 1 - response_len);
+
+    downlinkFeed(&response[response_len], received);
+    response_len += received;
+    response[response_len] = '\0';
+
+    if (strstr(response, done[2 * binary + confirmed]) != NULL) {
+        bool acked = strstr(response, "ACK Received") != NULL;
+        metricsRecord(MH_EXCHANGE, (int32_t) (now_ms - sent_ms));
+        if (true == confirmed && false == acked) {
+            stats.no_ack++;
+            metricsCount(MC_NO_ACKS);
+        } else if (true == acked) {
+            metricsCount(MC_ACKS);
+        }
+        adrReport(response, confirmed, acked);
+        finishAttempt(false == confirmed || true == acked, now_ms);
+    } else if (strstr(response, "ERROR") != NULL || strstr(response, "Please join") != NULL ||
+               strstr(response, "No band") != NULL || strstr(response, "Length error") != NULL) {
+        DBG_STRING("Modem refused uplink: %s", response);
+        metricsCount(MC_REFUSED);
+        finishAttempt(false, now_ms);
+    } else if ((int32_t) (now_ms - deadline_ms) >= 0) {
+        DBG_PRINT("Uplink timed out.\n");
+        metricsCount(MC_TIMEOUTS);
+        finishAttempt(false, now_ms);
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Collects the modem response of the control command in flight and finishes it once the expected response,
+ *         an error, or the timeout is reached.
+ *
+ * \param: 1 param: current time in ms.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void checkControl(uint32_t now_ms) {
+    bool ok = false;
+
+    uplink_control *finished = active_control;
+    int received = modem->read((uint8_t *) &response[response_len], UPLINK_RESPONSE_LEN - 1 - response_len);
+
+    downlinkFeed(&response[response_len], received);
+    response_len += received;
+    response[response_len] = '\0';
+
+    if (strstr(response, finished->expect) != NULL) {
+        ok = true;
+    } else if (strstr(response, "ERROR") == NULL && (int32_t) (now_ms - deadline_ms) < 0) {
+        return;
+    }
+    DBG_STRING(ok ? "Done: %s\n" : "Failed: %s\n", finished->expect);
+    if (false == ok) {
+        metricsCount(MC_COMMAND_FAILURES);
+    }
+    active_control = NULL;
+    finished->pending = false;
+    if (NULL != finished->done) {
+        finished->done(ok);
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Completes putting the modem to sleep. A modem that refuses AT+LOWPOWER is left awake for good.
+ *
+ * \param: 1 param: boolean ok, true if the modem confirmed that it sleeps.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void sleepDone(bool ok) {
+    if (true == ok) {
+        power = MODEM_SLEEPING;
+        stats.sleeps++;
+    } else {
+        DBG_PRINT("Modem does not sleep, low power disabled.\n");
+        low_power = false;
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Completes waking the modem and updates the wake lead time: it follows a longer wake at once and a shorter one
+ *         slowly, so that scheduled uplinks are not delayed by an occasional slow wake.
+ *
+ * \param: 1 param: boolean ok, true if the modem reported that it is awake.
+ *
+ * \return:
+ *
+ * \remarks: A failed wake leaves the modem asleep, the next poll tries again.
+ **********************************************************************************************************************/
+static void wakeDone(bool ok) {
+    if (false == ok) {
+        stats.wake_failures++;
+        return;
+    }
+    uint32_t latency = poll_ms - power_changed_ms;
+    power = MODEM_AWAKE;
+    stats.wakes++;
+    stats.wake_latency_last_ms = latency;
+    if (latency > stats.wake_latency_max_ms) {
+        stats.wake_latency_max_ms = latency;
+    }
+    wake_lead_ms = latency > wake_lead_ms ? latency : (7 * wake_lead_ms + latency) / 8;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the slowest data rate from the given one up that carries the longest uplink in the queue.
+ *
+ * \param: 1 param: data rate the adaptation asks for.
+ *
+ * \return: data rate index
+ *
+ * \remarks: Holds the data rate up while a long uplink waits, e.g. at DR3 for a text longer than the 51 bytes of
+ *           DR0 - DR2. The adaptation goes on from where it was once the uplink is gone.
+ **********************************************************************************************************************/
+static int fittingDataRate(int dr) {
+    size_t longest = 0;
+
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        if (UPLINK_FREE != queue[i].state && queue[i].length > longest) {
+            longest = queue[i].length;
+        }
+    }
+    while (dr < LORA_DR_COUNT - 1 && longest > dataRate(dr)->max_payload) {
+        dr++;
+    }
+    return dr;
+}
+
+/**********************************************************************************************************************
+ * \brief: Gives up the pending uplinks longer than the data rate in use carries.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks: The modem would refuse them with Length error on every attempt.
+ **********************************************************************************************************************/
+static void dropUnfitting() {
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        if (UPLINK_PENDING == queue[i].state && queue[i].length > dataRate(current_dr)->max_payload) {
+            DBG_PRINT("Uplink of %d bytes does not fit DR%d, dropped\n", (int) queue[i].length, current_dr);
+            metricsCount(MC_REFUSED);
+            stats.failed++;
+            queue[i].state = UPLINK_FREE;
+        }
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Completes a data rate change. If the modem refused it, the adaptation continues from the data rate in use.
+ *
+ * \param: 1 param: boolean ok, true if the modem confirmed the new data rate.
+ *
+ * \return:
+ *
+ * \remarks: Uplinks the refused data rate was to carry are dropped, they do not fit the one in use.
+ **********************************************************************************************************************/
+static void dataRateDone(bool ok) {
+    if (true == ok) {
+        current_dr = requested_dr;
+    } else {
+        adrSetDataRate(current_dr);
+        dropUnfitting();
+    }
+}
+
+/**********************************************************************************************************************
+ * \brief: Reads what the modem sent outside of an exchange. It goes to the downlink parser, so a downlink reported
+ *         after Done or unsolicited is kept, the rest is discarded.
+ *
+ * \param:
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static void drainModem() {
+    int received;
+
+    while ((received = modem->read((uint8_t *) response, UPLINK_RESPONSE_LEN - 1)) > 0) {
+        downlinkFeed(response, received);
+    }
+    response_len = 0;
+}
+
+/**********************************************************************************************************************
+ * \brief: Sends a control command to the modem.
+ *
+ * \param: 2 params: pointer to the control command and current time in ms.
+ *
+ * \return:
+ *
+ * \remarks: A command that could not be sent fails on the next poll instead of waiting for the timeout.
+ **********************************************************************************************************************/
+static void startControl(uplink_control *command, uint32_t now_ms) {
+    drainModem();
+    active_control = command;
+    deadline_ms = now_ms + (0 == modem->send(command->command) ? 0 : UPLINK_CONTROL_TIMEOUT_MS);
+}
+
+/**********************************************************************************************************************
+ * \brief: Puts the modem to sleep or wakes it up.
+ *
+ * \param: 2 params: true to wake, false to sleep, and current time in ms.
+ *
+ * \return:
+ *
+ * \remarks: The time asleep is counted from the sleep command to the wake command.
+ **********************************************************************************************************************/
+static void startPower(bool wake, uint32_t now_ms) {
+    if (true == wake) {
+        stats.asleep_ms += now_ms - power_changed_ms;
+        strcpy(power_control.command, UPLINK_WAKE_COMMAND);
+        strcpy(power_control.expect, UPLINK_WAKE_RESPONSE);
+        power_control.done = wakeDone;
+    } else {
+        strcpy(power_control.command, UPLINK_SLEEP_COMMAND);
+        strcpy(power_control.expect, UPLINK_SLEEP_RESPONSE);
+        power_control.done = sleepDone;
+    }
+    power_control.pending = true;
+    power_changed_ms = now_ms;
+    startControl(&power_control, now_ms);
+}
+
+/**********************************************************************************************************************
+ * \brief: Checks if an alert waits in the queue, due or waiting for a retry.
+ *
+ * \param:
+ *
+ * \return: true: if an alert is pending, false: otherwise
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+static bool alertPending() {
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        if (UPLINK_PENDING == queue[i].state && queue[i].flags & UPLINK_ALERT) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**********************************************************************************************************************
+ * \brief: Checks if the modem may go to sleep: nothing is pending, or the next uplink is scheduled so far ahead that
+ *         sleeping pays off.
+ *
+ * \param: 1 param: current time in ms.
+ *
+ * \return: true: if the modem may sleep, false: otherwise
+ *
+ * \remarks: Retries and uplinks deferred by the duty cycle are scheduled, the modem is woken up for them in time.
+ **********************************************************************************************************************/
+static bool maySleep(uint32_t now_ms) {
+    bool alert = alertPending();
+
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        if (UPLINK_PENDING == queue[i].state && (false == alert || queue[i].flags & UPLINK_ALERT) &&
+            (int32_t) (queue[i].next_attempt_ms - now_ms) < (int32_t) (UPLINK_SLEEP_MIN_MS + wake_lead_ms)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the pending uplink that is due and was queued first. While an alert is pending only alerts are
+ *         considered, routine uplinks wait even if the alert itself waits for a retry.
+ *
+ * \param: 1 param: current time in ms.
+ *
+ * \return: pointer to the uplink, NULL if none is due.
+ *
+ * \remarks: Keeps the duty cycle budget for the alert. An exchange already in flight is not interrupted.
+ **********************************************************************************************************************/
+static uplink *nextDue(uint32_t now_ms) {
+    uplink *next = NULL;
+    bool alert = alertPending();
+
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        if (UPLINK_PENDING == queue[i].state && (false == alert || queue[i].flags & UPLINK_ALERT) &&
+            (int32_t) (now_ms - queue[i].next_attempt_ms) >= 0 &&
+            (NULL == next || (int32_t) (queue[i].queued_ms - next->queued_ms) < 0)) {
+            next = &queue[i];
+        }
+    }
+    return next;
+}
+
+/**********************************************************************************************************************
+ * \brief: Joins a routine text uplink to one of the same kind that waits for its first attempt, if both fit in
+ *         UPLINK_COALESCE_MAX.
+ *
+ * \param: 3 params: pointer to the payload, payload length and flags.
+ *
+ * \return: true: if joined, false: if it has to be queued on its own
+ *
+ * \remarks: The joined uplink keeps the queue time of the older one.
+ **********************************************************************************************************************/
+static bool coalesce(const uint8_t *payload, size_t length, uint8_t flags) {
+    const size_t separator = sizeof(UPLINK_COALESCE_SEPARATOR) - 1;
+
+    if (flags & (UPLINK_ALERT | UPLINK_BINARY)) {
+        return false;
+    }
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        uplink *msg = &queue[i];
+        if (UPLINK_PENDING == msg->state && 0 == msg->attempts && flags == msg->flags &&
+            msg->length + separator + length <= UPLINK_COALESCE_MAX) {
+            memcpy(&msg->payload[msg->length], UPLINK_COALESCE_SEPARATOR, separator);
+            memcpy(&msg->payload[msg->length + separator], payload, length);
+            msg->length += separator + length;
+            stats.coalesced++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**********************************************************************************************************************
+ * \brief: Finds a free place in the queue. An alert takes the place of the routine uplink queued last if the queue is
+ *         full.
+ *
+ * \param: 1 param: flags of the uplink to be queued.
+ *
+ * \return: pointer to the place, NULL if the queue is full
+ *
+ * \remarks: The uplink in flight is never evicted.
+ **********************************************************************************************************************/
+static uplink *freePlace(uint8_t flags) {
+    uplink *newest = NULL;
+
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        if (UPLINK_FREE == queue[i].state) {
+            return &queue[i];
+        }
+        if (UPLINK_PENDING == queue[i].state && 0 == (queue[i].flags & UPLINK_ALERT) &&
+            (NULL == newest || (int32_t) (queue[i].queued_ms - newest->queued_ms) > 0)) {
+            newest = &queue[i];
+        }
+    }
+    if (flags & UPLINK_ALERT && NULL != newest) {
+        stats.evicted++;
+        return newest;
+    }
+    return NULL;
+}
+
+/**********************************************************************************************************************
+ * \brief: Sets the modem interface and seeds the backoff jitter. Empties the queue.
+ *
+ * \param: 2 params: pointer to the modem interface and the random seed.
+ *
+ * \return:
+ *
+ * \remarks: Seed must differ between devices, e.g. taken from the boot time in us.
+ **********************************************************************************************************************/
+void uplinkInit(const modem_io *io, uint32_t seed) {
+    modem = io;
+    random_state = seed ? seed : 1;
+    in_flight = NULL;
+    active_control = NULL;
+    control.pending = false;
+    power = MODEM_AWAKE;
+    wake_lead_ms = UPLINK_WAKE_LATENCY_MS;
+    current_dr = LORA_DEFAULT_DR;
+    memset(queue, 0, sizeof(queue));
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**********************************************************************************************************************
+ * \brief: Queues an uplink. Returns at once, the uplink is sent by uplinkPoll(). Routine text uplinks are joined to a
+ *         waiting one when they fit, an alert evicts a routine uplink from a full queue.
+ *
+ * \param: 4 params: pointer to the payload, payload length, UPLINK_CONFIRMED / UPLINK_BINARY / UPLINK_ALERT flags and
+ *         current time in ms.
+ *
+ * \return: true: if queued, false: if payload is too long or queue is full
+ *
+ * \remarks: The payload is copied, the caller may reuse its buffer.
+ **********************************************************************************************************************/
+bool uplinkEnqueue(const uint8_t *payload, size_t length, uint8_t flags, uint32_t now_ms) {
+    if (length > UPLINK_PAYLOAD_MAX) {
+        return false;
+    }
+    if (true == coalesce(payload, length, flags)) {
+        return true;
+    }
+    uplink *msg = freePlace(flags);
+    if (NULL == msg) {
+        stats.dropped++;
+        return false;
+    }
+    memcpy(msg->payload, payload, length);
+    msg->length = length;
+    msg->flags = flags;
+    msg->attempts = 0;
+    msg->queued_ms = now_ms;
+    msg->next_attempt_ms = now_ms;
+    msg->state = UPLINK_PENDING;
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Runs the uplink state machine: follows the exchange in flight, or sends the next due uplink once the duty
+ *         cycle allows it. Never blocks. With low power on, the modem sleeps while nothing is due and is woken up the
+ *         measured wake latency ahead of the next scheduled uplink. The data rate follows the adaptation, but not
+ *         below the one that carries the longest queued uplink.
+ *
+ * \param: 1 param: current time in ms.
+ *
+ * \return:
+ *
+ * \remarks: Call frequently from the main loop and from waits. An uplink queued while the modem sleeps waits for one
+ *           wake, the wake latency is reported in uplinkStatistics().
+ **********************************************************************************************************************/
+void uplinkPoll(uint32_t now_ms) {
+    char command[UPLINK_COMMAND_LEN];
+
+    if (NULL == modem) {
+        return;
+    }
+    poll_ms = now_ms;
+    if (NULL != active_control) {
+        checkControl(now_ms);
+        return;
+    }
+    if (NULL != in_flight) {
+        checkResponse(now_ms);
+        return;
+    }
+    drainModem();
+
+    int wanted_dr = fittingDataRate(adrDataRate());
+    if (false == control.pending && wanted_dr != current_dr) {
+        char expect[UPLINK_CONTROL_LEN];
+        requested_dr = wanted_dr;
+        snprintf(command, sizeof(command), "AT+DR=DR%d\r\n", requested_dr);
+        snprintf(expect, sizeof(expect), "+DR: DR%d", requested_dr);
+        uplinkControl(command, expect, dataRateDone);
+    }
+    if (MODEM_SLEEPING == power) {
+        if (true == control.pending || NULL != nextDue(now_ms + wake_lead_ms)) {
+            startPower(true, now_ms);
+        }
+        return;
+    }
+    if (true == control.pending) {
+        startControl(&control, now_ms);
+        return;
+    }
+
+    uplink *msg = nextDue(now_ms);
+    if (NULL == msg) {
+        if (true == low_power && true == maySleep(now_ms)) {
+            startPower(false, now_ms);
+        }
+        return;
+    }
+
+    if (msg->length > dataRate(current_dr)->max_payload) {
+        dropUnfitting();
+        return;
+    }
+    uint32_t airtime = uplinkAirtimeUs(current_dr, msg->length);
+    uint32_t delay = dutyCycleDelay(airtime, now_ms);
+    if (DUTY_CYCLE_NEVER == delay) {
+        stats.failed++;
+        msg->state = UPLINK_FREE;
+        return;
+    }
+    if (0 != delay) {
+        msg->next_attempt_ms = now_ms + delay;
+        return;
+    }
+
+    formatCommand(msg, command);
+    if (0 == modem->send(command)) {
+        // not sent, no airtime used: tried again after the base backoff
+        msg->next_attempt_ms = now_ms + UPLINK_BACKOFF_BASE_MS;
+        return;
+    }
+    dutyCycleConsume(airtime, now_ms);
+    msg->attempts++;
+    msg->state = UPLINK_IN_FLIGHT;
+    in_flight = msg;
+    sent_ms = now_ms;
+    metricsCount(MC_UPLINKS);
+    deadline_ms = now_ms + UPLINK_TIMEOUT_MS;
+}
+
+/**********************************************************************************************************************
+ * \brief: Queues a modem command to be sent before the next uplink.
+ *
+ * \param: 3 params: command with line ending, response that confirms it and the function called with the outcome, may
+ *         be NULL.
+ *
+ * \return: true: if queued, false: if another control command is pending or the strings are too long
+ *
+ * \remarks: Control commands take no airtime and are not subject to the duty cycle.
+ **********************************************************************************************************************/
+bool uplinkControl(const char *command, const char *expect, void (*done)(bool ok)) {
+    if (true == control.pending || strlen(command) >= UPLINK_CONTROL_LEN || strlen(expect) >= UPLINK_CONTROL_LEN) {
+        return false;
+    }
+    strcpy(control.command, command);
+    strcpy(control.expect, expect);
+    control.done = done;
+    control.pending = true;
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Checks if all queued uplinks have been handled.
+ *
+ * \param:
+ *
+ * \return: true: if nothing is queued or in flight, false: otherwise
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+bool uplinkIdle() {
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        if (UPLINK_FREE != queue[i].state) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**********************************************************************************************************************
+ * \brief: Turns the modem sleep between uplinks on or off.
+ *
+ * \param: 1 param: boolean enable.
+ *
+ * \return:
+ *
+ * \remarks: Turned off again if the modem refuses AT+LOWPOWER. A sleeping modem is woken up by the next uplink.
+ **********************************************************************************************************************/
+void uplinkLowPower(bool enable) {
+    low_power = enable;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns whether the modem sleeps.
+ *
+ * \param:
+ *
+ * \return: MODEM_AWAKE or MODEM_SLEEPING
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+modem_power uplinkModemPower() {
+    return power;
+}
+
+/**********************************************************************************************************************
+ * \brief: Counts the free places in the uplink queue.
+ *
+ * \param:
+ *
+ * \return: number of uplinks that can be enqueued.
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int uplinkQueueSpace() {
+    int space = 0;
+    for (int i = 0; i < UPLINK_QUEUE_SIZE; i++) {
+        if (UPLINK_FREE == queue[i].state) {
+            space++;
+        }
+    }
+    return space;
+}
+
+/**********************************************************************************************************************
+ * \brief: Sets the data rate the modem is known to use. Uplinks switch to adrDataRate() with AT+DR when it differs.
+ *
+ * \param: 1 param: data rate index.
+ *
+ * \return:
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+void uplinkSetDataRate(int dr) {
+    current_dr = dr;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the data rate the modem uses for uplinks.
+ *
+ * \param:
+ *
+ * \return: data rate index
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int uplinkDataRate() {
+    return current_dr;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the longest payload an uplink queued now can carry: the limit of the slower of the data rate in use
+ *         and the one the adaptation asks for, so the uplink still fits after a pending data rate change.
+ *
+ * \param:
+ *
+ * \return: payload length in bytes, at most UPLINK_PAYLOAD_MAX
+ *
+ * \remarks:
+ **********************************************************************************************************************/
+int uplinkMaxPayload() {
+    int dr = adrDataRate() < current_dr ? adrDataRate() : current_dr;
+    int max_payload = dataRate(dr)->max_payload;
+    return max_payload < UPLINK_PAYLOAD_MAX ? max_payload : UPLINK_PAYLOAD_MAX;
+}
+
+/**********************************************************************************************************************
+ * \brief: Returns the delivery statistics: delivered and failed counts, retries and latency.
+ *
+ * \param:
+ *
+ * \return: pointer to the statistics.
+ *
+ * \remarks: Average latency is latency_total_ms / delivered.
+ **********************************************************************************************************************/
+const uplink_stats *uplinkStatistics() {
+    return &stats;
+}
@@ -0,0 +1,106 @@
+#ifndef UPLINK
+#define UPLINK
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define UPLINK_QUEUE_SIZE 8
+#define UPLINK_PAYLOAD_MAX 115               // longest payload of DR3, frames at faster data rates are not longer
+#define UPLINK_COMMAND_LEN ( 2 * UPLINK_PAYLOAD_MAX + 20 )
+#define UPLINK_RESPONSE_LEN 192
+
+#define UPLINK_MAX_RETRIES 4
+#define UPLINK_BACKOFF_BASE_MS 8000          // doubled on every retry
+#define UPLINK_BACKOFF_MAX_MS 300000
+#define UPLINK_TIMEOUT_MS 20000              // modem did not finish the exchange
+#define UPLINK_CONTROL_LEN 32
+#define UPLINK_CONTROL_TIMEOUT_MS 1000
+
+/* Modem sleep between uplinks. Any uart input wakes the LoRa-E5, the 0xFF bytes are lost while it wakes. */
+#define UPLINK_SLEEP_COMMAND "AT+LOWPOWER\r\n"
+#define UPLINK_SLEEP_RESPONSE "+LOWPOWER: SLEEP"
+#define UPLINK_WAKE_COMMAND "\xFF\xFF\xFF\xFF"
+#define UPLINK_WAKE_RESPONSE "+LOWPOWER: WAKEUP"
+#define UPLINK_SLEEP_MIN_MS 10000            // no sleep if an uplink is due sooner
+#define UPLINK_WAKE_LATENCY_MS 50            // wake lead time until the first wake has been measured
+
+/* Uplink flags */
+#define UPLINK_CONFIRMED 0x01                // AT+CMSG, retried until the network acknowledges
+#define UPLINK_BINARY 0x02                   // payload is sent hex encoded with AT+MSGHEX / AT+CMSGHEX
+#define UPLINK_ALERT 0x04                    // sent before routine uplinks, which wait while an alert is pending
+
+/* Routine text uplinks waiting in the queue are joined into one, up to the largest payload of DR0 so that the joined
+ * uplink fits at any data rate */
+#define UPLINK_COALESCE_MAX 51
+#define UPLINK_COALESCE_SEPARATOR "; "
+
+/* Interface to the modem, the uart in the firmware and a simulated modem on the host */
+typedef struct modem_io_ {
+    int (*send)(const char *command);        // bytes sent, 0 if the command could not be sent
+    int (*read)(uint8_t *buffer, int size);
+} modem_io;
+
+typedef enum {
+    MODEM_AWAKE,
+    MODEM_SLEEPING
+} modem_power;
+
+typedef enum {
+    UPLINK_FREE,
+    UPLINK_PENDING,
+    UPLINK_IN_FLIGHT
+} uplink_state;
+
+typedef struct uplink_ {
+    uint8_t payload[UPLINK_PAYLOAD_MAX];
+    uint8_t length;
+    uint8_t flags;
+    uint8_t attempts;
+    uplink_state state;
+    uint32_t queued_ms;
+    uint32_t next_attempt_ms;
+} uplink;
+
+/* Modem command sent between uplinks, e.g. a data rate change */
+typedef struct uplink_control_ {
+    char command[UPLINK_CONTROL_LEN];
+    char expect[UPLINK_CONTROL_LEN];         // response that confirms the command
+    void (*done)(bool ok);
+    bool pending;
+} uplink_control;
+
+typedef struct uplink_stats_ {
+    uint32_t delivered;                      // acknowledged, or accepted by the modem if unconfirmed
+    uint32_t failed;                         // given up after UPLINK_MAX_RETRIES
+    uint32_t dropped;                        // queue was full
+    uint32_t evicted;                        // routine uplinks removed from a full queue for an alert
+    uint32_t coalesced;                      // routine uplinks joined to one already waiting
+    uint32_t retries;                        // retransmissions in total
+    uint32_t no_ack;                         // confirmed attempts that got no acknowledgement
+    uint32_t attempts[UPLINK_MAX_RETRIES + 1];   // delivered uplinks by number of attempts needed
+    uint32_t latency_last_ms;                // from enqueue to delivery
+    uint32_t latency_max_ms;
+    uint32_t latency_total_ms;
+    uint32_t sleeps;
+    uint32_t wakes;
+    uint32_t wake_failures;                  // no wake up response, retried on the next poll
+    uint32_t wake_latency_last_ms;           // from the wake bytes to the wake up response
+    uint32_t wake_latency_max_ms;
+    uint32_t asleep_ms;                      // time the modem has slept in total
+} uplink_stats;
+
+void uplinkInit(const modem_io *io, uint32_t seed);
+bool uplinkEnqueue(const uint8_t *payload, size_t length, uint8_t flags, uint32_t now_ms);
+void uplinkPoll(uint32_t now_ms);
+bool uplinkControl(const char *command, const char *expect, void (*done)(bool ok));
+bool uplinkIdle();
+void uplinkLowPower(bool enable);
+modem_power uplinkModemPower();
+int uplinkQueueSpace();
+void uplinkSetDataRate(int dr);
+int uplinkDataRate();
+int uplinkMaxPayload();
+const uplink_stats *uplinkStatistics();
+
+#endif